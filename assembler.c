@@ -1,130 +1,388 @@
+#define _POSIX_C_SOURCE 200112L
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include "output_module.h"
 #include "helper.h"
 #include "first_pass.h"
 #include "second_pass.h"
 #include "pre_assembler.h"
+#include "batch_mode.h"
+#include "assembly_unit.h"
+#include "pipeline.h"
+#include "dead_data.h"
+#include "parallel_passes.h"
+#include "watch_mode.h"
+#include "trace.h"
+#include "phase_counters.h"
 
 
 /**
  * Full Processing of .as file
  * @param filename The filename as directed in mmn14
+ * @param macros The macro bodies parsed by the pre assembler
+ * @param origins The origins of the expanded lines, NULL if not kept
+ * @param counters The counters of the file's phases, NULL if not counting
  * @return True if good False if bad
  */
-static bool process_file(char *filename);
+static bool process_file(char *filename, macro_ir_table *macros, line_origin_log *origins, file_counters *counters);
+
+/**
+ * Macro expansion and full processing of a single file
+ * @param filename The filename as directed in mmn14
+ * @return True if good False if bad
+ */
+static bool assemble_file(char *filename);
+
+/**
+ * Macro expansion and full processing of a single file by the sequential driver
+ * @param filename The filename as directed in mmn14
+ * @param macros The parsed lines, the file's macro bodies are added to it
+ * @param includes Where the paths of the included files are added, NULL if not kept
+ * @return True if good False if bad
+ */
+static bool assemble_with_macros(char *filename, macro_ir_table *macros, include_log *includes);
+
+/**
+ * Macro expansion and the validations of both passes of a single file (--check). No code word is built and no file
+ * is written, not even the .am file.
+ * @param filename The filename as directed in mmn14
+ * @param macros The parsed lines, the file's macro bodies are added to it
+ * @param includes Where the paths of the included files are added, NULL if not kept
+ * @return True if good False if bad
+ */
+static bool check_file(char *filename, macro_ir_table *macros, include_log *includes);
+
+/**
+ * Processing of a watched file: its kept unit is updated, or if it can't be (errors, or options of the whole
+ * image), the file is assembled or checked in full
+ * @param filename The filename as directed in mmn14
+ * @param kept The unit of the file's last assembly
+ * @param includes Where the paths of the included files are added
+ * @return True if good False if bad
+ */
+static bool reassemble_file(char *filename, incremental_unit *kept, include_log *includes);
+
+/**
+ * Expanded line handler of check_file, runs the first pass on the line
+ * @param context The line_splitter of the file
+ * @param line The expanded line
+ */
+static void check_expanded_line(void *context, char *line);
+
+/**
+ * Parses the options (-j N, --mem-budget MB, --pipeline, --threads N, --watch, --trace FILE, --counters, --check,
+ * --sym, --map, --strip-data, --pool-strings, --report, --report-json) at argv[*i], advancing *i past the option's
+ * value
+ * @return True if argv[*i] was an option
+ */
+static bool parse_option(int argc, char *argv[], int *i, batch_options *options);
+
+/**
+ * Returns the value of the option at argv[*i], advancing *i to it. Exits if the option is the last argument, rather
+ * than taking the next file as its value or the option as a file.
+ * @return The value
+ */
+static char *get_option_value(int argc, char *argv[], int *i);
+
+/** Whether files are assembled by the pipelined driver (--pipeline) */
+static bool use_pipeline = FALSE;
+
+/** Whether the files are reassembled whenever their sources change (--watch) */
+static bool watch_sources = FALSE;
+
+/** Maximum threads of the passes over a single file (--threads) */
+static int pass_threads = 1;
+
+/** Optional outputs and passes of every file (--sym, --map, --strip-data, --pool-strings, --report, --report-json,
+ * --check) */
+static assembly_options output_options = {FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE};
 
 /**
  * Main of the program
  */
 int main(int argc, char *argv[]) {
-	int i;
+	int i, watched_count = 0;
+	/* The files of the command line, when watching them */
+	char **watched = (char **) better_malloc(argc * sizeof(char *));
 	/* To break line if needed */
 	bool succeeded = TRUE;
+	/* Whether any file failed, the exit status when only checking */
+	bool any_failed = FALSE;
+	batch_options options;
+	long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	options.max_workers = online_cpus > 0 ? (int) online_cpus : 1;
+	options.memory_budget = 0;
+	/* Included files are read before forking, so the workers share them */
+	options.prepare = preload_includes;
+
 	/* Process each file by arguments */
 	for (i = 1; i < argc; ++i) {
+		if (parse_option(argc, argv, &i, &options)) continue;
 		/* if last process failed and there's another file, break line: */
 		if (!succeeded) puts("");
+		/* @manifest (or @- for stdin) lists the files to process in a batch */
+		if (argv[i][0] == MANIFEST_PREFIX) {
+			succeeded = run_manifest(argv[i] + 1, &options, assemble_file) == 0;
+			if (!succeeded) any_failed = TRUE;
+			continue;
+		}
+		/* Watched files are assembled by the watch loop */
+		if (watch_sources) {
+			watched[watched_count++] = argv[i];
+			continue;
+		}
 		/* foreach argument (file name), send it for full processing. */
-        expand_macros(argv[i]);
-
-		succeeded = process_file(argv[i]);
+		succeeded = assemble_file(argv[i]);
+		if (!succeeded) any_failed = TRUE;
 		/* Line break if failed */
 	}
-	return 0;
+	if (watched_count > 0) {
+		int result = run_watch(watched, watched_count, reassemble_file);
+		free(watched);
+		finish_trace();
+		report_total_counters();
+		return result;
+	}
+	free(watched);
+	finish_trace();
+	report_total_counters();
+	/* A check is usually run by scripts, which only look at the status */
+	return output_options.check_only && any_failed;
+}
+
+static bool parse_option(int argc, char *argv[], int *i, batch_options *options) {
+	if (strcmp(argv[*i], "--sym") == 0) {
+		output_options.symbol_snapshot = TRUE;
+		return TRUE;
+	}
+	if (strcmp(argv[*i], "--map") == 0) {
+		output_options.line_map = TRUE;
+		return TRUE;
+	}
+	if (strcmp(argv[*i], "--strip-data") == 0) {
+		output_options.strip_data = TRUE;
+		return TRUE;
+	}
+	if (strcmp(argv[*i], "--pool-strings") == 0) {
+		output_options.pool_strings = TRUE;
+		return TRUE;
+	}
+	if (strcmp(argv[*i], "--report") == 0) {
+		output_options.report = TRUE;
+		return TRUE;
+	}
+	if (strcmp(argv[*i], "--report-json") == 0) {
+		output_options.report_json = TRUE;
+		return TRUE;
+	}
+	if (strcmp(argv[*i], "--check") == 0) {
+		output_options.check_only = TRUE;
+		return TRUE;
+	}
+	if (strcmp(argv[*i], "--watch") == 0) {
+		watch_sources = TRUE;
+		return TRUE;
+	}
+	if (strcmp(argv[*i], "--trace") == 0) {
+		/* Before any thread or worker starts, so they record into the shared buffers */
+		if (!start_trace(get_option_value(argc, argv, i))) {
+			printf_error("[ERROR] Unable to start the trace: %s\n", argv[*i]);
+		}
+		return TRUE;
+	}
+	if (strcmp(argv[*i], "--counters") == 0) {
+		/* Before any thread or worker starts, so they're counted and add to the totals */
+		if (!start_phase_counters()) printf_error("[ERROR] Unable to start the counters\n");
+		return TRUE;
+	}
+	if (strcmp(argv[*i], "--pipeline") == 0) {
+		use_pipeline = TRUE;
+		return TRUE;
+	}
+	if (strcmp(argv[*i], "--threads") == 0) {
+		pass_threads = atoi(get_option_value(argc, argv, i));
+		if (pass_threads < 1) pass_threads = 1;
+		return TRUE;
+	}
+	if (strcmp(argv[*i], "-j") == 0 || strcmp(argv[*i], "--jobs") == 0) {
+		options->max_workers = atoi(get_option_value(argc, argv, i));
+		if (options->max_workers < 1) options->max_workers = 1;
+		return TRUE;
+	}
+	if (strcmp(argv[*i], "--mem-budget") == 0) {
+		/* Given in megabytes */
+		options->memory_budget = atol(get_option_value(argc, argv, i)) * 1024L * 1024L;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+static char *get_option_value(int argc, char *argv[], int *i) {
+	if (*i + 1 >= argc) {
+		printf_error("[ERROR] Missing value of option %s", argv[*i]);
+		exit(1);
+	}
+	return argv[++(*i)];
+}
+
+static bool assemble_file(char *filename) {
+	bool succeeded;
+	macro_ir_table macros;
+	double start = trace_now();
+	/* The pipeline formats code words during the second pass, before the data can be stripped,
+	 * and its phases overlap, so they can't be counted apart */
+	if (use_pipeline && !output_options.check_only && !output_options.strip_data && !is_counting_phases()) {
+		succeeded = assemble_file_pipelined(filename, &output_options);
+	} else {
+		init_macro_ir_table(&macros);
+		succeeded = output_options.check_only ? check_file(filename, &macros, NULL) :
+		            assemble_with_macros(filename, &macros, NULL);
+		free_macro_ir_table(&macros);
+	}
+	trace_span("assemble_file", filename, start);
+	return succeeded;
+}
+
+static bool assemble_with_macros(char *filename, macro_ir_table *macros, include_log *includes) {
+	bool succeeded;
+	line_origin_log origins;
+	file_counters counters;
+	counter_sample sample;
+	double start = trace_now();
+	bool is_counting = is_counting_phases();
+	init_line_origin_log(&origins);
+	init_file_counters(&counters);
+	if (is_counting) read_counter_sample(&sample);
+	succeeded = expand_macros(filename, macros, output_options.line_map ? &origins : NULL, includes);
+	if (is_counting) add_phase_sample(&counters, EXPAND_PHASE, &sample);
+	trace_span("expand_macros", filename, start);
+	/* Nothing to assemble if the source couldn't be expanded */
+	succeeded = succeeded && process_file(filename, macros, output_options.line_map ? &origins : NULL,
+	                                      is_counting ? &counters : NULL);
+	if (is_counting) report_file_counters(filename, &counters);
+	free_line_origin_log(&origins);
+	return succeeded;
+}
+
+static bool check_file(char *filename, macro_ir_table *macros, include_log *includes) {
+	bool succeeded;
+	long i;
+	line_splitter splitter;
+	double start = trace_now();
+	assembly_unit *unit = create_assembly_unit(filename);
+	unit->macro_ir = macros;
+	/* None of the optional outputs, they all need the code words */
+	unit->options.check_only = TRUE;
+
+	/* The first pass runs on the lines as they're expanded, macro body lines are spliced */
+	init_line_splitter(&splitter, unit);
+	succeeded = expand_macros_to(filename, check_expanded_line, &splitter, macros, NULL, includes);
+	finish_first_pass_text(&splitter);
+	if (succeeded) {
+		finish_first_pass(unit);
+		trace_span("first_pass", filename, start);
+		if (unit->success) {
+			start = trace_now();
+			for (i = 0; i < unit->line_count; i++) {
+				second_pass_line(unit, i);
+			}
+			trace_span("second_pass", filename, start);
+		}
+		succeeded = unit->success;
+	}
+	free_assembly_unit(unit);
+	return succeeded;
 }
 
-static bool process_file(char *filename) {
-    /* Memory address counters */
+static bool reassemble_file(char *filename, incremental_unit *kept, include_log *includes) {
+	bool succeeded;
+	macro_ir_table macros;
+	/* Phases are counted in a full assembly, like any other file's */
+	if (!is_counting_phases() && update_incremental_unit(kept, &output_options, pass_threads, includes)) return TRUE;
+	init_macro_ir_table(&macros);
+	succeeded = output_options.check_only ? check_file(filename, &macros, includes) :
+	            assemble_with_macros(filename, &macros, includes);
+	free_macro_ir_table(&macros);
+	return succeeded;
+}
+
+static void check_expanded_line(void *context, char *line) {
+	first_pass_text((line_splitter *) context, line, strlen(line));
+}
+
+static bool process_file(char *filename, macro_ir_table *macros, line_origin_log *origins, file_counters *counters) {
     int temp_c;
-    long ic = IC_INIT_VALUE, dc = 0, ICF, DCF;
-    bool success_flag = TRUE; /* is succeeded so far */
-    char *filename_with_ext;
+    bool success_flag; /* is succeeded so far */
+    double start;
+    counter_sample sample;
     char temp_line[MAX_LINE_LENGTH + 2]; /* used for line reading */
     FILE *file_des; /* Current assembly file descriptor to process */
-    long data_img[CODE_ARR_IMG_LENGTH]; /* Contains an image of the machine code */
-    machine_word *code_img[CODE_ARR_IMG_LENGTH];
-    /* Our symbol table */
-    table symbol_table = NULL;
-    line_descriptor current_line;
-
-    /* Concat extensionless filename with POST_MARCO_SUFFIX extension */
-    filename_with_ext = strcat_to_new(filename, POST_MARCO_SUFFIX);
+    assembly_unit *unit = create_assembly_unit(filename);
+    unit->macro_ir = macros;
+    unit->options = output_options;
+    unit->origins = origins;
 
     /* Try to open file, if something wrong skip */
-    if ((file_des = fopen(filename_with_ext, "r")) == NULL) {
+    if ((file_des = fopen(unit->full_file_name, "r")) == NULL) {
         /* if file couldn't be opened, write to stderr. */
         printf_error("[ERROR] Unable to read file: %s\n", filename);
-        free(filename_with_ext); /*free the memory we allocated to the string concat */
+        free_assembly_unit(unit);
         return FALSE;
     }
 
-    /* start first pass: */
-    current_line.full_file_name = filename_with_ext;
-    current_line.content = temp_line; /* We use temp_line to read from the file, but it stays at same location. */
-    /* Read line - stop if read failed (when NULL returned) - usually when EOF. increase line counter for error printing. */
-    for (current_line.line_number = 1;
-         fgets(temp_line, MAX_LINE_LENGTH + 2, file_des) != NULL;
-         current_line.line_number++) {
+    /* Read the lines for the first pass: */
+    /* Read line - stop if read failed (when NULL returned) - usually when EOF. */
+    while (fgets(temp_line, MAX_LINE_LENGTH + 2, file_des) != NULL) {
         /* if line too long, the buffer doesn't include the '\n' char OR the file isn't on end. */
-        if (strchr(temp_line, '\n') == NULL && !feof(file_des)) {
-            /* Print message and prevent further line processing, as well as second pass.  */
-            fprintf_error_specific(current_line,
-                                   "[ERROR] Line is longer than MAX_LINE_LENGTH. Maximum line length should be %d.",
-                                   MAX_LINE_LENGTH);
-            success_flag = FALSE;
+        bool is_too_long = strchr(temp_line, '\n') == NULL && !feof(file_des);
+        if (is_too_long) {
             /* skip leftovers */
             do {
                 temp_c = fgetc(file_des);
             } while (temp_c != '\n' && temp_c != EOF);
-        } else {
-            if (!process_line_first_pass(current_line, &ic, &dc, code_img, data_img, &symbol_table)) {
-                if (success_flag) {
-                    ICF = -1;
-                    success_flag = FALSE;
-                }
-            }
         }
+        add_source_line(unit, temp_line, is_too_long);
     }
+    fclose(file_des);
 
-    /* Step 18 Save IC and DC*/
-    ICF = ic;
-    DCF = dc;
-
-    /* If we succeeded in step 1 we can continue to the second pass and finish the first pass */
-    if (success_flag) {
-
-        ic = IC_INIT_VALUE;
+    start = trace_now();
+    if (counters != NULL) read_counter_sample(&sample);
+    run_first_pass(unit, pass_threads);
 
-        /* First pass step 19 with ICF value */
-        update_symbol_table_value(symbol_table, ICF, DATA_SYMBOL);
+    finish_first_pass(unit);
+    if (counters != NULL) add_phase_sample(counters, FIRST_PASS_PHASE, &sample);
+    trace_span("first_pass", filename, start);
 
-        /* First pass finished successfully */
-        rewind(file_des); /* Readfile again from the beginning */
-
-        /* Step 2 start */
-        for (current_line.line_number = 1; !feof(file_des); current_line.line_number++) {
-            int i = 0;
-            fgets(temp_line, MAX_LINE_LENGTH, file_des); /* Get line */
-            SKIP_TO_NEXT_NON_WHITESPACE(temp_line, i)
-            if (code_img[ic - IC_INIT_VALUE] != NULL || temp_line[i] == '.')
-                if(process_line_second_pass(current_line, &ic, code_img, &symbol_table) == FALSE){
-                    success_flag = FALSE;
-                }
-        }
+    /* If we succeeded in step 1 we can continue to the second pass */
+    if (unit->success) {
+        /* Step 2 start, the lines are kept in memory from the first pass */
+        start = trace_now();
+        if (counters != NULL) read_counter_sample(&sample);
+        run_second_pass(unit, pass_threads);
+        if (counters != NULL) add_phase_sample(counters, SECOND_PASS_PHASE, &sample);
+        trace_span("second_pass", filename, start);
 
         /* Write files if second pass succeeded */
-        if (success_flag) {
+        if (unit->success) {
+            if (unit->options.strip_data) {
+                printf("%s: removed %ld unreferenced data words\n", filename, strip_unreferenced_data(unit));
+            }
             /* Everything was done. Write to *filename.ob/.ext/.ent */
-            success_flag = write_output_files(code_img, data_img, ICF, DCF, filename, symbol_table);
+            start = trace_now();
+            if (counters != NULL) read_counter_sample(&sample);
+            unit->success = write_output_files(unit->code_img, unit->data_img, unit->icf, unit->dcf, filename,
+                                               unit->symbol_table, &unit->external_references, pass_threads) &&
+                            write_optional_outputs(unit);
+            if (counters != NULL) add_phase_sample(counters, OUTPUT_PHASE, &sample);
+            trace_span("write_outputs", filename, start);
         }
     }
 
     /* CLEANUP Time */
-    free(filename_with_ext);
-    free_table(symbol_table);
-    free_code_image(code_img, ICF);
+    success_flag = unit->success;
+    free_assembly_unit(unit);
 
     return success_flag;
-}
\ No newline at end of file
+}
@@ -0,0 +1,259 @@
+/* State of a single file through both passes, and the per line steps that drive it */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "assembly_unit.h"
+#include "helper.h"
+#include "first_pass.h"
+#include "second_pass.h"
+#include "symbol_snapshot.h"
+#include "string_pool.h"
+#include "trace.h"
+
+assembly_unit *create_assembly_unit(char *filename) {
+    assembly_unit *unit = (assembly_unit *) better_malloc(sizeof(assembly_unit));
+    unit->filename = filename;
+    /* Concat extensionless filename with POST_MARCO_SUFFIX extension */
+    unit->full_file_name = strcat_to_new(filename, POST_MARCO_SUFFIX);
+    unit->ic = unit->icf = IC_INIT_VALUE;
+    unit->dc = unit->dcf = 0;
+    unit->success = TRUE;
+    unit->lines = NULL;
+    unit->line_count = unit->line_capacity = 0;
+    /* The second pass tells code lines by the words they left in the image */
+    memset(unit->code_img, 0, sizeof(unit->code_img));
+    unit->symbol_table = NULL;
+    init_external_reference_log(&unit->external_references);
+    unit->macro_ir = NULL;
+    unit->options.symbol_snapshot = FALSE;
+    unit->options.line_map = FALSE;
+    unit->options.strip_data = FALSE;
+    unit->options.pool_strings = FALSE;
+    unit->options.report = FALSE;
+    unit->options.report_json = FALSE;
+    unit->options.check_only = FALSE;
+    unit->origins = NULL;
+    unit->composition = NULL;
+    unit->literal_splits = NULL;
+    unit->literal_split_count = 0;
+    return unit;
+}
+
+void add_source_line(assembly_unit *unit, char *content, bool is_too_long) {
+    if (unit->line_count == unit->line_capacity) {
+        source_line *grown;
+        unit->line_capacity = unit->line_capacity ? unit->line_capacity * 2 : 256;
+        grown = (source_line *) better_malloc(unit->line_capacity * sizeof(source_line));
+        if (unit->line_count) memcpy(grown, unit->lines, unit->line_count * sizeof(source_line));
+        free(unit->lines);
+        unit->lines = grown;
+    }
+    unit->lines[unit->line_count].content = strcat_to_new(content, "");
+    unit->lines[unit->line_count].is_too_long = is_too_long;
+    unit->line_count++;
+}
+
+void init_line_splitter(line_splitter *splitter, assembly_unit *unit) {
+    splitter->unit = unit;
+    splitter->length = 0;
+    splitter->is_skipping = FALSE;
+    splitter->is_passing = TRUE;
+}
+
+void first_pass_text(line_splitter *splitter, char *text, long length) {
+    char *new_line;
+    long count;
+    while (length > 0) {
+        if (splitter->is_skipping) {
+            /* skip leftovers of a too long line */
+            if ((new_line = memchr(text, '\n', length)) == NULL) return;
+            length -= new_line + 1 - text;
+            text = new_line + 1;
+            splitter->is_skipping = FALSE;
+            continue;
+        }
+        /* fgets reads up to MAX_LINE_LENGTH + 1 chars, or through '\n' */
+        count = MAX_LINE_LENGTH + 1 - splitter->length;
+        if (count > length) count = length;
+        if ((new_line = memchr(text, '\n', count)) != NULL) {
+            count = new_line + 1 - text;
+        }
+        memcpy(splitter->line + splitter->length, text, count);
+        splitter->length += count;
+        text += count;
+        length -= count;
+
+        if (new_line != NULL || splitter->length == MAX_LINE_LENGTH + 1) {
+            splitter->line[splitter->length] = '\0';
+            /* A full buffer without '\n' before the end of the file is a too long line */
+            splitter->is_skipping = new_line == NULL;
+            add_source_line(splitter->unit, splitter->line, splitter->is_skipping);
+            if (splitter->is_passing) first_pass_line(splitter->unit, splitter->unit->line_count - 1);
+            splitter->length = 0;
+        }
+    }
+}
+
+void finish_first_pass_text(line_splitter *splitter) {
+    /* Last line, without '\n' - fgets stopped by EOF */
+    if (splitter->length > 0) {
+        splitter->line[splitter->length] = '\0';
+        add_source_line(splitter->unit, splitter->line, FALSE);
+        if (splitter->is_passing) first_pass_line(splitter->unit, splitter->unit->line_count - 1);
+        splitter->length = 0;
+    }
+}
+
+void first_pass_line(assembly_unit *unit, long index) {
+    unit->lines[index].ic = unit->ic;
+    unit->lines[index].dc = unit->dc;
+    /* When only checking, the code words are counted without building them */
+    if (!first_pass_line_into(get_unit_line(unit, index), unit->lines[index].is_too_long, &unit->ic, &unit->dc,
+                              unit->options.check_only ? NULL : unit->code_img, unit->data_img, &unit->symbol_table,
+                              unit->macro_ir)) {
+        unit->success = FALSE;
+    }
+}
+
+bool first_pass_line_into(line_descriptor line, bool is_too_long, long *ic, long *dc, machine_word **code_img,
+                          long *data_img, table *symbol_table, macro_ir_table *macros) {
+    macro_line_ir *ir;
+    /* if line too long, the buffer doesn't include the '\n' char OR the file isn't on end. */
+    if (is_too_long) {
+        /* Print message and prevent further line processing, as well as second pass.  */
+        fprintf_error_specific(line, "[ERROR] Line is longer than MAX_LINE_LENGTH. Maximum line length should be %d.",
+                               MAX_LINE_LENGTH);
+        return FALSE;
+    }
+    /* Macro body lines were already parsed and validated when the macro was defined */
+    if ((ir = find_macro_line(macros, line.content)) != NULL) {
+        splice_macro_line(ir, ic, dc, code_img, data_img);
+        return TRUE;
+    }
+    return process_line_first_pass(line, ic, dc, code_img, data_img, symbol_table);
+}
+
+void finish_first_pass(assembly_unit *unit) {
+    if (unit->success && unit->options.pool_strings) {
+        printf("%s: pooled string literals saved %ld data words\n", unit->filename, pool_string_literals(unit));
+    }
+    /* Step 18 Save IC and DC*/
+    unit->icf = unit->ic;
+    unit->dcf = unit->dc;
+    /* If we succeeded in step 1 we can continue to the second pass and finish the first pass */
+    if (unit->success) {
+        unit->ic = IC_INIT_VALUE;
+        /* First pass step 19 with ICF value */
+        update_symbol_table_value(unit->symbol_table, unit->icf, DATA_SYMBOL);
+        if (is_tracing()) {
+            long symbol_count = 0;
+            table_entry *entry;
+            for (entry = unit->symbol_table; entry != NULL; entry = entry->next) symbol_count++;
+            trace_counter("symbols", symbol_count);
+            trace_counter("code_words", unit->icf - IC_INIT_VALUE);
+            trace_counter("data_words", unit->dcf);
+        }
+        if (unit->options.report || unit->options.report_json) {
+            unit->composition = gather_composition(unit->code_img, unit->icf, unit->dcf, unit->symbol_table);
+        }
+    }
+}
+
+bool second_pass_line(assembly_unit *unit, long index) {
+    int i = 0;
+    bool has_code_words;
+    long next_ic = index + 1 < unit->line_count ? unit->lines[index + 1].ic : unit->icf;
+    line_descriptor line = get_unit_line(unit, index);
+    SKIP_TO_NEXT_NON_WHITESPACE(line.content, i)
+    if (unit->options.check_only) {
+        /* Nothing was built, the counters the first pass left at each line tell where the code words are.
+         * A line of a single word has no operand symbols to look up. */
+        unit->ic = unit->lines[index].ic;
+        has_code_words = next_ic - unit->ic > 1;
+    } else {
+        has_code_words = unit->code_img[unit->ic - IC_INIT_VALUE] != NULL;
+    }
+    /* Only lines with code words, or instructions (for .entry) have work in the second pass */
+    if (has_code_words || line.content[i] == '.') {
+        if (!process_line_second_pass(line, &unit->ic, unit->options.check_only ? NULL : unit->code_img,
+                                      &unit->symbol_table, &unit->external_references)) {
+            unit->success = FALSE;
+            /* A failed line doesn't move the counter past its words, the next line starts at its own words */
+            unit->ic = next_ic;
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+bool write_optional_outputs(assembly_unit *unit) {
+    if (unit->options.symbol_snapshot && !write_symbol_snapshot(unit->filename, unit->symbol_table)) return FALSE;
+    if (unit->composition != NULL) {
+        if (unit->options.report && !write_composition_report(unit->filename, unit->composition, FALSE)) return FALSE;
+        if (unit->options.report_json && !write_composition_report(unit->filename, unit->composition, TRUE)) {
+            return FALSE;
+        }
+    }
+    if (unit->options.line_map && unit->origins != NULL) {
+        long i, *line_ics = (long *) better_malloc((unit->line_count + 1) * sizeof(long));
+        bool succeeded;
+        for (i = 0; i < unit->line_count; i++) {
+            line_ics[i] = unit->lines[i].ic;
+        }
+        succeeded = write_line_map(unit->filename, line_ics, unit->line_count, unit->icf, unit->origins);
+        free(line_ics);
+        if (!succeeded) return FALSE;
+    }
+    return TRUE;
+}
+
+bool find_checked_label(line_descriptor line, char *label_buff) {
+    /* find_and_validate_label may copy a whole field before it knows it's not a label */
+    char symbol[MAX_LINE_LENGTH + 2];
+    diagnostic_log ignored;
+    bool is_invalid;
+    int i = 0;
+
+    SKIP_TO_NEXT_NON_WHITESPACE(line.content, i)
+    if (!line.content[i] || line.content[i] == '\n' || line.content[i] == EOF || line.content[i] == ';')
+        return FALSE;
+
+    /* The first pass already reported an invalid label */
+    init_diagnostic_log(&ignored);
+    line.diagnostics = &ignored;
+    is_invalid = find_and_validate_label(line, symbol);
+    free_diagnostic_log(&ignored);
+    if (is_invalid || symbol[0] == '\0') return FALSE;
+
+    i = index_of_char(line.content, ':') + 1;
+    SKIP_TO_NEXT_NON_WHITESPACE(line.content, i)
+    if (line.content[i] == '\n') return FALSE;
+
+    strcpy(label_buff, symbol);
+    return TRUE;
+}
+
+line_descriptor get_unit_line(assembly_unit *unit, long index) {
+    line_descriptor line;
+    line.line_number = index + 1;
+    line.full_file_name = unit->full_file_name;
+    line.content = unit->lines[index].content;
+    line.diagnostics = NULL;
+    return line;
+}
+
+void free_assembly_unit(assembly_unit *unit) {
+    long i;
+    for (i = 0; i < unit->line_count; i++) {
+        free(unit->lines[i].content);
+    }
+    free(unit->lines);
+    free(unit->full_file_name);
+    free_table(unit->symbol_table);
+    free_external_reference_log(&unit->external_references);
+    /* Words past the final counter are left by a first pass that didn't finish */
+    free_code_image(unit->code_img, (unit->ic > unit->icf ? unit->ic : unit->icf) - IC_INIT_VALUE);
+    free_composition_report(unit->composition);
+    free(unit->literal_splits);
+    free(unit);
+}
@@ -0,0 +1,187 @@
+/* State of a single file through both passes, and the per line steps that drive it */
+#ifndef _ASSEMBLY_UNIT_H
+#define _ASSEMBLY_UNIT_H
+#include "globals.h"
+#include "symbol_table.h"
+#include "macro_ir.h"
+#include "line_map.h"
+#include "composition.h"
+
+/** A single line of the expanded (.am) source, kept in memory for the second pass */
+typedef struct source_line {
+    /** Raw content of the line, as read by fgets */
+    char *content;
+    /** Whether the rest of the line was cut because it's longer than MAX_LINE_LENGTH */
+    bool is_too_long;
+    /** Instruction and data counters at the start of the line, set by the first pass */
+    long ic, dc;
+} source_line;
+
+/** Optional outputs and passes of a file, set by command line options */
+typedef struct assembly_options {
+    /** Write the binary symbol table, filename.sym (--sym) */
+    bool symbol_snapshot;
+    /** Write the address to source line map, filename.map (--map) */
+    bool line_map;
+    /** Remove the data blocks that nothing refers to, after the second pass (--strip-data) */
+    bool strip_data;
+    /** Share the copies of identical and suffix string literals, after the first pass (--pool-strings) */
+    bool pool_strings;
+    /** Write the composition report, filename.rpt (--report) and as JSON, filename.json (--report-json) */
+    bool report;
+    bool report_json;
+    /** Only validate, no code word is built and no file is written (--check) */
+    bool check_only;
+} assembly_options;
+
+/** Everything that is built while assembling a single file */
+typedef struct assembly_unit {
+    /** The filename, without extension */
+    char *filename;
+    /** The expanded source filename, used in error messages */
+    char *full_file_name;
+    /** Instruction and data counters, and their final values */
+    long ic, dc, icf, dcf;
+    /** Whether no error was found so far */
+    bool success;
+    /** The lines of the expanded source, line i + 1 at index i */
+    source_line *lines;
+    long line_count;
+    long line_capacity;
+    /** Contains an image of the machine code */
+    long data_img[CODE_ARR_IMG_LENGTH];
+    machine_word *code_img[CODE_ARR_IMG_LENGTH];
+    /** Our symbol table */
+    table symbol_table;
+    /** Uses of external symbols, found in the second pass */
+    external_reference_log external_references;
+    /** The parsed macro bodies of the file, not owned by the unit, NULL if not parsed */
+    macro_ir_table *macro_ir;
+    /** Optional outputs, none by default */
+    assembly_options options;
+    /** Origins of the expanded lines, not owned by the unit, NULL if not kept */
+    line_origin_log *origins;
+    /** The composition of the image after the first pass, NULL if no report was asked for */
+    composition_report *composition;
+    /** Data image indexes where string pooling put a literal inside a longer literal's copy, NULL if none */
+    long *literal_splits;
+    long literal_split_count;
+} assembly_unit;
+
+/** Splits the expanded source text into lines of a unit exactly like fgets(line, MAX_LINE_LENGTH + 2) on the .am
+ * file, for the drivers that don't read it */
+typedef struct line_splitter {
+    assembly_unit *unit;
+    char line[MAX_LINE_LENGTH + 2];
+    int length;
+    /** Whether the rest of a too long line is skipped */
+    bool is_skipping;
+    /** Whether the first pass runs on every line as it's added, otherwise the lines are only added */
+    bool is_passing;
+} line_splitter;
+
+/**
+ * Allocates an empty unit for assembling a file
+ * @param filename The filename without extension
+ * @return The new unit
+ */
+assembly_unit *create_assembly_unit(char *filename);
+
+/**
+ * Adds the next line of the expanded source to the unit
+ * @param unit The unit
+ * @param content The line, as read by fgets from the expanded source
+ * @param is_too_long Whether the rest of the line was cut because it's longer than MAX_LINE_LENGTH
+ */
+void add_source_line(assembly_unit *unit, char *content, bool is_too_long);
+
+/**
+ * Starts splitting the expanded source of a unit, running the first pass on every line
+ * @param splitter The splitter
+ * @param unit The unit, the lines are added to it
+ */
+void init_line_splitter(line_splitter *splitter, assembly_unit *unit);
+
+/**
+ * Adds the complete lines of a piece of the expanded source to the unit, and runs the first pass on each of them
+ * @param splitter The splitter, keeps the part of a line that continues in the next piece
+ * @param text The piece of the expanded source
+ * @param length The length of the piece
+ */
+void first_pass_text(line_splitter *splitter, char *text, long length);
+
+/**
+ * Adds the last line, if the expanded source doesn't end with '\n', and runs the first pass on it
+ * @param splitter The splitter, after the whole source was passed
+ */
+void finish_first_pass_text(line_splitter *splitter);
+
+/**
+ * Runs the first pass on a single line. Lines must be processed in order.
+ * @param unit The unit
+ * @param index The line index
+ */
+void first_pass_line(assembly_unit *unit, long index);
+
+/**
+ * Runs the first pass on a single line into the given counters, images and symbol table
+ * @param line The line descriptor
+ * @param is_too_long Whether the rest of the line was cut because it's longer than MAX_LINE_LENGTH
+ * @param ic Pointer to the instruction counter
+ * @param dc Pointer to the data counter
+ * @param code_img The code image array, NULL to only validate and count the code words (--check)
+ * @param data_img The data image array
+ * @param symbol_table Pointer to the symbol table
+ * @param macros The parsed macro bodies, a line found there is spliced instead of parsed. May be NULL.
+ * @return Whether succeeded
+ */
+bool first_pass_line_into(line_descriptor line, bool is_too_long, long *ic, long *dc, machine_word **code_img,
+                          long *data_img, table *symbol_table, macro_ir_table *macros);
+
+/**
+ * Pools the string literals if asked to, saves the final counters and moves the data symbols after the code
+ * (steps 18-19), then gathers the composition report if asked to
+ * @param unit The unit
+ */
+void finish_first_pass(assembly_unit *unit);
+
+/**
+ * Runs the second pass on a single line. Lines must be processed in order. When only checking, the symbols of the
+ * operands are looked up without building their words.
+ * @param unit The unit, after a successful first pass
+ * @param index The line index
+ * @return Whether succeeded
+ */
+bool second_pass_line(assembly_unit *unit, long index);
+
+/**
+ * Writes the optional outputs that were asked for, after the .ob/.ext/.ent files were written
+ * @param unit The unit, after a successful second pass
+ * @return Whether succeeded
+ */
+bool write_optional_outputs(assembly_unit *unit);
+
+/**
+ * Finds the label that the first pass checks for being already defined in a line:
+ * a valid label that isn't followed by an empty line. Nothing is printed for an invalid label.
+ * @param line The line
+ * @param label_buff Buffer of at least MAX_LABEL_LENGTH + 1 chars
+ * @return True if the line has such label
+ */
+bool find_checked_label(line_descriptor line, char *label_buff);
+
+/**
+ * Builds the line descriptor of a line, for the pass functions and error messages
+ * @param unit The unit
+ * @param index The line index
+ * @return The line descriptor
+ */
+line_descriptor get_unit_line(assembly_unit *unit, long index);
+
+/**
+ * Deallocates the unit with everything that was built in it
+ * @param unit The unit
+ */
+void free_assembly_unit(assembly_unit *unit);
+
+#endif
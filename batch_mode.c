@@ -0,0 +1,241 @@
+/* Manifest driven batch mode - assembles a list of files with a bounded pool of worker processes */
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "batch_mode.h"
+#include "helper.h"
+
+/** Final state of a single file in the batch */
+typedef enum batch_status {
+    BATCH_RUNNING,
+    BATCH_SUCCEEDED,
+    BATCH_FAILED,
+    /** Worker was killed by a signal (crash, memory budget, etc.) */
+    BATCH_CRASHED,
+    /** Couldn't start a worker for the file */
+    BATCH_SPAWN_FAILED
+} batch_status;
+
+static char *batch_status_names[] = {"running", "ok", "failed", "crashed", "spawn-failed"};
+
+/** Summary record of a single file */
+typedef struct batch_result {
+    char *filename;
+    batch_status status;
+    /** Wall time of the file in milliseconds */
+    double ms;
+} batch_result;
+
+/** A running worker process */
+typedef struct batch_worker {
+    pid_t pid;
+    /** Index of the file in the results array */
+    long result_index;
+    double start_ms;
+} batch_worker;
+
+/**
+ * Reads the next file name from the manifest, skipping empty and comment lines.
+ * The .as extension is removed if exists, as the processor expects extensionless names.
+ * @param manifest The manifest file descriptor
+ * @param entry_buff Buffer of at least MAX_MANIFEST_ENTRY_LENGTH + 2 chars
+ * @return True if an entry was read, False on end of manifest
+ */
+static bool read_manifest_entry(FILE *manifest, char *entry_buff);
+
+/**
+ * Starts a worker process that assembles a single file
+ * @param worker The worker slot to fill
+ * @param result_index The index of the file in the results array
+ * @param filename The file to assemble
+ * @param options The batch resource bounds
+ * @param processor The file processing function
+ * @return True if the worker was started
+ */
+static bool start_worker(batch_worker *worker, long result_index, char *filename, batch_options *options,
+                         file_processor processor);
+
+/**
+ * Waits for any worker to finish and records its result
+ * @param workers The worker slots
+ * @param worker_count The amount of worker slots
+ * @param results The results array
+ * @return Index of the freed slot, or -1 if no worker was running
+ */
+static int wait_for_worker(batch_worker *workers, int worker_count, batch_result *results);
+
+/**
+ * Prints the machine readable batch summary
+ * @param results The results array
+ * @param result_count The amount of results
+ * @param total_ms Wall time of the whole batch
+ * @return Number of files that didn't succeed
+ */
+static int print_summary(batch_result *results, long result_count, double total_ms);
+
+/** @return Monotonic clock in milliseconds */
+static double now_ms(void);
+
+int run_manifest(char *manifest_path, batch_options *options, file_processor processor) {
+    FILE *manifest;
+    char entry[MAX_MANIFEST_ENTRY_LENGTH + 2];
+    batch_worker *workers;
+    batch_result *results = NULL;
+    long result_count = 0, result_capacity = 0;
+    int i, active = 0, worker_count = options->max_workers > 0 ? options->max_workers : 1;
+    bool has_entry;
+    double batch_start = now_ms();
+
+    if (strcmp(manifest_path, MANIFEST_STDIN) == 0) {
+        manifest = stdin;
+    } else if ((manifest = fopen(manifest_path, "r")) == NULL) {
+        printf_error("[ERROR] Unable to read manifest: %s", manifest_path);
+        return -1;
+    }
+
+    workers = (batch_worker *) better_malloc(worker_count * sizeof(batch_worker));
+    for (i = 0; i < worker_count; i++) {
+        workers[i].pid = 0;
+    }
+
+    /* Keep the pool full while the manifest has entries, then drain it */
+    for (has_entry = read_manifest_entry(manifest, entry); has_entry || active > 0;) {
+        int slot = -1;
+        if (has_entry && active < worker_count) {
+            for (i = 0; i < worker_count && slot == -1; i++) {
+                if (workers[i].pid == 0) slot = i;
+            }
+        } else {
+            slot = wait_for_worker(workers, worker_count, results);
+            active--;
+            continue;
+        }
+
+        if (result_count == result_capacity) {
+            result_capacity = result_capacity ? result_capacity * 2 : 64;
+            results = (batch_result *) realloc(results, result_capacity * sizeof(batch_result));
+            if (results == NULL) {
+                printf("[ERROR] Malloc failed exiting the program.");
+                exit(1);
+            }
+        }
+        results[result_count].filename = strcat_to_new(entry, "");
+        results[result_count].status = BATCH_RUNNING;
+        results[result_count].ms = 0;
+
+        if (options->prepare != NULL) options->prepare(entry);
+        if (start_worker(&workers[slot], result_count, entry, options, processor)) {
+            active++;
+        } else if (active > 0) {
+            /* Out of processes, wait for one and retry the same entry */
+            wait_for_worker(workers, worker_count, results);
+            active--;
+            free(results[result_count].filename);
+            continue;
+        } else {
+            results[result_count].status = BATCH_SPAWN_FAILED;
+        }
+        result_count++;
+        has_entry = read_manifest_entry(manifest, entry);
+    }
+
+    if (manifest != stdin) fclose(manifest);
+
+    i = print_summary(results, result_count, now_ms() - batch_start);
+
+    while (result_count--) free(results[result_count].filename);
+    free(results);
+    free(workers);
+    return i;
+}
+
+static bool read_manifest_entry(FILE *manifest, char *entry_buff) {
+    int start, end;
+    while (fgets(entry_buff, MAX_MANIFEST_ENTRY_LENGTH + 2, manifest) != NULL) {
+        /* Trim whitespace from both sides */
+        for (end = strlen(entry_buff); end > 0 && isspace((unsigned char) entry_buff[end - 1]); end--);
+        entry_buff[end] = '\0';
+        start = 0;
+        SKIP_TO_NEXT_NON_WHITESPACE(entry_buff, start)
+        if (!entry_buff[start] || entry_buff[start] == '#') continue;
+
+        /* Names are given without extension, like in the command line */
+        if (end - start > 3 && strcmp(entry_buff + end - 3, PRE_MARCO_SUFFIX) == 0) {
+            entry_buff[end - 3] = '\0';
+        }
+        memmove(entry_buff, entry_buff + start, strlen(entry_buff + start) + 1);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static bool start_worker(batch_worker *worker, long result_index, char *filename, batch_options *options,
+                         file_processor processor) {
+    pid_t pid;
+    /* Flush before forking, otherwise buffered output is printed twice */
+    fflush(stdout);
+    worker->start_ms = now_ms();
+    if ((pid = fork()) < 0) {
+        return FALSE;
+    }
+    if (pid == 0) {
+        bool succeeded;
+        if (options->memory_budget > 0) {
+            struct rlimit limit;
+            limit.rlim_cur = limit.rlim_max = (rlim_t) options->memory_budget;
+            setrlimit(RLIMIT_AS, &limit);
+        }
+        succeeded = processor(filename);
+        fflush(stdout);
+        _exit(succeeded ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    worker->pid = pid;
+    worker->result_index = result_index;
+    return TRUE;
+}
+
+static int wait_for_worker(batch_worker *workers, int worker_count, batch_result *results) {
+    int i, status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, 0)) > 0) {
+        for (i = 0; i < worker_count; i++) {
+            if (workers[i].pid == pid) {
+                batch_result *result = &results[workers[i].result_index];
+                result->ms = now_ms() - workers[i].start_ms;
+                if (WIFEXITED(status)) {
+                    result->status = WEXITSTATUS(status) == EXIT_SUCCESS ? BATCH_SUCCEEDED : BATCH_FAILED;
+                } else {
+                    result->status = BATCH_CRASHED;
+                }
+                workers[i].pid = 0;
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+static int print_summary(batch_result *results, long result_count, double total_ms) {
+    long i, succeeded = 0;
+    printf("file\tstatus\tms\n");
+    for (i = 0; i < result_count; i++) {
+        if (results[i].status == BATCH_SUCCEEDED) succeeded++;
+        printf("%s\t%s\t%.3f\n", results[i].filename, batch_status_names[results[i].status], results[i].ms);
+    }
+    printf("total\tsucceeded=%ld failed=%ld\t%.3f\n", succeeded, result_count - succeeded, total_ms);
+    fflush(stdout);
+    return (int) (result_count - succeeded);
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
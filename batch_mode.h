@@ -0,0 +1,40 @@
+/* Manifest driven batch mode - assembles a list of files with a bounded pool of workers */
+#ifndef _BATCH_MODE_H
+#define _BATCH_MODE_H
+#include "globals.h"
+
+/** Command line argument prefix that marks a manifest file (@files.txt) */
+#define MANIFEST_PREFIX '@'
+
+/** Manifest name that reads the file list from stdin (@-) */
+#define MANIFEST_STDIN "-"
+
+/** Maximum length of a single manifest entry (a path, not a source line) */
+#define MAX_MANIFEST_ENTRY_LENGTH 4096
+
+/** Full processing function of a single extensionless file name, returns True if good */
+typedef bool (*file_processor)(char *filename);
+
+/** Resource bounds of a batch run */
+typedef struct batch_options {
+    /** Maximum number of files assembled concurrently */
+    int max_workers;
+    /** Address space limit of a single file's worker in bytes, 0 means unlimited */
+    long memory_budget;
+    /** Called in the parent for every file before its worker starts, NULL for none */
+    file_processor prepare;
+} batch_options;
+
+/**
+ * Assembles every file listed in the manifest, one name per line (with or without the .as extension).
+ * Empty lines and lines starting with '#' are skipped.
+ * Each file is assembled in its own worker process, so a failed or crashed file doesn't affect the others.
+ * When all files are done a tab separated summary (file, status, time per file) is printed to stdout.
+ * @param manifest_path The manifest path, or MANIFEST_STDIN for reading from stdin
+ * @param options Worker count and per file memory budget
+ * @param processor The function that fully processes a single file
+ * @return Number of files that didn't succeed, -1 if the manifest couldn't be read
+ */
+int run_manifest(char *manifest_path, batch_options *options, file_processor processor);
+
+#endif
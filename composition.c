@@ -0,0 +1,261 @@
+/* Composition report (.rpt/.json) - what the words of the image are spent on, gathered after the first pass */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "composition.h"
+#include "helper.h"
+#include "opcode_builder.h"
+
+/** Names of the addressing types, by their value */
+static char *addressing_names[4] = {"immediate", "direct", "index", "register"};
+
+/**
+ * Adds the labels of a section to the report, each one's words are up to the next label or the section's end
+ * @param report The report
+ * @param symbol_table The symbol table, sorted by value within each section
+ * @param type CODE_SYMBOL or DATA_SYMBOL
+ * @param start The first address of the section
+ * @param end The address after the section
+ * @return The words before the section's first label
+ */
+static long add_section_labels(composition_report *report, table symbol_table, symbol_type type, long start,
+                               long end);
+
+/**
+ * Copies the data labels, the largest first
+ * @param report The report
+ * @param count Output, the amount of copied labels, at most LARGEST_DATA_BLOCKS
+ * @return The labels, deallocate with free
+ */
+static label_composition *largest_data_blocks(composition_report *report, long *count);
+
+/**
+ * Orders label_composition by words, the largest first, and then by address
+ */
+static int compare_label_words(const void *first, const void *second);
+
+/**
+ * Writes the report as text
+ * @param file_desc The file
+ * @param report The report
+ */
+static void write_text_report(FILE *file_desc, composition_report *report);
+
+/**
+ * Writes the report as a JSON object
+ * @param file_desc The file
+ * @param report The report
+ */
+static void write_json_report(FILE *file_desc, composition_report *report);
+
+composition_report *gather_composition(machine_word **code_img, long icf, long dcf, table symbol_table) {
+    composition_report *report = (composition_report *) better_malloc(sizeof(composition_report));
+    table_entry *entry;
+    long i;
+
+    report->code_words = icf - IC_INIT_VALUE;
+    report->data_words = dcf;
+    report->instruction_count = 0;
+    memset(report->instruction_counts, 0, sizeof(report->instruction_counts));
+    memset(report->source_addressing, 0, sizeof(report->source_addressing));
+    memset(report->destination_addressing, 0, sizeof(report->destination_addressing));
+
+    /* Every instruction starts with its opcode word, which holds the instruction's length */
+    for (i = 0; i < report->code_words;) {
+        machine_word *word = code_img[i];
+        unsigned int op, fun = FUNCT_DEFAULT;
+        if (word == NULL || word->length <= 0) {
+            i++;
+            continue;
+        }
+        op = word->word.opcode->opcode & 15;
+        /* rts and stop have no operand word */
+        if (word->length > 1 && code_img[i + 1] != NULL && code_img[i + 1]->is_operand) {
+            operand_word *operands = code_img[i + 1]->word.operand;
+            fun = operands->funct;
+            if (op <= LEA_OP) report->source_addressing[operands->source_addressing]++;
+            if (op <= PRN_OP) report->destination_addressing[operands->destination_addressing]++;
+        }
+        report->instruction_counts[op][fun]++;
+        report->instruction_count++;
+        i += word->length;
+    }
+
+    report->label_count = 0;
+    for (entry = symbol_table; entry != NULL; entry = entry->next) {
+        if (entry->type == CODE_SYMBOL || entry->type == DATA_SYMBOL) report->label_count++;
+    }
+    report->labels = (label_composition *) better_malloc((report->label_count + 1) * sizeof(label_composition));
+    report->label_count = 0;
+    report->unlabeled_code_words = add_section_labels(report, symbol_table, CODE_SYMBOL, IC_INIT_VALUE, icf);
+    report->unlabeled_data_words = add_section_labels(report, symbol_table, DATA_SYMBOL, icf, icf + dcf);
+    return report;
+}
+
+bool write_composition_report(char *filename, composition_report *report, bool as_json) {
+    FILE *file_desc;
+    /* concatenate filename & extension, and open the file for writing: */
+    char *full_filename = strcat_to_new(filename, as_json ? COMPOSITION_JSON_SUFFIX : COMPOSITION_TEXT_SUFFIX);
+    file_desc = fopen(full_filename, "w");
+    /* if failed, print error and exit */
+    if (file_desc == NULL) {
+        printf("Can't create or rewrite to file %s.", full_filename);
+        free(full_filename);
+        return FALSE;
+    }
+    free(full_filename);
+    if (as_json) {
+        write_json_report(file_desc, report);
+    } else {
+        write_text_report(file_desc, report);
+    }
+    fclose(file_desc);
+    return TRUE;
+}
+
+void free_composition_report(composition_report *report) {
+    if (report == NULL) return;
+    free(report->labels);
+    free(report);
+}
+
+static long add_section_labels(composition_report *report, table symbol_table, symbol_type type, long start,
+                               long end) {
+    table_entry *entry;
+    long first = report->label_count, i;
+    for (entry = next_entry_of_type(symbol_table, type); entry != NULL; entry = next_entry_of_type(entry->next, type)) {
+        label_composition *label = &report->labels[report->label_count++];
+        label->name = entry->key;
+        label->address = entry->value;
+        label->is_data = type == DATA_SYMBOL;
+    }
+    for (i = first; i < report->label_count; i++) {
+        report->labels[i].words = (i + 1 < report->label_count ? report->labels[i + 1].address : end) -
+                                  report->labels[i].address;
+    }
+    return (first < report->label_count ? report->labels[first].address : end) - start;
+}
+
+static label_composition *largest_data_blocks(composition_report *report, long *count) {
+    label_composition *blocks = (label_composition *) better_malloc((report->label_count + 1) *
+                                                                    sizeof(label_composition));
+    long i;
+    *count = 0;
+    for (i = 0; i < report->label_count; i++) {
+        if (report->labels[i].is_data) blocks[(*count)++] = report->labels[i];
+    }
+    qsort(blocks, *count, sizeof(label_composition), compare_label_words);
+    if (*count > LARGEST_DATA_BLOCKS) *count = LARGEST_DATA_BLOCKS;
+    return blocks;
+}
+
+static int compare_label_words(const void *first, const void *second) {
+    const label_composition *a = (const label_composition *) first, *b = (const label_composition *) second;
+    if (a->words != b->words) return a->words > b->words ? -1 : 1;
+    return a->address < b->address ? -1 : a->address > b->address;
+}
+
+static void write_text_report(FILE *file_desc, composition_report *report) {
+    long i, j, block_count, memory_operands;
+    label_composition *blocks;
+
+    fprintf(file_desc, "code: %ld words, %ld instructions\n", report->code_words, report->instruction_count);
+    fprintf(file_desc, "data: %ld words\n", report->data_words);
+    fprintf(file_desc, "image limit: %d words each\n", CODE_ARR_IMG_LENGTH);
+
+    fprintf(file_desc, "\nwords per label:\n");
+    if (report->unlabeled_code_words) fprintf(file_desc, "  code %6s %6ld  (unlabeled)\n", "-",
+                                              report->unlabeled_code_words);
+    for (i = 0; i < report->label_count; i++) {
+        label_composition *label = &report->labels[i];
+        if (i > 0 && label->is_data && !report->labels[i - 1].is_data && report->unlabeled_data_words) {
+            fprintf(file_desc, "  data %6s %6ld  (unlabeled)\n", "-", report->unlabeled_data_words);
+        }
+        fprintf(file_desc, "  %s %6ld %6ld  %s\n", label->is_data ? "data" : "code", label->address, label->words,
+                label->name);
+    }
+
+    fprintf(file_desc, "\ninstructions:\n");
+    for (i = 0; i < 16; i++) {
+        for (j = 0; j < 16; j++) {
+            char *name;
+            if (report->instruction_counts[i][j] == 0) continue;
+            name = get_command_name((opcode) i, (funct) j);
+            fprintf(file_desc, "  %-4s %2ld/%-2ld %6ld\n", name != NULL ? name : "?", i, j,
+                    report->instruction_counts[i][j]);
+        }
+    }
+
+    fprintf(file_desc, "\naddressing:    ");
+    for (i = 0; i < 4; i++) fprintf(file_desc, " %9s", addressing_names[i]);
+    fprintf(file_desc, "\n  source:      ");
+    for (i = 0; i < 4; i++) fprintf(file_desc, " %9ld", report->source_addressing[i]);
+    fprintf(file_desc, "\n  destination: ");
+    for (i = 0; i < 4; i++) fprintf(file_desc, " %9ld", report->destination_addressing[i]);
+    /* A register operand is encoded in the operand word, a direct or index one takes a base and an offset word */
+    memory_operands = report->source_addressing[DIRECT_ADDR] + report->source_addressing[INDEX_ADDR] +
+                      report->destination_addressing[DIRECT_ADDR] + report->destination_addressing[INDEX_ADDR];
+    fprintf(file_desc, "\ndirect and index operands: %ld, %ld words that register operands wouldn't take\n",
+            memory_operands, 2 * memory_operands);
+
+    fprintf(file_desc, "\nlargest data blocks:\n");
+    blocks = largest_data_blocks(report, &block_count);
+    for (i = 0; i < block_count; i++) {
+        fprintf(file_desc, "  %6ld %6ld  %s\n", blocks[i].address, blocks[i].words, blocks[i].name);
+    }
+    free(blocks);
+}
+
+static void write_json_report(FILE *file_desc, composition_report *report) {
+    long i, j, block_count, memory_operands;
+    label_composition *blocks;
+    char *separator = "";
+
+    fprintf(file_desc, "{\"image_limit\":%d,", CODE_ARR_IMG_LENGTH);
+    fprintf(file_desc, "\"code\":{\"words\":%ld,\"unlabeled_words\":%ld,\"instructions\":%ld},",
+            report->code_words, report->unlabeled_code_words, report->instruction_count);
+    fprintf(file_desc, "\"data\":{\"words\":%ld,\"unlabeled_words\":%ld},", report->data_words,
+            report->unlabeled_data_words);
+
+    /* Labels are valid identifiers, they need no escaping */
+    fprintf(file_desc, "\"labels\":[");
+    for (i = 0; i < report->label_count; i++) {
+        label_composition *label = &report->labels[i];
+        fprintf(file_desc, "%s{\"name\":\"%s\",\"section\":\"%s\",\"address\":%ld,\"words\":%ld}", i ? "," : "",
+                label->name, label->is_data ? "data" : "code", label->address, label->words);
+    }
+
+    fprintf(file_desc, "],\"instructions\":[");
+    for (i = 0; i < 16; i++) {
+        for (j = 0; j < 16; j++) {
+            char *name;
+            if (report->instruction_counts[i][j] == 0) continue;
+            name = get_command_name((opcode) i, (funct) j);
+            fprintf(file_desc, "%s{\"name\":\"%s\",\"opcode\":%ld,\"funct\":%ld,\"count\":%ld}", separator,
+                    name != NULL ? name : "?", i, j, report->instruction_counts[i][j]);
+            separator = ",";
+        }
+    }
+
+    fprintf(file_desc, "],\"addressing\":{\"source\":{");
+    for (i = 0; i < 4; i++) {
+        fprintf(file_desc, "%s\"%s\":%ld", i ? "," : "", addressing_names[i], report->source_addressing[i]);
+    }
+    fprintf(file_desc, "},\"destination\":{");
+    for (i = 0; i < 4; i++) {
+        fprintf(file_desc, "%s\"%s\":%ld", i ? "," : "", addressing_names[i], report->destination_addressing[i]);
+    }
+    memory_operands = report->source_addressing[DIRECT_ADDR] + report->source_addressing[INDEX_ADDR] +
+                      report->destination_addressing[DIRECT_ADDR] + report->destination_addressing[INDEX_ADDR];
+    fprintf(file_desc, "},\"direct_and_index_operands\":%ld,\"direct_and_index_words\":%ld},", memory_operands,
+            2 * memory_operands);
+
+    fprintf(file_desc, "\"largest_data_blocks\":[");
+    blocks = largest_data_blocks(report, &block_count);
+    for (i = 0; i < block_count; i++) {
+        fprintf(file_desc, "%s{\"name\":\"%s\",\"address\":%ld,\"words\":%ld}", i ? "," : "", blocks[i].name,
+                blocks[i].address, blocks[i].words);
+    }
+    free(blocks);
+    fprintf(file_desc, "]}\n");
+}
@@ -0,0 +1,64 @@
+/* Composition report (.rpt/.json) - what the words of the image are spent on, gathered after the first pass */
+#ifndef _COMPOSITION_H
+#define _COMPOSITION_H
+#include "globals.h"
+#include "symbol_table.h"
+
+#define COMPOSITION_TEXT_SUFFIX ".rpt"
+
+#define COMPOSITION_JSON_SUFFIX ".json"
+
+/** How many of the largest data blocks are listed */
+#define LARGEST_DATA_BLOCKS 10
+
+/** The words of a single label, up to the next label of its section */
+typedef struct label_composition {
+    /** The label, the interning pool's copy */
+    char *name;
+    long address;
+    long words;
+    bool is_data;
+} label_composition;
+
+/** Sizes and counts of a single file's image */
+typedef struct composition_report {
+    /** Words of each section, and the words before the section's first label */
+    long code_words, data_words;
+    long unlabeled_code_words, unlabeled_data_words;
+    /** The code labels and then the data labels, each by address */
+    label_composition *labels;
+    long label_count;
+    long instruction_count;
+    /** Instructions by opcode and funct */
+    long instruction_counts[16][16];
+    /** Operands by addressing type, of the source and of the destination */
+    long source_addressing[4];
+    long destination_addressing[4];
+} composition_report;
+
+/**
+ * Gathers the report of a file after a successful first pass, once the data symbols were moved after the code
+ * @param code_img The code image
+ * @param icf The final instruction counter
+ * @param dcf The final data counter
+ * @param symbol_table The symbol table
+ * @return The report, deallocate with free_composition_report
+ */
+composition_report *gather_composition(machine_word **code_img, long icf, long dcf, table symbol_table);
+
+/**
+ * Writes the report to filename.rpt, or as JSON to filename.json
+ * @param filename The filename without extension
+ * @param report The report
+ * @param as_json Whether to write JSON
+ * @return Whether succeeded
+ */
+bool write_composition_report(char *filename, composition_report *report, bool as_json);
+
+/**
+ * Deallocates a report
+ * @param report The report
+ */
+void free_composition_report(composition_report *report);
+
+#endif
@@ -0,0 +1,43 @@
+/* Bounded lock-free single producer single consumer queue, based on GCC atomic builtins */
+#define _POSIX_C_SOURCE 200112L
+#include <stdlib.h>
+#include <sched.h>
+#include "concurrent_queue.h"
+#include "helper.h"
+
+void init_concurrent_queue(concurrent_queue *queue, unsigned long capacity) {
+    unsigned long rounded = 1;
+    while (rounded < capacity) rounded <<= 1;
+    queue->slots = (void **) better_malloc(rounded * sizeof(void *));
+    queue->capacity = rounded;
+    queue->head = queue->tail = 0;
+}
+
+void concurrent_queue_push(concurrent_queue *queue, void *item) {
+    /* Only this thread writes tail */
+    unsigned long tail = queue->tail;
+    /* Acquire the consumer's progress, so its slot reads are done before we overwrite */
+    while (tail - __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) == queue->capacity) {
+        sched_yield();
+    }
+    queue->slots[tail & (queue->capacity - 1)] = item;
+    /* Release the slot (and everything the item points to) to the consumer */
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+void *concurrent_queue_pop(concurrent_queue *queue) {
+    /* Only this thread writes head */
+    unsigned long head = queue->head;
+    void *item;
+    while (__atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) == head) {
+        sched_yield();
+    }
+    item = queue->slots[head & (queue->capacity - 1)];
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+    return item;
+}
+
+void free_concurrent_queue(concurrent_queue *queue) {
+    free(queue->slots);
+    queue->slots = NULL;
+}
@@ -0,0 +1,44 @@
+/* Bounded lock-free queue between a single producer thread and a single consumer thread */
+#ifndef _CONCURRENT_QUEUE_H
+#define _CONCURRENT_QUEUE_H
+#include "globals.h"
+
+/** Ring buffer of pointers. head is written only by the consumer and tail only by the producer */
+typedef struct concurrent_queue {
+    void **slots;
+    /** Number of slots, a power of 2 */
+    unsigned long capacity;
+    /** Count of popped items */
+    unsigned long head;
+    /** Count of pushed items */
+    unsigned long tail;
+} concurrent_queue;
+
+/**
+ * Initializes an empty queue
+ * @param queue The queue to initialize
+ * @param capacity Maximum amount of items in the queue, rounded up to a power of 2
+ */
+void init_concurrent_queue(concurrent_queue *queue, unsigned long capacity);
+
+/**
+ * Adds an item to the queue, yielding the CPU while the queue is full. Producer thread only.
+ * @param queue The queue
+ * @param item The item to add
+ */
+void concurrent_queue_push(concurrent_queue *queue, void *item);
+
+/**
+ * Removes the oldest item of the queue, yielding the CPU while the queue is empty. Consumer thread only.
+ * @param queue The queue
+ * @return The removed item
+ */
+void *concurrent_queue_pop(concurrent_queue *queue);
+
+/**
+ * Deallocates the queue slots (not the items left in it)
+ * @param queue The queue
+ */
+void free_concurrent_queue(concurrent_queue *queue);
+
+#endif
@@ -0,0 +1,143 @@
+/* Dead data elimination - drops .data/.string blocks that no instruction and no .entry refers to */
+#include <stdlib.h>
+#include <string.h>
+#include "dead_data.h"
+#include "helper.h"
+
+/** The data of a single data label */
+typedef struct data_block {
+    /** Data image index of the label, and the index after its last word */
+    long start, end;
+    bool is_referenced;
+    /** Whether a pooled literal of the block goes on into the next block */
+    bool is_split;
+    /** Index of the label after the compaction */
+    long new_start;
+} data_block;
+
+/**
+ * Finds the block that contains a data image index
+ * @param blocks The blocks, by their start
+ * @param block_count The amount of blocks
+ * @param index The data image index
+ * @return The block's index, -1 if the index is before the first block
+ */
+static long find_block(data_block *blocks, long block_count, long index);
+
+long strip_unreferenced_data(assembly_unit *unit) {
+    data_block *blocks;
+    long block_count = 0, reference_count = 0, removed = 0, i, *references;
+    long code_length = unit->icf - IC_INIT_VALUE;
+    table_entry *entry, **link;
+
+    for (entry = unit->symbol_table; entry != NULL; entry = entry->next) {
+        if (entry->type == DATA_SYMBOL) block_count++;
+    }
+    if (block_count == 0) return 0;
+    blocks = (data_block *) better_malloc(block_count * sizeof(data_block));
+    references = (long *) better_malloc((code_length + 1) * sizeof(long));
+
+    /* The table is sorted by value, so are the blocks */
+    for (i = 0, entry = unit->symbol_table; entry != NULL; entry = entry->next) {
+        if (entry->type != DATA_SYMBOL) continue;
+        blocks[i].start = entry->value - unit->icf;
+        blocks[i].is_referenced = FALSE;
+        blocks[i].is_split = FALSE;
+        if (i > 0) blocks[i - 1].end = blocks[i].start;
+        i++;
+    }
+    blocks[block_count - 1].end = unit->dcf;
+
+    /* Entries keep their labels */
+    for (entry = next_entry_of_type(unit->symbol_table, ENTRY_SYMBOL); entry != NULL;
+         entry = next_entry_of_type(entry->next, ENTRY_SYMBOL)) {
+        if (entry->value >= unit->icf && (i = find_block(blocks, block_count, entry->value - unit->icf)) >= 0) {
+            blocks[i].is_referenced = TRUE;
+        }
+    }
+
+    /* Operands that refer to labels are the relocatable base and offset word pairs the second pass built */
+    for (i = 0; i + 1 < code_length; i++) {
+        machine_word *base_word = unit->code_img[i], *offset_word = unit->code_img[i + 1];
+        long address, block;
+        if (base_word == NULL || base_word->length != 0 || base_word->is_operand ||
+            base_word->word.data2->ARE != RELOCATABLE || offset_word == NULL) {
+            continue;
+        }
+        address = base_word->word.data2->data + offset_word->word.data2->data;
+        if (address >= unit->icf && (block = find_block(blocks, block_count, address - unit->icf)) >= 0) {
+            blocks[block].is_referenced = TRUE;
+            references[reference_count++] = i;
+        }
+        i++;
+    }
+
+    /* A pooled literal that ends another one splits its block, the rest of a kept literal must stay */
+    for (i = 0; i < unit->literal_split_count; i++) {
+        long block = find_block(blocks, block_count, unit->literal_splits[i]);
+        /* Labels of the same address make empty blocks, the literal is in the last one before them */
+        while (block > 0 && blocks[block - 1].start == unit->literal_splits[i]) block--;
+        if (block > 0 && blocks[block].start == unit->literal_splits[i]) blocks[block - 1].is_split = TRUE;
+    }
+    for (i = 0; i + 1 < block_count; i++) {
+        if (blocks[i].is_referenced && blocks[i].is_split) {
+            blocks[find_block(blocks, block_count, blocks[i].end)].is_referenced = TRUE;
+        }
+    }
+
+    /* Compact the data image, the data before the first block stays in place */
+    for (i = 0; i < block_count; i++) {
+        blocks[i].new_start = blocks[i].start - removed;
+        if (blocks[i].is_referenced) {
+            memmove(unit->data_img + blocks[i].new_start, unit->data_img + blocks[i].start,
+                    (blocks[i].end - blocks[i].start) * sizeof(long));
+        } else {
+            removed += blocks[i].end - blocks[i].start;
+        }
+    }
+    unit->dcf -= removed;
+    unit->dc = unit->dcf;
+
+    for (i = 0; i < reference_count; i++) {
+        operand_data_word *base = unit->code_img[references[i]]->word.data2;
+        operand_data_word *offset = unit->code_img[references[i] + 1]->word.data2;
+        long address = base->data + offset->data;
+        data_block *block = &blocks[find_block(blocks, block_count, address - unit->icf)];
+        address -= block->start - block->new_start;
+        offset->data = address % 16;
+        base->data = address - offset->data;
+    }
+
+    /* Move the kept data symbols (and their entries) down, and drop the symbols of removed blocks */
+    for (link = &unit->symbol_table; (entry = *link) != NULL;) {
+        long block;
+        if ((entry->type == DATA_SYMBOL || entry->type == ENTRY_SYMBOL) && entry->value >= unit->icf &&
+            (block = find_block(blocks, block_count, entry->value - unit->icf)) >= 0) {
+            if (!blocks[block].is_referenced) {
+                remove_table_item(&unit->symbol_table, link);
+                continue;
+            }
+            set_table_item_value(unit->symbol_table, entry,
+                                 entry->value - (blocks[block].start - blocks[block].new_start));
+        }
+        link = &entry->next;
+    }
+
+    free(references);
+    free(blocks);
+    return removed;
+}
+
+static long find_block(data_block *blocks, long block_count, long index) {
+    long low = 0, high = block_count - 1, found = -1;
+    while (low <= high) {
+        long middle = (low + high) / 2;
+        if (blocks[middle].start <= index) {
+            found = middle;
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return found;
+}
@@ -0,0 +1,17 @@
+/* Dead data elimination - drops .data/.string blocks that no instruction and no .entry refers to */
+#ifndef _DEAD_DATA_H
+#define _DEAD_DATA_H
+#include "assembly_unit.h"
+
+/**
+ * Removes the unreferenced data blocks of a unit after a successful second pass.
+ * A block is the data of a data label up to the next data label. It's kept if an operand refers to its label
+ * or the label is an entry, data before the first data label is always kept.
+ * The data image is compacted, the data symbols (and their entries) are moved down, the symbols of removed
+ * blocks are removed from the table, and the operand words that refer to moved data are fixed.
+ * @param unit The unit
+ * @return The amount of data words removed
+ */
+long strip_unreferenced_data(assembly_unit *unit);
+
+#endif
@@ -28,7 +28,7 @@ static bool process_code(line_descriptor line, int i, long *ic, machine_word **c
  * @param externals The externals symbol table
  * @param IC ABSOLUTE pointer to the current instruction counter
  * @param DC ABSOLUTE pointer to the current data counter
- * @param code_img The code image array
+ * @param code_img The code image array, NULL to only validate and count the code words (--check)
  * @param data_img The data image array
  * @return Whether succeeded.
  */
@@ -129,11 +129,11 @@ bool process_line_first_pass(line_descriptor line, long *IC, long *DC, machine_w
 /**
  * Allocates and builds the data inside the additional code word by the given operand,
  * Only in the first pass
- * @param code_img The current code image
+ * @param code_img The current code image, NULL to only count the words
  * @param ic The current instruction counter
  * @param operand The operand to check
  */
-static void encode_addressing_additional_words(machine_word **code_img, long *ic, char *operand);
+static void encode_addressing_additional_words(machine_word **code_img, long *ic, operand_view *operand);
 
 /**
  * Processes a single code line in the first pass.
@@ -142,12 +142,12 @@ static void encode_addressing_additional_words(machine_word **code_img, long *ic
  * @param line The code line to process
  * @param i Where to start processing the line from
  * @param ic ABSOLUTE pointer to the current instruction counter
- * @param code_img The code image array
+ * @param code_img The code image array, NULL to only validate and count the code words
  * @return Success status boolean
  */
 static bool process_code(line_descriptor line, int i, long *ic, machine_word **code_img) {
 	char operation[8]; /* stores the string of the current code instruction */
-	char *operands[2]; /* 2 strings, each for operand */
+	operand_view operands[2]; /* 2 views into the line, each for operand */
     long start_ic;
     int j, operand_count;
 	opcode curr_opcode; /* the current opcode and funct values */
@@ -176,16 +176,21 @@ static bool process_code(line_descriptor line, int i, long *ic, machine_word **c
 		return FALSE;
 	}
 
+	/* Without an image the words are only counted: the code word, the funct word and the additional words */
+	if (code_img == NULL) {
+		if (encode_opcode_wards(line, curr_opcode, curr_funct, operand_count, operands, NULL, NULL) == 0) {
+			return FALSE;
+		}
+		(*ic) += curr_opcode != RTS_OP && curr_opcode != STOP_OP ? 2 : 1;
+		for (j = 0; j < operand_count; j++) {
+			encode_addressing_additional_words(NULL, ic, &operands[j]);
+		}
+		return TRUE;
+	}
+
 	/* Build code word struct to store in code image array */
 	if ((encode_opcode_wards(line, curr_opcode, curr_funct, operand_count, operands, &opcode_word_temp,
                              &operand_word_temp)) == 0) {
-		/* Release allocated memory for operands */
-		if (operands[0]) {
-			free(operands[0]);
-			if (operands[1]) {
-				free(operands[1]);
-			}
-		}
 		return FALSE;
 	}
     /* nope */
@@ -194,6 +199,7 @@ static bool process_code(line_descriptor line, int i, long *ic, machine_word **c
     start_ic = *ic;
 	/* allocate memory for a new word in the code image, and put the code word into it */
 	opcode_machine_word = (machine_word *) better_malloc(sizeof(machine_word));
+	opcode_machine_word->is_operand = FALSE;
 	opcode_machine_word->word.opcode = opcode_word_temp;
 	code_img[(*ic) - IC_INIT_VALUE] = opcode_machine_word; /* IC initialized to 100, but we shouldn't skip the first cells  */
 
@@ -206,13 +212,11 @@ static bool process_code(line_descriptor line, int i, long *ic, machine_word **c
         code_img[(*ic) - IC_INIT_VALUE] = operand_machine_word;
     }
 
-	/* Build extra information code word if possible, free pointers with no need */
+	/* Build extra information code word if possible */
 	if (operand_count--) { /* Its true unless operand == 0 we subtract to handle the case of 1 operand */
-        encode_addressing_additional_words(code_img, ic, operands[0]);
-		free(operands[0]);
+        encode_addressing_additional_words(code_img, ic, &operands[0]);
 		if (operand_count) {
-            encode_addressing_additional_words(code_img, ic, operands[1]);
-			free(operands[1]);
+            encode_addressing_additional_words(code_img, ic, &operands[1]);
 		}
 	}
 
@@ -224,22 +228,23 @@ static bool process_code(line_descriptor line, int i, long *ic, machine_word **c
 	return TRUE; /* No errors */
 }
 
-static void encode_addressing_additional_words(machine_word **code_img, long *ic, char *operand) {
+static void encode_addressing_additional_words(machine_word **code_img, long *ic, operand_view *operand) {
 	addressing_type operand_addressing = get_addressing_type(operand);
 	/* Register includes no additional info words */
 	if (operand_addressing != REGISTER_ADDR && operand_addressing != NONE_ADDR) {
 		(*ic)++; /* We add one word to the ic */
-		if (operand_addressing == IMMEDIATE_ADDR) {
+		if (operand_addressing == IMMEDIATE_ADDR && code_img != NULL) {
 			char *ptr;
 			machine_word *immediate_addr_word;
-			/* skip the first char because immediate addressing specifies it equals # */
-			int value = strtol(operand + 1, &ptr, 10);
+			/* skip the first char because immediate addressing specifies it equals #, the view ends at a non digit */
+			int value = strtol(operand->text + 1, &ptr, 10);
             immediate_addr_word = (machine_word *) better_malloc(sizeof(machine_word));
             immediate_addr_word->length = 0;
+            immediate_addr_word->is_operand = FALSE;
 			(immediate_addr_word->word).data2 = encode_operand_data(IMMEDIATE_ADDR, value, FALSE);
 
 			code_img[(*ic) - IC_INIT_VALUE] = immediate_addr_word;
-		} else{
+		} else if (operand_addressing != IMMEDIATE_ADDR) {
             (*ic)++; /* Direct/Index 2 more words */
         }
 	}
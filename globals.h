@@ -41,7 +41,10 @@ typedef struct simple_node {
 } simple_node;
 
 typedef struct list_node {
+    /** The name, the interning pool's copy */
     char* data;
+    /** Interned id of the name (an intern_id), nodes are found by it */
+    long data_id;
     struct list_node* next;
     simple_node* macro_lines;
 } list_node;
@@ -205,6 +208,32 @@ typedef enum instruction {
 	ERROR_INST
 } instruction;
 
+/** An error message that is held back, to be printed later in line order */
+typedef struct diagnostic {
+	long line_number;
+	/** The full formatted message, including file name, line number and '\n' */
+	char *text;
+} diagnostic;
+
+/** Growing list of held back error messages */
+typedef struct diagnostic_log {
+	diagnostic *items;
+	long count;
+	long capacity;
+} diagnostic_log;
+
+/** Non-owning view of an operand inside its line */
+typedef struct operand_view {
+	/** Start of the operand in the line, not null terminated */
+	char *text;
+	int length;
+	/** Length of the label part of label[rN], the whole length when there are no brackets */
+	int label_length;
+	/** The register part of label[rN], NULL when there are no brackets */
+	char *index_register;
+	int index_register_length;
+} operand_view;
+
 /**
  * A metadata + data object about the line we are working with
  */
@@ -215,6 +244,8 @@ typedef struct line_descriptor {
 	char *full_file_name;
 	/** Raw content of the line */
 	char *content;
+	/** Where errors of the line are held, NULL prints them right away */
+	diagnostic_log *diagnostics;
 } line_descriptor;
 
 #endif
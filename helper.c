@@ -1,13 +1,47 @@
-#include <ctype.h>
+#define _POSIX_C_SOURCE 200112L
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
+#include <limits.h>
 #include "helper.h"
 #include "opcode_builder.h" /* for checking reserved words */
 
 #define STDERR_FILE stdout /* we should print to stderr but w/e */
 
+#define MAX_DIAGNOSTIC_LENGTH 8192 /* held back error message, with the file name */
+
+/* Short names for the table below */
+#define W CHAR_BLANK
+#define A CHAR_ALPHA
+#define D CHAR_DIGIT
+#define E CHAR_LINE_END
+#define C CHAR_COMMA
+/* Character classes of every byte (ASCII only, like isalnum in the C locale), 16 per row */
+const unsigned char char_classes[256] = {
+	E, 0, 0, 0, 0, 0, 0, 0, 0, W, E, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	W, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, C, 0, 0, 0,
+	D, D, D, D, D, D, D, D, D, D, 0, 0, 0, 0, 0, 0,
+	0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,
+	A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, 0,
+	0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,
+	A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, E
+};
+#undef W
+#undef A
+#undef D
+#undef E
+#undef C
+
 char *strcat_to_new(char *first_str, char* second_str) {
     /* first_str_len + second_str_len + string line terminator */
 	char *new_string = (char *) better_malloc(strlen(first_str) + strlen(second_str) + 1);
@@ -101,22 +135,6 @@ bool find_instruction_label(char* content, char *symbol_buff) {
 	return FALSE; /* Symbol not found */
 }
 
-/***
- * Takes the register out of the label
- * @param full_label
- * @return label without register and braces
- */
-char *extract_index_addressing_label(char* full_label){
-    char *short_label = better_malloc(MAX_LABEL_LENGTH);
-    int i, open_braces_index = index_of_char(full_label, '[');
-
-    for(i=0; i<open_braces_index;i++) {
-        short_label[i] = full_label[i];
-    }
-    short_label[i] = '\0';
-    return short_label;
-}
-
 /***
  * Finds index of char in a given string
  * @param string string to search in
@@ -161,12 +179,45 @@ bool is_integer(char *string) {
 	int i = 0;
 	if (string[0] == '-' || string[0] == '+') string++; /* if string starts with +/-, it's OK */
 	for (; string[i]; i++) { /* Just make sure that everything is a digit until the end */
-		if (!isdigit(string[i])) {
+		if (!(CHAR_CLASS(string[i]) & CHAR_DIGIT)) {
 			return FALSE;
 		}
 	}
 	return i > 0; /* if i==0 then it was an empty string! */
 }
+bool is_integer_view(char *string, int length) {
+	int i = 0;
+	if (length > 0 && (string[0] == '-' || string[0] == '+')) i++; /* if string starts with +/-, it's OK */
+	if (i == length) return FALSE; /* an empty string isn't a number */
+	for (; i < length; i++) {
+		if (!(CHAR_CLASS(string[i]) & CHAR_DIGIT)) return FALSE;
+	}
+	return TRUE;
+}
+
+bool parse_integer_token(char *string, int *length, long *value) {
+	int i = 0, digits_start, digit;
+	bool is_negative = FALSE, is_valid;
+	unsigned long magnitude = 0, limit;
+	if (string[0] == '-' || string[0] == '+') { /* if string starts with +/-, it's OK */
+		is_negative = string[0] == '-';
+		i++;
+	}
+	/* strtol saturates on overflow, so do we */
+	limit = is_negative ? (unsigned long) LONG_MAX + 1 : (unsigned long) LONG_MAX;
+	for (digits_start = i; CHAR_CLASS(string[i]) & CHAR_DIGIT; i++) {
+		digit = string[i] - '0';
+		magnitude = magnitude > (limit - digit) / 10 ? limit : magnitude * 10 + digit;
+	}
+	/* At least one digit, and the token must end right after them */
+	is_valid = i > digits_start && IS_TOKEN_END(string[i]);
+	/* On failure measure the whole token for the error message */
+	for (; !IS_TOKEN_END(string[i]); i++);
+	*length = i;
+	*value = is_negative ? (long) (0 - magnitude) : (long) magnitude;
+	return is_valid;
+}
+
 /***
  * Malloc wrapper with error "handling"
  * @param size size to allocate in bytes
@@ -192,22 +243,31 @@ void *better_malloc(long size) {
  * @return True if label is valid else false
  */
 bool is_valid_label_name(char *name) {
-	return name[0] && strlen(name) <= MAX_LABEL_LENGTH && isalpha(name[0]) && is_alnum_str(name + 1) &&
-           !is_reserved_word(name);
+	return is_valid_label_view(name, (int) strlen(name));
+}
+
+bool is_valid_label_view(char *name, int length) {
+	char copy[MAX_LABEL_LENGTH + 1];
+	int i;
+	if (length < 1 || length > MAX_LABEL_LENGTH || !(CHAR_CLASS(name[0]) & CHAR_ALPHA)) return FALSE;
+	for (i = 1; i < length; i++) {
+		if (!(CHAR_CLASS(name[i]) & (CHAR_ALPHA | CHAR_DIGIT))) return FALSE;
+	}
+	/* Short enough for the stack, the reserved words lookups need a null terminated name */
+	memcpy(copy, name, length);
+	copy[length] = '\0';
+	return !is_reserved_word(copy);
 }
 
 /**
- * Wrapper for isalnum ctype.h function that handles strings
+ * Alphanumeric check of a whole string (like isalnum in the C locale, by the char_classes table)
  * @param string input string
  * @return True if alphanumeric else false
  */
 bool is_alnum_str(char *string) {
-	int i;
-    /* enumerate string characters and feeds them to isalnum func  */
-	for (i = 0; string[i]; i++) {
-		if (!isalnum(string[i])) return FALSE;
-	}
-	return TRUE;
+    /* enumerate string characters until the first non alphanumeric one */
+	for (; CHAR_CLASS(*string) & (CHAR_ALPHA | CHAR_DIGIT); string++);
+	return !*string;
 }
 
 bool is_reserved_word(char *name) {
@@ -220,9 +280,54 @@ bool is_reserved_word(char *name) {
 	return FALSE;
 }
 
+void init_diagnostic_log(diagnostic_log *log) {
+	log->items = NULL;
+	log->count = log->capacity = 0;
+}
+
+void add_diagnostic(diagnostic_log *log, long line_number, char *text) {
+	if (log->count == log->capacity) {
+		diagnostic *grown;
+		log->capacity = log->capacity ? log->capacity * 2 : 16;
+		grown = (diagnostic *) better_malloc(log->capacity * sizeof(diagnostic));
+		if (log->count) memcpy(grown, log->items, log->count * sizeof(diagnostic));
+		free(log->items);
+		log->items = grown;
+	}
+	log->items[log->count].line_number = line_number;
+	log->items[log->count].text = strcat_to_new(text, "");
+	log->count++;
+}
+
+void print_diagnostics(diagnostic_log *log) {
+	long i;
+	for (i = 0; i < log->count; i++) {
+		fputs(log->items[i].text, STDERR_FILE);
+	}
+}
+
+void free_diagnostic_log(diagnostic_log *log) {
+	while (log->count > 0) free(log->items[--log->count].text);
+	free(log->items);
+	init_diagnostic_log(log);
+}
+
 int fprintf_error_specific(line_descriptor line, char *message, ...) { /* Prints the errors into a file, defined above as macro */
 	int result;
 	va_list args;
+	if (line.diagnostics != NULL) {
+		/* Held back - format the same text into a buffer */
+		char text[MAX_DIAGNOSTIC_LENGTH];
+		int prefix = snprintf(text, sizeof(text), "Error In %s:%ld: ", line.full_file_name, line.line_number);
+		if (prefix < 0 || prefix >= (int) sizeof(text)) prefix = 0;
+		va_start(args, message);
+		result = vsnprintf(text + prefix, sizeof(text) - prefix - 1, message, args);
+		va_end(args);
+		/* One char is left for the line break, even if the message was cut */
+		strcat(text, "\n");
+		add_diagnostic(line.diagnostics, line.line_number, text);
+		return result;
+	}
 	fprintf(STDERR_FILE, "Error In %s:%ld: ", line.full_file_name, line.line_number);
 
 	va_start(args, message);
@@ -5,8 +5,21 @@
 #include "globals.h"
 
 
+/** Character class bits of char_classes */
+#define CHAR_BLANK 1 /* ' ' and '\t' */
+#define CHAR_ALPHA 2
+#define CHAR_DIGIT 4
+#define CHAR_LINE_END 8 /* '\0', '\n' and EOF */
+#define CHAR_COMMA 16
+
+/** Class bits of every char, one table load instead of a chain of compares */
+extern const unsigned char char_classes[256];
+
+/** The class bits of a single char */
+#define CHAR_CLASS(c) (char_classes[(unsigned char) (c)])
+
 /** simple macro that forwards the line index to the next non-whitespace char */
-#define SKIP_TO_NEXT_NON_WHITESPACE(string, index) for (;string[index] && (string[index] == '\t' || string[index] == ' '); (++index));
+#define SKIP_TO_NEXT_NON_WHITESPACE(string, index) for (; CHAR_CLASS(string[index]) & CHAR_BLANK; (++index));
 
 /**
  * Concatenates both string to a new allocated memory
@@ -41,12 +54,6 @@ int get_first_field(const char* line_string,char* field);
  */
 bool find_instruction_label(char* content, char *symbol_buff);
 
-/***
- * Takes the register out of the label
- * @param full_label
- * @return label without register and braces
- */
-char *extract_index_addressing_label(char* full_label);
 
 /***
  * Finds index of char in a given string
@@ -70,6 +77,27 @@ instruction get_instruction_by_name(char *instruction_str);
  */
 bool is_integer(char* string);
 
+/**
+ * Tests whether a string of a given length is an optional +/- sign followed by digits only
+ * @param string The string, doesn't have to be null terminated
+ * @param length The length of the string
+ * @return True if its an integer else false
+ */
+bool is_integer_view(char *string, int length);
+
+/** Whether c ends a .data number or an operand token */
+#define IS_TOKEN_END(c) (CHAR_CLASS(c) & (CHAR_BLANK | CHAR_LINE_END | CHAR_COMMA))
+
+/**
+ * Validates and parses a base 10 integer token in a single scan, instead of is_integer + strtol.
+ * The token ends at whitespace, comma, end of line or end of string.
+ * @param string The token start, an optional +/- sign followed by digits
+ * @param length The length of the whole token, valid or not OUTPUT
+ * @param value The parsed value, saturated like strtol OUTPUT
+ * @return True if the token is an integer else false
+ */
+bool parse_integer_token(char *string, int *length, long *value);
+
 /***
  * Malloc wrapper with error "handling"
  * @param size size to allocate in bytes
@@ -90,7 +118,15 @@ void *better_malloc(long size);
 bool is_valid_label_name(char* name);
 
 /**
- * Wrapper for isalnum ctype.h function that handles strings
+ * Checks if a string of a given length is a valid label name, like is_valid_label_name
+ * @param name The label name, doesn't have to be null terminated
+ * @param length The length of the name
+ * @return True if label is valid and vice versa
+ */
+bool is_valid_label_view(char *name, int length);
+
+/**
+ * Alphanumeric check of a whole string (like isalnum in the C locale, by the char_classes table)
  * @param string input string
  * @return True if alphanumeric else false
  */
@@ -102,6 +138,7 @@ bool is_reserved_word(char *name);
 /**
  * Prints a detailed error message, including file name and line number by the specified message,
  * formatted as specified in App. B of "The C Programming language" for printf.
+ * If the line has a diagnostic log, the message is added to it instead of being printed.
  * @param line line_descriptor information object
  * @param message The error message
  * @param ... The arguments to format into the message
@@ -109,6 +146,32 @@ bool is_reserved_word(char *name);
  */
 int fprintf_error_specific(line_descriptor line, char *message, ...);
 
+/**
+ * Initializes an empty diagnostic log
+ * @param log The log
+ */
+void init_diagnostic_log(diagnostic_log *log);
+
+/**
+ * Appends a copy of a formatted error message to the log
+ * @param log The log
+ * @param line_number The line the message belongs to
+ * @param text The full message text
+ */
+void add_diagnostic(diagnostic_log *log, long line_number, char *text);
+
+/**
+ * Prints all the messages of the log, in the order they were added
+ * @param log The log
+ */
+void print_diagnostics(diagnostic_log *log);
+
+/**
+ * Frees all the messages of the log, leaving it empty
+ * @param log The log
+ */
+void free_diagnostic_log(diagnostic_log *log);
+
 /**
  * Prints a detailed error message
  * formatted as specified in App. B of "The C Programming language" for printf.
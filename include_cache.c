@@ -0,0 +1,115 @@
+/* Cache of the files read by .include - every included file is expanded once per run */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "include_cache.h"
+#include "helper.h"
+
+/** Cached modules, removed only by clearing the cache. Workers forked after a module was added share it. */
+static included_module *modules = NULL;
+
+static pthread_mutex_t modules_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Finds a cached module. The lock must be held.
+ * @param path The path of the file
+ * @param content_hash The hash of the file's content
+ * @return The module, NULL if not cached
+ */
+static included_module *find_module_locked(char *path, unsigned long content_hash);
+
+included_module *find_included_module(char *path, unsigned long content_hash) {
+    included_module *module;
+    pthread_mutex_lock(&modules_lock);
+    module = find_module_locked(path, content_hash);
+    pthread_mutex_unlock(&modules_lock);
+    return module;
+}
+
+included_module *add_included_module(included_module *module) {
+    included_module *cached;
+    pthread_mutex_lock(&modules_lock);
+    /* Another thread may have expanded the same file since the lookup */
+    if ((cached = find_module_locked(module->path, module->content_hash)) == NULL) {
+        module->next = modules;
+        modules = module;
+        cached = module;
+    }
+    pthread_mutex_unlock(&modules_lock);
+    if (cached != module) free_included_module(module);
+    return cached;
+}
+
+void free_included_module(included_module *module) {
+    long i;
+    list_node *macro = module->macros;
+    for (i = 0; i < module->line_count; i++) {
+        free(module->lines[i]);
+    }
+    free(module->lines);
+    free_line_origin_log(&module->origins);
+    free_include_log(&module->includes);
+    while (macro != NULL) {
+        list_node *next_macro = macro->next;
+        simple_node *macro_line = macro->macro_lines;
+        while (macro_line != NULL) {
+            simple_node *next_line = macro_line->next;
+            free(macro_line->data);
+            free(macro_line);
+            macro_line = next_line;
+        }
+        free(macro);
+        macro = next_macro;
+    }
+    free(module->path);
+    free(module);
+}
+
+void clear_included_modules(void) {
+    included_module *module;
+    pthread_mutex_lock(&modules_lock);
+    while ((module = modules) != NULL) {
+        modules = module->next;
+        free_included_module(module);
+    }
+    pthread_mutex_unlock(&modules_lock);
+}
+
+void init_include_log(include_log *log) {
+    log->paths = NULL;
+    log->count = log->capacity = 0;
+}
+
+void add_include_path(include_log *log, char *path) {
+    long i;
+    /* A file includes a few files, a linear search is enough */
+    for (i = 0; i < log->count; i++) {
+        if (strcmp(log->paths[i], path) == 0) return;
+    }
+    if (log->count == log->capacity) {
+        char **grown;
+        log->capacity = log->capacity ? log->capacity * 2 : 8;
+        grown = (char **) better_malloc(log->capacity * sizeof(char *));
+        if (log->count) memcpy(grown, log->paths, log->count * sizeof(char *));
+        free(log->paths);
+        log->paths = grown;
+    }
+    log->paths[log->count++] = strcat_to_new(path, "");
+}
+
+void free_include_log(include_log *log) {
+    long i;
+    for (i = 0; i < log->count; i++) {
+        free(log->paths[i]);
+    }
+    free(log->paths);
+    init_include_log(log);
+}
+
+static included_module *find_module_locked(char *path, unsigned long content_hash) {
+    included_module *module;
+    for (module = modules; module != NULL; module = module->next) {
+        if (module->content_hash == content_hash && strcmp(module->path, path) == 0) return module;
+    }
+    return NULL;
+}
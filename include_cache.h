@@ -0,0 +1,79 @@
+/* Cache of the files read by .include - every included file is expanded once per run */
+#ifndef _INCLUDE_CACHE_H
+#define _INCLUDE_CACHE_H
+#include "globals.h"
+#include "line_map.h"
+
+/** The paths of the files an expansion included, each path once */
+typedef struct include_log {
+    char **paths;
+    long count;
+    long capacity;
+} include_log;
+
+/** An included file after macro expansion, shared read-only by every file that includes it */
+typedef struct included_module {
+    /** The path the file was read from */
+    char *path;
+    /** FNV-1a hash of the file's content, a changed file is a different module */
+    unsigned long content_hash;
+    /** The expanded lines, with the file's own includes spliced in, as read by fgets */
+    char **lines;
+    long line_count;
+    /** Origins of the lines, one for each line */
+    line_origin_log origins;
+    /** The macros the file defines (and the macros of the files it includes) */
+    list_node *macros;
+    /** The files the file includes, directly or through the files it includes */
+    include_log includes;
+    struct included_module *next;
+} included_module;
+
+/**
+ * Finds a cached module. Thread safe.
+ * @param path The path of the file
+ * @param content_hash The hash of the file's current content
+ * @return The module, NULL if the file with this content wasn't cached
+ */
+included_module *find_included_module(char *path, unsigned long content_hash);
+
+/**
+ * Adds a module to the cache, which owns it from now on. Thread safe.
+ * If the same module was added meanwhile, the given one is deallocated.
+ * @param module The module, allocated with better_malloc
+ * @return The cached module
+ */
+included_module *add_included_module(included_module *module);
+
+/**
+ * Deallocates a module that wasn't added to the cache
+ * @param module The module
+ */
+void free_included_module(included_module *module);
+
+/**
+ * Removes every module from the cache, the files are expanded again when next included.
+ * No module may be in use meanwhile.
+ */
+void clear_included_modules(void);
+
+/**
+ * Initializes an empty log
+ * @param log The log
+ */
+void init_include_log(include_log *log);
+
+/**
+ * Adds a copy of a path to the log, unless it's already there
+ * @param log The log
+ * @param path The path
+ */
+void add_include_path(include_log *log, char *path);
+
+/**
+ * Deallocates the paths of the log, and empties it
+ * @param log The log
+ */
+void free_include_log(include_log *log);
+
+#endif
@@ -0,0 +1,657 @@
+/* Incremental reassembly - the unit of a file kept between assemblies, and updated by the lines that changed */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "incremental_unit.h"
+#include "helper.h"
+#include "opcode_builder.h"
+#include "second_pass.h"
+#include "output_module.h"
+#include "pre_assembler.h"
+#include "trace.h"
+
+/** Bytes that the texts are compared by at once, before the bytes of the block that differs */
+#define TEXT_COMPARE_BLOCK 4096
+
+/** The expanded source, exactly as it's written to the .am file */
+typedef struct expanded_text {
+    char *text;
+    long length;
+    long capacity;
+} expanded_text;
+
+/** The changed lines, and what the first pass built from them before it replaces the kept lines' part */
+typedef struct changed_lines {
+    /** The new lines [first_line, end_line) replace the kept lines [first_line, kept_end_line) */
+    long first_line, end_line, kept_end_line;
+    /** The counters at the first changed line, and after the last one */
+    long first_ic, first_dc, end_ic, end_dc;
+    /** Images at the final addresses, only the changed lines' part is used */
+    machine_word **code_img;
+    long *data_img;
+    /** What the changed lines added, by their new line indexes */
+    line_records symbols;
+    line_records entries;
+    line_records fixups;
+} changed_lines;
+
+/**
+ * Expanded line handler that appends the line to the expanded text
+ * @param context The expanded_text
+ * @param line The expanded line
+ */
+static void collect_expanded_text(void *context, char *line);
+
+/**
+ * Finds the changed lines by the bytes that the kept text and the new text share at their start and at their end.
+ * The lines are split the same at the start of any line, so the shared whole lines are the same lines.
+ * @param kept The kept unit
+ * @param expanded The new expanded text
+ * @param changed Where the changed lines are set
+ * @param first_byte Set to the offset of the first changed line in the new text
+ * @param end_byte Set to the offset after the last changed line in the new text
+ */
+static void find_changed_lines(incremental_unit *kept, expanded_text *expanded, changed_lines *changed,
+                               long *first_byte, long *end_byte);
+
+/**
+ * @return Whether an offset of a text is at the start of a line
+ */
+static bool is_line_start(char *text, long offset);
+
+/**
+ * @return The amount of lines in a part of a text that starts at the start of a line
+ */
+static long count_text_lines(char *text, long length);
+
+/**
+ * Runs the first pass on the changed lines, at the counters of the first one. Every line gets its own symbol table,
+ * like a chunk of the parallel first pass, so what it added is recorded apart from the other lines.
+ * @param current The unit of the changed lines only
+ * @param changed The changed lines, their words, symbols, .entry lines and label words are added to it
+ * @return Whether all the lines passed
+ */
+static bool pass_changed_lines(assembly_unit *current, changed_lines *changed);
+
+/**
+ * Records the label words of a code line, found by the same walk over the operands as add_symbol_to_machine_code
+ * @param fixups The records
+ * @param line The code line
+ * @param index The line index
+ */
+static void add_line_fixups(line_records *fixups, line_descriptor line, long index);
+
+/**
+ * @param line A line that passed the first pass
+ * @return Whether the second pass handles the line as an .entry instruction
+ */
+static bool is_entry_line(line_descriptor line);
+
+/**
+ * Replaces the kept lines' part with the changed lines: the words and counters after it are moved to their new
+ * addresses, the kept unit takes the new lines, and the records of the replaced lines are replaced
+ * @param kept The kept unit
+ * @param current The unit of the changed lines, left without lines
+ * @param changed The changed lines, their words are moved to the kept unit
+ */
+static void splice_changed_lines(incremental_unit *kept, assembly_unit *current, changed_lines *changed);
+
+/**
+ * Rebuilds the symbol table from the symbols that the lines added, at their lines' counters and in line order,
+ * exactly like the first pass of all the lines builds it
+ * @param kept The kept unit
+ * @return False if a label is already defined
+ */
+static bool replay_line_symbols(incremental_unit *kept);
+
+/**
+ * Resolves the label words of the symbols whose value or type changed, and the ones that weren't resolved yet,
+ * logs the external references again, and checks the .entry lines again
+ * @param kept The kept unit, after the first pass was finished
+ * @return False if a symbol is missing, or an .entry line is wrong
+ */
+static bool resolve_label_words(incremental_unit *kept);
+
+/**
+ * Sets the data of a label word, allocating the word if it wasn't resolved yet
+ * @param word The word in the code image
+ * @param data The encoded data
+ */
+static void set_label_word(machine_word **word, operand_data_word *data);
+
+/**
+ * Writes the expanded text to the .am file
+ * @param filename The filename without extension
+ * @param expanded The expanded text
+ * @return Whether succeeded
+ */
+static bool write_am_file(char *filename, expanded_text *expanded);
+
+/**
+ * @return The instruction counter at a line of the unit, the final one after the last line
+ */
+static long line_ic(assembly_unit *unit, long index);
+
+/**
+ * @return The data counter at a line of the unit, the final one after the last line
+ */
+static long line_dc(assembly_unit *unit, long index);
+
+/**
+ * Initializes empty records
+ * @param records The records
+ * @param record_size Size of a single record, which starts with its line index
+ */
+static void init_line_records(line_records *records, size_t record_size);
+
+/**
+ * Adds a copy of a record after the last one
+ * @param records The records
+ * @param record The record, of a line after the lines of the other records
+ */
+static void add_line_record(line_records *records, void *record);
+
+/**
+ * @return The record at an index
+ */
+static void *get_line_record(line_records *records, long index);
+
+/**
+ * Finds the first record of a line, or of the lines after it
+ * @param records The records
+ * @param line_index The line index
+ * @return Index of the record, the count if there's none
+ */
+static long find_line_record(line_records *records, long line_index);
+
+/**
+ * Replaces the records of the lines [first_line, end_line) with other records, and moves the line indexes of the
+ * records after them
+ * @param records The records
+ * @param first_line The first replaced line
+ * @param end_line The line after the last replaced line
+ * @param replacement The new records, of the lines from first_line on
+ * @param line_delta The change in the line count, added to the line indexes after the replaced lines
+ */
+static void splice_line_records(line_records *records, long first_line, long end_line, line_records *replacement,
+                                long line_delta);
+
+/**
+ * Deallocates the records
+ * @param records The records
+ */
+static void free_line_records(line_records *records);
+
+void init_incremental_unit(incremental_unit *kept, char *filename) {
+    kept->unit = create_assembly_unit(filename);
+    kept->text = NULL;
+    kept->length = 0;
+    init_line_records(&kept->symbols, sizeof(line_symbol));
+    init_line_records(&kept->entries, sizeof(long));
+    init_line_records(&kept->fixups, sizeof(symbol_fixup));
+}
+
+bool update_incremental_unit(incremental_unit *kept, assembly_options *options, int threads, include_log *includes) {
+    assembly_unit *unit = kept->unit, *current;
+    char *filename = unit->filename;
+    expanded_text expanded;
+    line_origin_log origins;
+    line_splitter splitter;
+    changed_lines changed;
+    long first_byte, end_byte;
+    bool succeeded;
+    double start = trace_now();
+
+    if (options->check_only || options->strip_data || options->pool_strings || options->report ||
+        options->report_json) {
+        return FALSE;
+    }
+    unit->options = *options;
+    expanded.text = NULL;
+    expanded.length = expanded.capacity = 0;
+    init_line_origin_log(&origins);
+    if (!expand_macros_to(filename, collect_expanded_text, &expanded, NULL, options->line_map ? &origins : NULL,
+                          includes)) {
+        free(expanded.text);
+        free_line_origin_log(&origins);
+        return FALSE;
+    }
+    trace_span("expand_macros", filename, start);
+
+    /* The lines that are the same at the start and at the end keep what they built. Only the changed lines are
+     * split, exactly like the .am file is read, but nothing is passed yet. */
+    start = trace_now();
+    find_changed_lines(kept, &expanded, &changed, &first_byte, &end_byte);
+    current = create_assembly_unit(filename);
+    init_line_splitter(&splitter, current);
+    splitter.is_passing = FALSE;
+    first_pass_text(&splitter, expanded.text + first_byte, end_byte - first_byte);
+    finish_first_pass_text(&splitter);
+    changed.first_ic = line_ic(unit, changed.first_line);
+    changed.first_dc = line_dc(unit, changed.first_line);
+    changed.code_img = (machine_word **) better_malloc(CODE_ARR_IMG_LENGTH * sizeof(machine_word *));
+    memset(changed.code_img, 0, CODE_ARR_IMG_LENGTH * sizeof(machine_word *));
+    changed.data_img = (long *) better_malloc(CODE_ARR_IMG_LENGTH * sizeof(long));
+    init_line_records(&changed.symbols, sizeof(line_symbol));
+    init_line_records(&changed.entries, sizeof(long));
+    init_line_records(&changed.fixups, sizeof(symbol_fixup));
+
+    succeeded = pass_changed_lines(current, &changed) &&
+                unit->icf + changed.end_ic - line_ic(unit, changed.kept_end_line) - IC_INIT_VALUE <=
+                CODE_ARR_IMG_LENGTH &&
+                unit->dcf + changed.end_dc - line_dc(unit, changed.kept_end_line) <= CODE_ARR_IMG_LENGTH;
+    if (succeeded) {
+        splice_changed_lines(kept, current, &changed);
+    } else {
+        /* The kept unit wasn't touched, the next update compares with it again */
+        long end_ic = changed.end_ic < IC_INIT_VALUE + CODE_ARR_IMG_LENGTH ? changed.end_ic :
+                      IC_INIT_VALUE + CODE_ARR_IMG_LENGTH;
+        free_code_image(changed.code_img + (changed.first_ic - IC_INIT_VALUE), end_ic - changed.first_ic);
+    }
+    free(changed.code_img);
+    free(changed.data_img);
+    free_line_records(&changed.symbols);
+    free_line_records(&changed.entries);
+    free_line_records(&changed.fixups);
+    free_assembly_unit(current);
+    if (!succeeded) {
+        free(expanded.text);
+        free_line_origin_log(&origins);
+        return FALSE;
+    }
+
+    unit->success = replay_line_symbols(kept);
+    finish_first_pass(unit);
+    trace_span("first_pass", filename, start);
+    start = trace_now();
+    /* The kept unit has the new lines even if their symbols don't resolve, the next update resolves them again */
+    free(kept->text);
+    kept->text = expanded.text;
+    kept->length = expanded.length;
+    if (!unit->success || !resolve_label_words(kept)) {
+        free_line_origin_log(&origins);
+        return FALSE;
+    }
+    trace_span("second_pass", filename, start);
+
+    start = trace_now();
+    unit->origins = options->line_map ? &origins : NULL;
+    succeeded = write_am_file(filename, &expanded) &&
+                write_output_files(unit->code_img, unit->data_img, unit->icf, unit->dcf, filename,
+                                   unit->symbol_table, &unit->external_references, threads) &&
+                write_optional_outputs(unit);
+    unit->origins = NULL;
+    trace_span("write_outputs", filename, start);
+    free_line_origin_log(&origins);
+    return succeeded;
+}
+
+void free_incremental_unit(incremental_unit *kept) {
+    free_assembly_unit(kept->unit);
+    kept->unit = NULL;
+    free(kept->text);
+    kept->text = NULL;
+    free_line_records(&kept->symbols);
+    free_line_records(&kept->entries);
+    free_line_records(&kept->fixups);
+}
+
+static void collect_expanded_text(void *context, char *line) {
+    expanded_text *expanded = (expanded_text *) context;
+    long length = (long) strlen(line);
+    if (expanded->length + length > expanded->capacity) {
+        char *grown;
+        expanded->capacity = expanded->capacity ? expanded->capacity * 2 : 65536;
+        if (expanded->capacity < expanded->length + length) expanded->capacity = expanded->length + length;
+        grown = (char *) better_malloc(expanded->capacity);
+        if (expanded->length) memcpy(grown, expanded->text, expanded->length);
+        free(expanded->text);
+        expanded->text = grown;
+    }
+    memcpy(expanded->text + expanded->length, line, length);
+    expanded->length += length;
+}
+
+static void find_changed_lines(incremental_unit *kept, expanded_text *expanded, changed_lines *changed,
+                               long *first_byte, long *end_byte) {
+    char *kept_text = kept->text, *text = expanded->text;
+    long kept_length = kept->length, length = expanded->length;
+    long shared = kept_length < length ? kept_length : length, first, tail;
+
+    for (first = 0; first + TEXT_COMPARE_BLOCK <= shared &&
+         memcmp(kept_text + first, text + first, TEXT_COMPARE_BLOCK) == 0; first += TEXT_COMPARE_BLOCK);
+    for (; first < shared && kept_text[first] == text[first]; first++);
+    /* Back to the start of the line that changed, which is a line start in both texts */
+    while (first > 0 && text[first - 1] != '\n') first--;
+    for (tail = 0; tail + TEXT_COMPARE_BLOCK <= shared - first &&
+         memcmp(kept_text + kept_length - tail - TEXT_COMPARE_BLOCK, text + length - tail - TEXT_COMPARE_BLOCK,
+                TEXT_COMPARE_BLOCK) == 0; tail += TEXT_COMPARE_BLOCK);
+    for (; tail < shared - first && kept_text[kept_length - 1 - tail] == text[length - 1 - tail]; tail++);
+    /* On to a line that starts in both texts, the lines after it are the same */
+    while (tail > 0 && !(is_line_start(text, length - tail) && is_line_start(kept_text, kept_length - tail))) tail--;
+
+    *first_byte = first;
+    *end_byte = length - tail;
+    changed->first_line = count_text_lines(text, first);
+    changed->end_line = changed->first_line + count_text_lines(text + first, length - tail - first);
+    changed->kept_end_line = kept->unit->line_count - count_text_lines(text + length - tail, tail);
+}
+
+static bool is_line_start(char *text, long offset) {
+    return offset == 0 || text[offset - 1] == '\n';
+}
+
+static long count_text_lines(char *text, long length) {
+    char *end = text + length, *new_line;
+    long count = 0;
+    for (; text < end && (new_line = memchr(text, '\n', end - text)) != NULL; text = new_line + 1) count++;
+    /* The last line, without '\n' */
+    return count + (text < end);
+}
+
+static bool pass_changed_lines(assembly_unit *current, changed_lines *changed) {
+    long i, j, ic = changed->first_ic, dc = changed->first_dc;
+    bool succeeded = TRUE;
+    diagnostic_log ignored;
+
+    /* The full assembly reports the errors */
+    init_diagnostic_log(&ignored);
+    for (i = changed->first_line; i < changed->end_line && succeeded; i++) {
+        table added = NULL, entry;
+        char label[MAX_LABEL_LENGTH + 1];
+        intern_id label_id = NO_INTERN_ID;
+        source_line *source = &current->lines[i - changed->first_line];
+        line_descriptor line = get_unit_line(current, i - changed->first_line);
+        line.line_number = i + 1;
+        line.diagnostics = &ignored;
+        source->ic = ic;
+        source->dc = dc;
+        succeeded = first_pass_line_into(line, source->is_too_long, &ic, &dc, changed->code_img,
+                                         changed->data_img, &added, NULL);
+        if (succeeded && find_checked_label(line, label)) {
+            label_id = intern_string(label);
+            /* Every line that passed with a label adds a symbol, the check is replayed with it */
+            succeeded = added != NULL;
+        }
+        for (entry = added; succeeded && entry != NULL; entry = entry->next) {
+            line_symbol symbol;
+            symbol.line_index = i;
+            symbol.label_id = label_id;
+            symbol.key_id = entry->key_id;
+            symbol.type = entry->type;
+            symbol.relative_value = entry->value;
+            if (entry->type == CODE_SYMBOL) symbol.relative_value -= source->ic;
+            else if (entry->type == DATA_SYMBOL) symbol.relative_value -= source->dc;
+            add_line_record(&changed->symbols, &symbol);
+            /* The label is checked once, before the line's first symbol is added */
+            label_id = NO_INTERN_ID;
+        }
+        free_table(added);
+        if (!succeeded) break;
+
+        if (is_entry_line(line)) add_line_record(&changed->entries, &i);
+        /* The first pass left the label words of a code line empty */
+        for (j = source->ic; j < ic && changed->code_img[j - IC_INIT_VALUE] != NULL; j++);
+        if (j < ic) add_line_fixups(&changed->fixups, line, i);
+    }
+    free_diagnostic_log(&ignored);
+    changed->end_ic = ic;
+    changed->end_dc = dc;
+    return succeeded;
+}
+
+static void add_line_fixups(line_records *fixups, line_descriptor line, long index) {
+    char symbol[MAX_LINE_LENGTH + 2];
+    operand_view operands[2];
+    int i = 0, j, operand_count;
+    /* Operand words start after the code word and the funct word */
+    long word = 1;
+
+    SKIP_TO_NEXT_NON_WHITESPACE(line.content, i)
+    find_and_validate_label(line, symbol);
+    if (symbol[0] != '\0') {
+        for (; line.content[i] && line.content[i] != '\n' && line.content[i] != EOF && line.content[i] != ' ' &&
+               line.content[i] != '\t'; i++);
+        i++;
+    }
+    SKIP_TO_NEXT_NON_WHITESPACE(line.content, i)
+    for (; line.content[i] && line.content[i] != ' ' && line.content[i] != '\t' && line.content[i] != '\n' &&
+           line.content[i] != EOF; i++);
+    SKIP_TO_NEXT_NON_WHITESPACE(line.content, i)
+    analyze_operands(line, i, operands, &operand_count);
+
+    for (j = 0; j < operand_count; j++) {
+        addressing_type addressing = get_addressing_type(&operands[j]);
+        if (addressing == IMMEDIATE_ADDR) {
+            word++;
+        } else if (addressing == DIRECT_ADDR || addressing == INDEX_ADDR) {
+            symbol_fixup fixup;
+            fixup.line_index = index;
+            fixup.word = word + 1;
+            fixup.key_id = intern_text(operands[j].text, operands[j].label_length);
+            fixup.addressing = addressing;
+            /* Not resolved yet, its words are empty */
+            fixup.value = 0;
+            fixup.is_external = FALSE;
+            add_line_record(fixups, &fixup);
+            word += 2;
+        }
+    }
+}
+
+static bool is_entry_line(line_descriptor line) {
+    char symbol[MAX_LINE_LENGTH + 2];
+    int i = 0;
+    /* The same checks as process_line_second_pass */
+    SKIP_TO_NEXT_NON_WHITESPACE(line.content, i)
+    if (!line.content[i] || line.content[i] == '\n' || line.content[i] == EOF || line.content[i] == ';')
+        return FALSE;
+    find_and_validate_label(line, symbol);
+    if (symbol[0] != '\0') i = index_of_char(line.content, ':') + 1;
+    SKIP_TO_NEXT_NON_WHITESPACE(line.content, i)
+    return line.content[i] == '.' && strncmp(".entry", line.content + i, 6) == 0;
+}
+
+static void splice_changed_lines(incremental_unit *kept, assembly_unit *current, changed_lines *changed) {
+    assembly_unit *unit = kept->unit;
+    long i, line_delta = changed->end_line - changed->kept_end_line, line_count = unit->line_count + line_delta;
+    long kept_end_ic = line_ic(unit, changed->kept_end_line), kept_end_dc = line_dc(unit, changed->kept_end_line);
+    long ic_delta = changed->end_ic - kept_end_ic, dc_delta = changed->end_dc - kept_end_dc;
+
+    /* The words of the replaced lines go, the words after them move to their new addresses */
+    free_code_image(unit->code_img + (changed->first_ic - IC_INIT_VALUE), kept_end_ic - changed->first_ic);
+    memmove(unit->code_img + (changed->end_ic - IC_INIT_VALUE), unit->code_img + (kept_end_ic - IC_INIT_VALUE),
+            (unit->icf - kept_end_ic) * sizeof(machine_word *));
+    memcpy(unit->code_img + (changed->first_ic - IC_INIT_VALUE), changed->code_img + (changed->first_ic - IC_INIT_VALUE),
+           (changed->end_ic - changed->first_ic) * sizeof(machine_word *));
+    if (ic_delta < 0) {
+        memset(unit->code_img + (unit->icf + ic_delta - IC_INIT_VALUE), 0, -ic_delta * sizeof(machine_word *));
+    }
+    memmove(unit->data_img + changed->end_dc, unit->data_img + kept_end_dc, (unit->dcf - kept_end_dc) * sizeof(long));
+    memcpy(unit->data_img + changed->first_dc, changed->data_img + changed->first_dc,
+           (changed->end_dc - changed->first_dc) * sizeof(long));
+    unit->ic = unit->icf + ic_delta;
+    unit->dc = unit->dcf + dc_delta;
+
+    /* The changed lines replace the kept ones, the lines after them move with their counters */
+    for (i = changed->first_line; i < changed->kept_end_line; i++) {
+        free(unit->lines[i].content);
+    }
+    if (line_count > unit->line_capacity) {
+        source_line *grown;
+        unit->line_capacity = unit->line_capacity * 2 > line_count ? unit->line_capacity * 2 : line_count;
+        grown = (source_line *) better_malloc(unit->line_capacity * sizeof(source_line));
+        if (unit->line_count) memcpy(grown, unit->lines, unit->line_count * sizeof(source_line));
+        free(unit->lines);
+        unit->lines = grown;
+    }
+    if (unit->line_count > changed->kept_end_line) {
+        memmove(unit->lines + changed->end_line, unit->lines + changed->kept_end_line,
+                (unit->line_count - changed->kept_end_line) * sizeof(source_line));
+    }
+    if (current->line_count) {
+        memcpy(unit->lines + changed->first_line, current->lines, current->line_count * sizeof(source_line));
+    }
+    for (i = changed->end_line; i < line_count; i++) {
+        unit->lines[i].ic += ic_delta;
+        unit->lines[i].dc += dc_delta;
+    }
+    unit->line_count = line_count;
+    /* The contents moved to the kept unit */
+    current->line_count = 0;
+
+    splice_line_records(&kept->symbols, changed->first_line, changed->kept_end_line, &changed->symbols, line_delta);
+    splice_line_records(&kept->entries, changed->first_line, changed->kept_end_line, &changed->entries, line_delta);
+    splice_line_records(&kept->fixups, changed->first_line, changed->kept_end_line, &changed->fixups, line_delta);
+}
+
+static bool replay_line_symbols(incremental_unit *kept) {
+    assembly_unit *unit = kept->unit;
+    long i;
+    free_table(unit->symbol_table);
+    unit->symbol_table = NULL;
+    for (i = 0; i < kept->symbols.count; i++) {
+        line_symbol *symbol = (line_symbol *) get_line_record(&kept->symbols, i);
+        long value = symbol->relative_value;
+        if (symbol->label_id != NO_INTERN_ID && find_by_types(unit->symbol_table, interned_string(symbol->label_id), 3,
+                                                              EXTERNAL_SYMBOL, DATA_SYMBOL, CODE_SYMBOL) != NULL) {
+            return FALSE;
+        }
+        if (symbol->type == CODE_SYMBOL) value += unit->lines[symbol->line_index].ic;
+        else if (symbol->type == DATA_SYMBOL) value += unit->lines[symbol->line_index].dc;
+        add_table_item(&unit->symbol_table, interned_string(symbol->key_id), value, symbol->type);
+    }
+    return TRUE;
+}
+
+static bool resolve_label_words(incremental_unit *kept) {
+    assembly_unit *unit = kept->unit;
+    diagnostic_log ignored;
+    bool succeeded = TRUE;
+    long i;
+
+    /* The log points to the entries of the table that was just rebuilt */
+    free_external_reference_log(&unit->external_references);
+    for (i = 0; i < kept->fixups.count; i++) {
+        symbol_fixup *fixup = (symbol_fixup *) get_line_record(&kept->fixups, i);
+        long address = unit->lines[fixup->line_index].ic + fixup->word;
+        machine_word **words = unit->code_img + (address - IC_INIT_VALUE);
+        table_entry *entry = find_by_types(unit->symbol_table, interned_string(fixup->key_id), 3, DATA_SYMBOL,
+                                           CODE_SYMBOL, EXTERNAL_SYMBOL);
+        bool is_external;
+        if (entry == NULL) return FALSE;
+        is_external = entry->type == EXTERNAL_SYMBOL;
+        if (is_external) add_external_reference(&unit->external_references, entry, address);
+        /* The words moved with their line, they change only with the symbol */
+        if (words[0] != NULL && fixup->value == entry->value && fixup->is_external == is_external) continue;
+        set_label_word(&words[0], encode_operand_data(fixup->addressing, entry->base, is_external));
+        set_label_word(&words[1], encode_operand_data(fixup->addressing, entry->offset, is_external));
+        fixup->value = entry->value;
+        fixup->is_external = is_external;
+    }
+
+    /* The entry symbols are added to the table again, in line order like the second pass adds them */
+    init_diagnostic_log(&ignored);
+    for (i = 0; i < kept->entries.count && succeeded; i++) {
+        line_descriptor line = get_unit_line(unit, *(long *) get_line_record(&kept->entries, i));
+        line.diagnostics = &ignored;
+        succeeded = process_line_second_pass(line, &unit->ic, unit->code_img, &unit->symbol_table,
+                                             &unit->external_references);
+    }
+    free_diagnostic_log(&ignored);
+    unit->ic = unit->icf;
+    return succeeded;
+}
+
+static void set_label_word(machine_word **word, operand_data_word *data) {
+    if (*word == NULL) {
+        *word = (machine_word *) better_malloc(sizeof(machine_word));
+        (*word)->is_operand = FALSE;
+        (*word)->length = 0;
+    } else {
+        free((*word)->word.data2);
+    }
+    (*word)->word.data2 = data;
+}
+
+static bool write_am_file(char *filename, expanded_text *expanded) {
+    char *path = strcat_to_new(filename, POST_MARCO_SUFFIX);
+    FILE *file_desc = fopen(path, "w");
+    bool succeeded = file_desc != NULL;
+    if (succeeded) {
+        succeeded = fwrite(expanded->text, 1, expanded->length, file_desc) == (size_t) expanded->length;
+        if (fclose(file_desc) != 0) succeeded = FALSE;
+    }
+    free(path);
+    return succeeded;
+}
+
+static long line_ic(assembly_unit *unit, long index) {
+    return index < unit->line_count ? unit->lines[index].ic : unit->icf;
+}
+
+static long line_dc(assembly_unit *unit, long index) {
+    return index < unit->line_count ? unit->lines[index].dc : unit->dcf;
+}
+
+static void init_line_records(line_records *records, size_t record_size) {
+    records->records = NULL;
+    records->record_size = record_size;
+    records->count = records->capacity = 0;
+}
+
+static void add_line_record(line_records *records, void *record) {
+    if (records->count == records->capacity) {
+        char *grown;
+        records->capacity = records->capacity ? records->capacity * 2 : 64;
+        grown = (char *) better_malloc(records->capacity * records->record_size);
+        if (records->count) memcpy(grown, records->records, records->count * records->record_size);
+        free(records->records);
+        records->records = grown;
+    }
+    memcpy(records->records + records->count * records->record_size, record, records->record_size);
+    records->count++;
+}
+
+static void *get_line_record(line_records *records, long index) {
+    return records->records + index * records->record_size;
+}
+
+static long find_line_record(line_records *records, long line_index) {
+    long low = 0, high = records->count;
+    while (low < high) {
+        long middle = low + (high - low) / 2;
+        if (*(long *) get_line_record(records, middle) < line_index) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+static void splice_line_records(line_records *records, long first_line, long end_line, line_records *replacement,
+                                long line_delta) {
+    long from = find_line_record(records, first_line), to = find_line_record(records, end_line), i;
+    long count = records->count - (to - from) + replacement->count;
+    size_t size = records->record_size;
+    if (count > records->capacity) {
+        char *grown;
+        records->capacity = records->capacity * 2 > count ? records->capacity * 2 : count;
+        grown = (char *) better_malloc(records->capacity * size);
+        if (records->count) memcpy(grown, records->records, records->count * size);
+        free(records->records);
+        records->records = grown;
+    }
+    if (records->count > to) {
+        memmove(records->records + (from + replacement->count) * size, records->records + to * size,
+                (records->count - to) * size);
+    }
+    if (replacement->count) memcpy(records->records + from * size, replacement->records, replacement->count * size);
+    for (i = from + replacement->count; i < count; i++) {
+        *(long *) get_line_record(records, i) += line_delta;
+    }
+    records->count = count;
+}
+
+static void free_line_records(line_records *records) {
+    free(records->records);
+    init_line_records(records, records->record_size);
+}
@@ -0,0 +1,85 @@
+/* Incremental reassembly - the unit of a file kept between assemblies, and updated by the lines that changed */
+#ifndef _INCREMENTAL_UNIT_H
+#define _INCREMENTAL_UNIT_H
+#include "globals.h"
+#include "assembly_unit.h"
+#include "include_cache.h"
+
+/** Records of some of the lines of a unit, in line order. Every record struct starts with the long index of its line. */
+typedef struct line_records {
+    char *records;
+    /** Size of a single record */
+    size_t record_size;
+    long count;
+    long capacity;
+} line_records;
+
+/** A symbol that a line added in the first pass */
+typedef struct line_symbol {
+    long line_index;
+    /** The label that the line checks for being already defined, NO_INTERN_ID if none */
+    intern_id label_id;
+    /** The added symbol */
+    intern_id key_id;
+    symbol_type type;
+    /** The value less the line's counter: its IC for a code symbol, its DC for a data symbol */
+    long relative_value;
+} line_symbol;
+
+/** The base and offset words of an operand, that the second pass resolves from a symbol */
+typedef struct symbol_fixup {
+    long line_index;
+    /** Address of the base word less the line's IC, the offset word follows it */
+    long word;
+    intern_id key_id;
+    addressing_type addressing;
+    /** The symbol value and type the words were resolved to */
+    long value;
+    bool is_external;
+} symbol_fixup;
+
+/** A file's unit, with what its lines added to it, kept from one assembly to the next */
+typedef struct incremental_unit {
+    /** The unit of the last assembly that succeeded, with the lines it was assembled from */
+    assembly_unit *unit;
+    /** The expanded text that the unit's lines were split from */
+    char *text;
+    long length;
+    /** The symbols the lines added (line_symbol) */
+    line_records symbols;
+    /** The .entry lines (long), checked again after every update */
+    line_records entries;
+    /** The label words of the code lines (symbol_fixup) */
+    line_records fixups;
+} incremental_unit;
+
+/**
+ * Starts keeping the unit of a file, with no lines
+ * @param kept The kept unit
+ * @param filename The filename without extension
+ */
+void init_incremental_unit(incremental_unit *kept, char *filename);
+
+/**
+ * Assembles a file by updating its kept unit. The source is expanded again, and compared with the kept text: only
+ * the lines between the first and the last line that changed are split and go through the first pass.
+ * The words and lines after them are moved by the change in the counters, the symbol table is rebuilt from what
+ * the lines added, and only the label words of symbols whose value changed are resolved again.
+ * The outputs are then written like a full assembly writes them.
+ * Nothing is printed: a file with errors, or with options that change or summarize the whole image (--check,
+ * --strip-data, --pool-strings, --report, --report-json), has to be assembled in full, which reports the errors.
+ * @param kept The kept unit, which takes the changed lines once they passed the first pass
+ * @param options The optional outputs and passes
+ * @param threads Maximum number of threads writing the outputs
+ * @param includes Where the paths of the included files are added
+ * @return False if the file has to be assembled in full
+ */
+bool update_incremental_unit(incremental_unit *kept, assembly_options *options, int threads, include_log *includes);
+
+/**
+ * Deallocates the kept unit, and everything its lines added
+ * @param kept The kept unit
+ */
+void free_incremental_unit(incremental_unit *kept);
+
+#endif
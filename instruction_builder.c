@@ -28,9 +28,8 @@ instruction parse_instruction_from_index(line_descriptor line, int *index) {
 /* Instruction line processing helper functions */
 
 bool process_string_instruction(line_descriptor line, int index, long *data_img, long *dc) {
-    char *last_quote_location = strrchr(line.content, '"'); /* str*r*char finds last occurrence*/
-    int last_char_index = (last_quote_location-line.content)+1;
-    SKIP_TO_NEXT_NON_WHITESPACE(line.content,last_char_index)
+    char *string_start, *string_end;
+    int length, last_char_index;
 
 	SKIP_TO_NEXT_NON_WHITESPACE(line.content, index)
 
@@ -38,24 +37,33 @@ bool process_string_instruction(line_descriptor line, int index, long *data_img,
 		/* something like: LABEL: .string  hello, world\n - the string isn't surrounded with "" */
         fprintf_error_specific(line, "[ERROR] Missing opening quote of string");
 		return FALSE;
-	} else if (&line.content[index] == last_quote_location) { /* last quote is same as first quote */
+	}
+    string_start = line.content + index + 1; /* skip the first quote */
+    length = strlen(string_start);
+    /* Find the last quote, scanning only the part after the opening one */
+    last_char_index = length - 1;
+    while (last_char_index >= 0 && string_start[last_char_index] != '"') {
+        last_char_index--;
+    }
+	if (last_char_index < 0) { /* last quote is same as first quote */
         fprintf_error_specific(line, "[ERROR ] Missing closing quote of string");
 		return FALSE;
-	} else if( line.content[last_char_index] != '\n' && line.content[last_char_index] != EOF) { /* test if " is really the last char */
+	}
+    last_char_index++;
+    SKIP_TO_NEXT_NON_WHITESPACE(string_start, last_char_index)
+    if (string_start[last_char_index] != '\n' && string_start[last_char_index] != EOF) { /* test if " is really the last char */
         fprintf_error_specific(line, "[ERROR] Chars after the closing quote");
         return FALSE;
-    } else {
-        index++; /* skip the first quote */
-		/* Copy the string including quotes & everything until end of line */
-		for (; line.content[index] && line.content[index] != '"'; index++) {
-                data_img[*dc] = line.content[index];
-                (*dc)++;
-		}
+    }
+    /* Copy the string until the first inner quote in one go */
+    string_end = memchr(string_start, '"', length);
+    for (; string_start < string_end; string_start++) {
+        data_img[(*dc)++] = *string_start;
+    }
 
-		/* Add string terminator */
-		data_img[*dc] = '\0';
-		(*dc)++;
-	}
+	/* Add string terminator */
+	data_img[*dc] = '\0';
+	(*dc)++;
 	return TRUE;
 }
 
@@ -63,29 +71,23 @@ bool process_string_instruction(line_descriptor line, int index, long *data_img,
  * Parses a .data instruction. copies each number value to data_img by dc position, and returns the amount of processed data.
  */
 bool process_data_instruction(line_descriptor line, int index, long *data_img, long *dc) {
-	char temp[80], *temp_ptr;
 	long value;
-	int i;
+	int length;
 	SKIP_TO_NEXT_NON_WHITESPACE(line.content, index)
 	if (line.content[index] == ',') {
         fprintf_error_specific(line, "[ERROR] Unexpected comma after .data instruction");
         return FALSE;
 	}
 	do {
-		for (i = 0;
-		     line.content[index] && line.content[index] != EOF && line.content[index] != '\t' &&
-		     line.content[index] != ' ' && line.content[index] != ',' &&
-		     line.content[index] != '\n'; index++, i++) {
-			temp[i] = line.content[index];
-		}
-		temp[i] = '\0'; /* End of string */
-		if (!is_integer(temp)) {
-            fprintf_error_specific(line, "Expected integer for .data instruction (got '%s')", temp);
+		/* Validate and parse the number in the same scan */
+		if (!parse_integer_token(line.content + index, &length, &value)) {
+            fprintf_error_specific(line, "Expected integer for .data instruction (got '%.*s')", length,
+                                   line.content + index);
 			return FALSE;
 		}
-		/* Now let's write to data buffer */
-		value = strtol(temp, &temp_ptr, 10);
+		index += length;
 
+		/* Now let's write to data buffer */
 		data_img[*dc] = value;
 
 		(*dc)++; /* a word was written right now */
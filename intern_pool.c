@@ -0,0 +1,223 @@
+/* Interning pool - a single stored copy, stable id and precomputed hash for every distinct identifier */
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "intern_pool.h"
+#include "helper.h"
+
+/** Strings per page of the strings array, pages are never moved so ids can be read without the lock */
+#define INTERN_PAGE_SIZE 1024
+
+/** Maximum amount of pages, 4M strings */
+#define MAX_INTERN_PAGES 4096
+
+/** Size of a block of the strings arena */
+#define INTERN_ARENA_BLOCK_SIZE 65536
+
+/** A single interned string */
+typedef struct interned {
+    /** Null terminated copy in the arena */
+    char *text;
+    int length;
+    unsigned long hash;
+} interned;
+
+/** The strings, by id */
+static interned *pages[MAX_INTERN_PAGES];
+static long string_count = 0;
+
+/** Open addressing hash table of ids, NO_INTERN_ID for an empty slot */
+static intern_id *slots = NULL;
+/** Number of slots, a power of 2 */
+static unsigned long slot_count = 0;
+
+/** The current block of the strings arena */
+static char *arena = NULL;
+static long arena_left = 0;
+
+/** Every block of the arena (and every long string), so the pool can be reset */
+static char **arena_blocks = NULL;
+static long arena_block_count = 0;
+static long arena_block_capacity = 0;
+
+/** Lookups take it for reading, adding a string takes it for writing */
+static pthread_rwlock_t pool_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/**
+ * Finds the slot of a string, or the empty slot where it belongs. The lock must be held.
+ * @param text The string
+ * @param length The length of the string
+ * @param hash The hash of the string
+ * @return Index of the slot
+ */
+static unsigned long find_slot(char *text, int length, unsigned long hash);
+
+/**
+ * Doubles the hash table. The write lock must be held.
+ */
+static void grow_slots(void);
+
+/**
+ * Copies a string into the arena. The write lock must be held.
+ * @param text The string
+ * @param length The length of the string
+ * @return The null terminated copy
+ */
+static char *arena_copy(char *text, int length);
+
+/**
+ * Allocates a block of the arena. The write lock must be held.
+ * @param size The size of the block
+ * @return The block
+ */
+static char *new_arena_block(long size);
+
+unsigned long intern_hash(char *text, int length) {
+    unsigned long hash = 2166136261UL;
+    int i;
+    for (i = 0; i < length; i++) {
+        hash = ((hash ^ (unsigned char) text[i]) * 16777619UL) & 0xffffffffUL;
+    }
+    return hash;
+}
+
+intern_id intern_text(char *text, int length) {
+    unsigned long hash = intern_hash(text, length), slot;
+    intern_id id;
+
+    if ((id = find_interned(text, length)) != NO_INTERN_ID) return id;
+
+    pthread_rwlock_wrlock(&pool_lock);
+    /* Keep the load under a half */
+    if (2 * (unsigned long) (string_count + 1) > slot_count) grow_slots();
+    slot = find_slot(text, length, hash);
+    /* Another thread may have added it since the lookup */
+    if ((id = slots[slot]) == NO_INTERN_ID) {
+        interned *string;
+        if (string_count == (long) MAX_INTERN_PAGES * INTERN_PAGE_SIZE) {
+            printf("[ERROR] Too many distinct names, exiting the program.");
+            exit(1);
+        }
+        if (string_count % INTERN_PAGE_SIZE == 0) {
+            pages[string_count / INTERN_PAGE_SIZE] = (interned *) better_malloc(INTERN_PAGE_SIZE * sizeof(interned));
+        }
+        id = string_count;
+        string = &pages[id / INTERN_PAGE_SIZE][id % INTERN_PAGE_SIZE];
+        string->text = arena_copy(text, length);
+        string->length = length;
+        string->hash = hash;
+        string_count++;
+        slots[slot] = id;
+    }
+    pthread_rwlock_unlock(&pool_lock);
+    return id;
+}
+
+intern_id intern_string(char *text) {
+    return intern_text(text, (int) strlen(text));
+}
+
+intern_id find_interned(char *text, int length) {
+    intern_id id = NO_INTERN_ID;
+    pthread_rwlock_rdlock(&pool_lock);
+    if (slot_count > 0) id = slots[find_slot(text, length, intern_hash(text, length))];
+    pthread_rwlock_unlock(&pool_lock);
+    return id;
+}
+
+long interned_count(void) {
+    long count;
+    pthread_rwlock_rdlock(&pool_lock);
+    count = string_count;
+    pthread_rwlock_unlock(&pool_lock);
+    return count;
+}
+
+void reset_intern_pool(void) {
+    long i;
+    pthread_rwlock_wrlock(&pool_lock);
+    for (i = 0; i * INTERN_PAGE_SIZE < string_count; i++) {
+        free(pages[i]);
+    }
+    for (i = 0; i < arena_block_count; i++) {
+        free(arena_blocks[i]);
+    }
+    free(arena_blocks);
+    free(slots);
+    string_count = 0;
+    slots = NULL;
+    slot_count = 0;
+    arena = NULL;
+    arena_left = 0;
+    arena_blocks = NULL;
+    arena_block_count = arena_block_capacity = 0;
+    pthread_rwlock_unlock(&pool_lock);
+}
+
+char *interned_string(intern_id id) {
+    return pages[id / INTERN_PAGE_SIZE][id % INTERN_PAGE_SIZE].text;
+}
+
+unsigned long interned_hash(intern_id id) {
+    return pages[id / INTERN_PAGE_SIZE][id % INTERN_PAGE_SIZE].hash;
+}
+
+static unsigned long find_slot(char *text, int length, unsigned long hash) {
+    unsigned long slot = hash & (slot_count - 1);
+    /* Linear probing, the table is never full */
+    for (; slots[slot] != NO_INTERN_ID; slot = (slot + 1) & (slot_count - 1)) {
+        interned *string = &pages[slots[slot] / INTERN_PAGE_SIZE][slots[slot] % INTERN_PAGE_SIZE];
+        if (string->hash == hash && string->length == length && memcmp(string->text, text, length) == 0) break;
+    }
+    return slot;
+}
+
+static void grow_slots(void) {
+    unsigned long i;
+    intern_id id;
+    free(slots);
+    slot_count = slot_count ? slot_count * 2 : 256;
+    slots = (intern_id *) better_malloc(slot_count * sizeof(intern_id));
+    for (i = 0; i < slot_count; i++) {
+        slots[i] = NO_INTERN_ID;
+    }
+    for (id = 0; id < string_count; id++) {
+        interned *string = &pages[id / INTERN_PAGE_SIZE][id % INTERN_PAGE_SIZE];
+        slots[find_slot(string->text, string->length, string->hash)] = id;
+    }
+}
+
+static char *arena_copy(char *text, int length) {
+    char *copy;
+    if (length + 1 > arena_left) {
+        /* Long strings get their own block, so the current one isn't wasted */
+        if (length + 1 > INTERN_ARENA_BLOCK_SIZE / 4) {
+            copy = new_arena_block(length + 1);
+            memcpy(copy, text, length);
+            copy[length] = '\0';
+            return copy;
+        }
+        arena = new_arena_block(INTERN_ARENA_BLOCK_SIZE);
+        arena_left = INTERN_ARENA_BLOCK_SIZE;
+    }
+    copy = arena;
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    arena += length + 1;
+    arena_left -= length + 1;
+    return copy;
+}
+
+static char *new_arena_block(long size) {
+    if (arena_block_count == arena_block_capacity) {
+        char **grown;
+        arena_block_capacity = arena_block_capacity ? arena_block_capacity * 2 : 64;
+        grown = (char **) better_malloc(arena_block_capacity * sizeof(char *));
+        if (arena_block_count) memcpy(grown, arena_blocks, arena_block_count * sizeof(char *));
+        free(arena_blocks);
+        arena_blocks = grown;
+    }
+    return arena_blocks[arena_block_count++] = (char *) better_malloc(size);
+}
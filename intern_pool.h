@@ -0,0 +1,66 @@
+/* Interning pool - a single stored copy, stable id and precomputed hash for every distinct identifier */
+#ifndef _INTERN_POOL_H
+#define _INTERN_POOL_H
+#include "globals.h"
+
+/** Small integer id of an interned string, ids are given in order starting from 0 */
+typedef long intern_id;
+
+/** Id of a string that wasn't interned */
+#define NO_INTERN_ID (-1L)
+
+/**
+ * Interns a string, adding it to the pool if it's not there yet. Thread safe.
+ * @param text The string, doesn't have to be null terminated
+ * @param length The length of the string
+ * @return The string's id, the same for every call with the same text
+ */
+intern_id intern_text(char *text, int length);
+
+/**
+ * Interns a null terminated string
+ * @param text The string
+ * @return The string's id
+ */
+intern_id intern_string(char *text);
+
+/**
+ * Finds the id of a string without adding it. Thread safe.
+ * @param text The string, doesn't have to be null terminated
+ * @param length The length of the string
+ * @return The string's id, NO_INTERN_ID if it was never interned
+ */
+intern_id find_interned(char *text, int length);
+
+/**
+ * @param id An id given by the pool
+ * @return The pool's copy of the string, null terminated and valid until the pool is reset
+ */
+char *interned_string(intern_id id);
+
+/**
+ * @param id An id given by the pool
+ * @return The FNV-1a hash of the string
+ */
+unsigned long interned_hash(intern_id id);
+
+/**
+ * Calculates the hash that the pool uses for a string
+ * @param text The string, doesn't have to be null terminated
+ * @param length The length of the string
+ * @return The 32 bit FNV-1a hash of the string
+ */
+unsigned long intern_hash(char *text, int length);
+
+/**
+ * @return The amount of strings in the pool
+ */
+long interned_count(void);
+
+/**
+ * Removes every string from the pool, ids and copies given before aren't valid anymore.
+ * Nothing may use the pool meanwhile, and nothing may keep an id or a copy from before.
+ */
+void reset_intern_pool(void);
+
+#endif
@@ -0,0 +1,236 @@
+/* Address to source line map (.map) - where every code address came from, for profilers and simulators */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "line_map.h"
+#include "helper.h"
+
+/** Growing output of the map */
+typedef struct map_buffer {
+    unsigned char *bytes;
+    long length;
+    long capacity;
+} map_buffer;
+
+/** Indexes of the distinct files or macros of the map, by their interned id */
+typedef struct name_index {
+    /** Open addressing hash table of ids, NO_INTERN_ID for an empty slot */
+    intern_id *ids;
+    long *indexes;
+    /** Number of slots, a power of 2 */
+    unsigned long capacity;
+    /** The ids by index */
+    intern_id *names;
+    long count;
+} name_index;
+
+/**
+ * Appends bytes to the buffer
+ * @param buffer The buffer
+ * @param bytes The bytes
+ * @param length Amount of bytes
+ */
+static void put_bytes(map_buffer *buffer, void *bytes, long length);
+
+/**
+ * Appends an unsigned LEB128 number
+ * @param buffer The buffer
+ * @param value The number
+ */
+static void put_uleb(map_buffer *buffer, unsigned long value);
+
+/**
+ * Appends a signed LEB128 number
+ * @param buffer The buffer
+ * @param value The number
+ */
+static void put_sleb(map_buffer *buffer, long value);
+
+/**
+ * Initializes an empty index that can hold up to max_count names
+ * @param index The index
+ * @param max_count The maximum amount of names
+ */
+static void init_name_index(name_index *index, long max_count);
+
+/**
+ * Gets the index of a name, giving it the next index if it's new
+ * @param index The index
+ * @param id The interned name
+ * @return The name's index
+ */
+static long get_name_index(name_index *index, intern_id id);
+
+/**
+ * Appends the count and the null terminated names of an index
+ * @param buffer The buffer
+ * @param index The index
+ */
+static void put_names(map_buffer *buffer, name_index *index);
+
+/**
+ * Deallocates the index
+ * @param index The index
+ */
+static void free_name_index(name_index *index);
+
+void init_line_origin_log(line_origin_log *log) {
+    log->origins = NULL;
+    log->count = log->capacity = 0;
+    log->is_continuing = FALSE;
+}
+
+void add_line_origin(line_origin_log *log, line_origin origin, char *text) {
+    if (log->count == log->capacity) {
+        line_origin *grown;
+        log->capacity = log->capacity ? log->capacity * 2 : 256;
+        grown = (line_origin *) better_malloc(log->capacity * sizeof(line_origin));
+        if (log->count) memcpy(grown, log->origins, log->count * sizeof(line_origin));
+        free(log->origins);
+        log->origins = grown;
+    }
+    /* The first pass reads the expanded text line by line, the rest of a too long line is skipped */
+    origin.starts_line = !log->is_continuing;
+    log->is_continuing = strchr(text, '\n') == NULL;
+    log->origins[log->count++] = origin;
+}
+
+void free_line_origin_log(line_origin_log *log) {
+    free(log->origins);
+    init_line_origin_log(log);
+}
+
+bool write_line_map(char *filename, long *line_ics, long line_count, long icf, line_origin_log *log) {
+    FILE *file_desc;
+    char *full_filename;
+    map_buffer entries, map;
+    name_index files, macros;
+    long i, line = 0, entry_count = 0, previous_address = 0, previous_line = 0;
+    bool succeeded;
+
+    entries.bytes = map.bytes = NULL;
+    entries.length = entries.capacity = map.length = map.capacity = 0;
+    init_name_index(&files, log->count);
+    init_name_index(&macros, log->count);
+
+    for (i = 0; i < log->count && line < line_count; i++) {
+        line_origin *origin = &log->origins[i];
+        long end_ic;
+        if (!origin->starts_line) continue;
+        end_ic = line + 1 < line_count ? line_ics[line + 1] : icf;
+        /* Only lines with code words have addresses */
+        if (end_ic > line_ics[line]) {
+            put_uleb(&entries, line_ics[line] - previous_address);
+            put_uleb(&entries, get_name_index(&files, origin->file));
+            put_sleb(&entries, origin->line - previous_line);
+            put_uleb(&entries, origin->macro == NO_INTERN_ID ? 0 : get_name_index(&macros, origin->macro) + 1);
+            put_uleb(&entries, origin->macro_line);
+            previous_address = line_ics[line];
+            previous_line = origin->line;
+            entry_count++;
+        }
+        line++;
+    }
+
+    put_bytes(&map, LINE_MAP_MAGIC, 4);
+    put_names(&map, &files);
+    put_names(&map, &macros);
+    put_uleb(&map, entry_count);
+    put_bytes(&map, entries.bytes, entries.length);
+    free(entries.bytes);
+    free_name_index(&files);
+    free_name_index(&macros);
+
+    /* concatenate filename & extension, and open the file for writing: */
+    full_filename = strcat_to_new(filename, LINE_MAP_SUFFIX);
+    file_desc = fopen(full_filename, "wb");
+    /* if failed, print error and exit */
+    if (file_desc == NULL) {
+        printf("Can't create or rewrite to file %s.", full_filename);
+        free(full_filename);
+        free(map.bytes);
+        return FALSE;
+    }
+    free(full_filename);
+    succeeded = fwrite(map.bytes, 1, map.length, file_desc) == (size_t) map.length;
+    fclose(file_desc);
+    free(map.bytes);
+    return succeeded;
+}
+
+static void put_bytes(map_buffer *buffer, void *bytes, long length) {
+    if (buffer->length + length > buffer->capacity) {
+        unsigned char *grown;
+        while (buffer->length + length > buffer->capacity) {
+            buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 4096;
+        }
+        grown = (unsigned char *) better_malloc(buffer->capacity);
+        if (buffer->length) memcpy(grown, buffer->bytes, buffer->length);
+        free(buffer->bytes);
+        buffer->bytes = grown;
+    }
+    if (length) memcpy(buffer->bytes + buffer->length, bytes, length);
+    buffer->length += length;
+}
+
+static void put_uleb(map_buffer *buffer, unsigned long value) {
+    unsigned char byte;
+    do {
+        byte = (unsigned char) (value & 0x7f);
+        value >>= 7;
+        if (value != 0) byte |= 0x80;
+        put_bytes(buffer, &byte, 1);
+    } while (value != 0);
+}
+
+static void put_sleb(map_buffer *buffer, long value) {
+    unsigned char byte;
+    bool is_last;
+    do {
+        byte = (unsigned char) (value & 0x7f);
+        /* Arithmetic shift keeps the sign */
+        value = value < 0 ? ~(~value >> 7) : value >> 7;
+        is_last = (value == 0 && !(byte & 0x40)) || (value == -1 && (byte & 0x40));
+        if (!is_last) byte |= 0x80;
+        put_bytes(buffer, &byte, 1);
+    } while (!is_last);
+}
+
+static void init_name_index(name_index *index, long max_count) {
+    unsigned long i;
+    /* Keep the load under a half */
+    for (index->capacity = 16; index->capacity < 2 * (unsigned long) max_count; index->capacity *= 2);
+    index->ids = (intern_id *) better_malloc(index->capacity * sizeof(intern_id));
+    index->indexes = (long *) better_malloc(index->capacity * sizeof(long));
+    for (i = 0; i < index->capacity; i++) {
+        index->ids[i] = NO_INTERN_ID;
+    }
+    index->names = (intern_id *) better_malloc((max_count + 1) * sizeof(intern_id));
+    index->count = 0;
+}
+
+static long get_name_index(name_index *index, intern_id id) {
+    unsigned long slot = interned_hash(id) & (index->capacity - 1);
+    for (; index->ids[slot] != NO_INTERN_ID && index->ids[slot] != id; slot = (slot + 1) & (index->capacity - 1));
+    if (index->ids[slot] == NO_INTERN_ID) {
+        index->ids[slot] = id;
+        index->indexes[slot] = index->count;
+        index->names[index->count++] = id;
+    }
+    return index->indexes[slot];
+}
+
+static void put_names(map_buffer *buffer, name_index *index) {
+    long i;
+    put_uleb(buffer, index->count);
+    for (i = 0; i < index->count; i++) {
+        char *name = interned_string(index->names[i]);
+        put_bytes(buffer, name, strlen(name) + 1);
+    }
+}
+
+static void free_name_index(name_index *index) {
+    free(index->ids);
+    free(index->indexes);
+    free(index->names);
+}
@@ -0,0 +1,76 @@
+/* Address to source line map (.map) - where every code address came from, for profilers and simulators */
+#ifndef _LINE_MAP_H
+#define _LINE_MAP_H
+#include "globals.h"
+#include "intern_pool.h"
+
+/*
+ * Layout, numbers are ULEB128 and signed numbers SLEB128:
+ *   magic "MAP1"
+ *   file count, then the source file paths, each null terminated
+ *   macro count, then the macro names, each null terminated
+ *   entry count, then the entries, each starting where the previous one ends:
+ *     address delta, file index, line delta, macro index + 1 (0 if not from a macro), macro body line
+ * The first entry's deltas are from address 0 and line 0. An entry covers the addresses up to the next one's,
+ * the last entry covers the addresses up to ICF.
+ */
+
+#define LINE_MAP_SUFFIX ".map"
+
+#define LINE_MAP_MAGIC "MAP1"
+
+/** Where an expanded line came from */
+typedef struct line_origin {
+    /** Interned path of the source file */
+    intern_id file;
+    /** Line in the source file, the line that uses the macro for macro lines */
+    long line;
+    /** Interned name of the macro the line came from, NO_INTERN_ID if not from a macro */
+    intern_id macro;
+    /** Line in the macro body, from 1, 0 if not from a macro */
+    long macro_line;
+    /** False if the text continues a line that was longer than the line buffer */
+    bool starts_line;
+} line_origin;
+
+/** Origins of the expanded text, in order */
+typedef struct line_origin_log {
+    line_origin *origins;
+    long count;
+    long capacity;
+    /** Whether the last added text didn't end its line */
+    bool is_continuing;
+} line_origin_log;
+
+/**
+ * Initializes an empty log
+ * @param log The log
+ */
+void init_line_origin_log(line_origin_log *log);
+
+/**
+ * Adds the origin of the next expanded text
+ * @param log The log
+ * @param origin The origin, its starts_line is set by the log
+ * @param text The expanded text, as passed to the expanded line handler
+ */
+void add_line_origin(line_origin_log *log, line_origin origin, char *text);
+
+/**
+ * Deallocates the log
+ * @param log The log
+ */
+void free_line_origin_log(line_origin_log *log);
+
+/**
+ * Writes filename.map of the code addresses of the expanded lines
+ * @param filename The filename without extension
+ * @param line_ics The instruction counter at the start of every expanded line
+ * @param line_count The amount of expanded lines
+ * @param icf The final instruction counter
+ * @param log The origins of the expanded text
+ * @return Whether succeeded
+ */
+bool write_line_map(char *filename, long *line_ics, long line_count, long icf, line_origin_log *log);
+
+#endif
@@ -1,4 +1,4 @@
-// Linked list operations in C
+/* Linked list operations in C */
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -6,6 +6,7 @@
 #include "string.h"
 #include "globals.h"
 #include "helper.h"
+#include "intern_pool.h"
 
 /***
  * Inserts node at the start of the list
@@ -13,15 +14,16 @@
  * @param new_data string
  */
 void insert_at_the_head(struct list_node** head_ref, char* new_data) {
-    // Allocate memory to a node
+    /* Allocate memory to a node */
     list_node *new_node = (list_node*)better_malloc(sizeof(list_node));
 
-    // insert the data
-    new_node->data = strdup(new_data);
+    /* insert the data */
+    new_node->data_id = intern_string(new_data);
+    new_node->data = interned_string(new_node->data_id);
     new_node->next = (*head_ref);
     new_node->macro_lines = NULL;
 
-    // Move head to new node
+    /* Move head to new node */
     (*head_ref) = new_node;
 }
 
@@ -33,22 +35,31 @@ void insert_at_the_head(struct list_node** head_ref, char* new_data) {
  * @returns the_new_node_created
  */
 list_node * insert_node_list_at_the_end(list_node** head_ref, char* new_data) {
+    list_node *last = *head_ref;
+
+    if (last != NULL) {
+        while (last->next != NULL) last = last->next;
+    }
+    return insert_node_list_after(head_ref, last, new_data);
+}
+
+/***
+ * Inserts node after the last node of the list, without walking it
+ * @param head_ref pointer to list head
+ * @param last the last node, NULL if the list is empty
+ * @param new_data string
+ * @return the new node, the last one now
+ */
+list_node *insert_node_list_after(list_node **head_ref, list_node *last, char *new_data) {
     list_node *new_node = (list_node*)better_malloc(sizeof(list_node));
-    list_node *last; /* used in step 5*/
 
-    new_node->data = strdup(new_data);
+    new_node->data_id = intern_string(new_data);
+    new_node->data = interned_string(new_node->data_id);
     new_node->next = NULL;
     new_node->macro_lines = NULL;
 
-    if (*head_ref == NULL) {
-        *head_ref = new_node;
-        return new_node;
-    }
-    last = *head_ref;
-
-    while (last->next != NULL) last = last->next;
-
-    last->next = new_node;
+    if (last == NULL) *head_ref = new_node;
+    else last->next = new_node;
     return new_node;
 }
 
@@ -58,21 +69,30 @@ list_node * insert_node_list_at_the_end(list_node** head_ref, char* new_data) {
  * @param new_data string to add
  */
 void insert_string_node_at_the_end(simple_node ** head_ref, char* new_data) {
-    simple_node *new_node = (simple_node*)better_malloc(sizeof(simple_node));
-    simple_node *last; /* used in step 5*/
+    simple_node *last = *head_ref;
 
-    new_node->data = strdup(new_data);
-    new_node->next = NULL;
-
-    if (*head_ref == NULL) {
-        *head_ref = new_node;
-        return;
+    if (last != NULL) {
+        while (last->next != NULL) last = last->next;
     }
-    last = *head_ref;
+    insert_string_node_after(head_ref, last, new_data);
+}
 
-    while (last->next != NULL) last = last->next;
+/***
+ * Insert new node after the last node of linked list string, without walking it, or creates the list
+ * @param head_ref head if exists null if not
+ * @param last the last node, NULL if the list is empty
+ * @param new_data string to add
+ * @return the new node, the last one now
+ */
+simple_node *insert_string_node_after(simple_node **head_ref, simple_node *last, char *new_data) {
+    simple_node *new_node = (simple_node*)better_malloc(sizeof(simple_node));
 
-    last->next = new_node;
+    new_node->data = strcat_to_new(new_data, "");
+    new_node->next = NULL;
+
+    if (last == NULL) *head_ref = new_node;
+    else last->next = new_node;
+    return new_node;
 }
 
 /**
@@ -82,7 +102,8 @@ void insert_string_node_at_the_end(simple_node ** head_ref, char* new_data) {
  */
 list_node *create_list_node(char* new_data){
     list_node *new_node = (list_node*)malloc(sizeof(list_node));
-    new_node->data = strdup(new_data);
+    new_node->data_id = intern_string(new_data);
+    new_node->data = interned_string(new_node->data_id);
     new_node->next = NULL;
     return new_node;
 }
@@ -94,9 +115,12 @@ list_node *create_list_node(char* new_data){
  */
 list_node *find_node_in_list(list_node* node, char* field_to_find){
     list_node* current_node = node;
+    /* A name that was never interned isn't a macro */
+    intern_id field_id = find_interned(field_to_find, (int) strlen(field_to_find));
+    if (field_id == NO_INTERN_ID) return NULL;
 
     while (current_node != NULL){
-        if(strcmp(current_node->data,field_to_find) == 0){
+        if(current_node->data_id == field_id){
             return current_node;
         }
         current_node = current_node->next;
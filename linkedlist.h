@@ -17,6 +17,15 @@ void insert_at_the_head(struct list_node** head_ref, char* new_data);
  */
 list_node * insert_node_list_at_the_end(struct list_node** head_ref, char* new_data);
 
+/***
+ * Inserts node after the last node of the list, without walking it
+ * @param head_ref pointer to list head
+ * @param last the last node, NULL if the list is empty
+ * @param new_data string
+ * @return the new node, the last one now
+ */
+list_node *insert_node_list_after(list_node **head_ref, list_node *last, char *new_data);
+
 /***
  * Insert new node at the end of linked list string or creates the list
  * @param head_ref head if exists null if not
@@ -24,6 +33,15 @@ list_node * insert_node_list_at_the_end(struct list_node** head_ref, char* new_d
  */
 void insert_string_node_at_the_end(simple_node ** head_ref, char* new_data);
 
+/***
+ * Insert new node after the last node of linked list string, without walking it, or creates the list
+ * @param head_ref head if exists null if not
+ * @param last the last node, NULL if the list is empty
+ * @param new_data string to add
+ * @return the new node, the last one now
+ */
+simple_node *insert_string_node_after(simple_node **head_ref, simple_node *last, char *new_data);
+
 /**
  * creates linked list node
  * @param new_data string
@@ -45,4 +63,4 @@ list_node *find_node_in_list(list_node* node, char* field_to_find);
  */
 void free_string_node(simple_node** node);
 
-#endif //ASSEMBLER_LINKEDLIST_H
+#endif /* ASSEMBLER_LINKEDLIST_H */
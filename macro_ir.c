@@ -0,0 +1,146 @@
+/* Macro bodies parsed once when the macro is defined, and spliced into the images at every use */
+#include <stdlib.h>
+#include <string.h>
+#include "macro_ir.h"
+#include "helper.h"
+#include "symbol_table.h"
+#include "first_pass.h"
+
+/** Words a single line can add to a scratch image, a line is at most MAX_LINE_LENGTH chars */
+#define MACRO_LINE_MAX_WORDS (MAX_LINE_LENGTH + 2)
+
+/**
+ * Finds the slot of a line, or the empty slot where it belongs
+ * @param table The table
+ * @param text_id The interned text of the line
+ * @return Index of the slot
+ */
+static unsigned long find_macro_line_slot(macro_ir_table *table, intern_id text_id);
+
+/**
+ * Allocates a copy of a code word
+ * @param word The word
+ * @return The copy
+ */
+static machine_word *clone_machine_word(machine_word *word);
+
+void init_macro_ir_table(macro_ir_table *table) {
+    table->slots = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}
+
+void define_macro_line(macro_ir_table *macros, char *content) {
+    machine_word *code_img[MACRO_LINE_MAX_WORDS];
+    long data_img[MACRO_LINE_MAX_WORDS];
+    long ic = IC_INIT_VALUE, dc = 0, i;
+    table scratch_symbols = NULL;
+    diagnostic_log ignored;
+    line_descriptor line;
+    macro_line_ir *ir;
+    intern_id text_id = intern_string(content);
+    bool succeeded;
+
+    /* The same line in several macros is parsed once */
+    if (macros->capacity > 0 && macros->slots[find_macro_line_slot(macros, text_id)] != NULL) return;
+
+    memset(code_img, 0, sizeof(code_img));
+    init_diagnostic_log(&ignored);
+    line.line_number = 0;
+    line.full_file_name = "";
+    line.content = content;
+    line.diagnostics = &ignored;
+    succeeded = process_line_first_pass(line, &ic, &dc, code_img, data_img, &scratch_symbols);
+
+    if (!succeeded || ignored.count > 0 || scratch_symbols != NULL) {
+        /* Errors are reported where the macro is used, and symbols depend on the place */
+        free_diagnostic_log(&ignored);
+        free_table(scratch_symbols);
+        free_code_image(code_img, ic - IC_INIT_VALUE);
+        return;
+    }
+    free_diagnostic_log(&ignored);
+
+    ir = (macro_line_ir *) better_malloc(sizeof(macro_line_ir));
+    ir->text_id = text_id;
+    ir->code_length = ic - IC_INIT_VALUE;
+    ir->code_words = (machine_word **) better_malloc((ir->code_length + 1) * sizeof(machine_word *));
+    for (i = 0; i < ir->code_length; i++) {
+        ir->code_words[i] = code_img[i];
+    }
+    ir->data_length = dc;
+    ir->data_words = (long *) better_malloc((dc + 1) * sizeof(long));
+    memcpy(ir->data_words, data_img, dc * sizeof(long));
+
+    /* Keep the load under a half */
+    if (2 * (unsigned long) (macros->count + 1) > macros->capacity) {
+        macro_line_ir **old_slots = macros->slots;
+        unsigned long old_capacity = macros->capacity, j;
+        macros->capacity = macros->capacity ? macros->capacity * 2 : 64;
+        macros->slots = (macro_line_ir **) better_malloc(macros->capacity * sizeof(macro_line_ir *));
+        memset(macros->slots, 0, macros->capacity * sizeof(macro_line_ir *));
+        for (j = 0; j < old_capacity; j++) {
+            if (old_slots[j] != NULL) macros->slots[find_macro_line_slot(macros, old_slots[j]->text_id)] = old_slots[j];
+        }
+        free(old_slots);
+    }
+    macros->slots[find_macro_line_slot(macros, text_id)] = ir;
+    macros->count++;
+}
+
+macro_line_ir *find_macro_line(macro_ir_table *table, char *content) {
+    intern_id text_id;
+    if (table == NULL || table->count == 0) return NULL;
+    /* A line that was never interned isn't a macro line */
+    if ((text_id = find_interned(content, (int) strlen(content))) == NO_INTERN_ID) return NULL;
+    return table->slots[find_macro_line_slot(table, text_id)];
+}
+
+void splice_macro_line(macro_line_ir *ir, long *ic, long *dc, machine_word **code_img, long *data_img) {
+    long i;
+    for (i = 0; code_img != NULL && i < ir->code_length; i++) {
+        code_img[*ic - IC_INIT_VALUE + i] = ir->code_words[i] != NULL ? clone_machine_word(ir->code_words[i]) : NULL;
+    }
+    *ic += ir->code_length;
+    memcpy(data_img + *dc, ir->data_words, ir->data_length * sizeof(long));
+    *dc += ir->data_length;
+}
+
+void free_macro_ir_table(macro_ir_table *table) {
+    unsigned long i;
+    for (i = 0; i < table->capacity; i++) {
+        macro_line_ir *ir = table->slots[i];
+        if (ir == NULL) continue;
+        free_code_image(ir->code_words, ir->code_length);
+        free(ir->code_words);
+        free(ir->data_words);
+        free(ir);
+    }
+    free(table->slots);
+    init_macro_ir_table(table);
+}
+
+static unsigned long find_macro_line_slot(macro_ir_table *table, intern_id text_id) {
+    unsigned long slot = interned_hash(text_id) & (table->capacity - 1);
+    /* Linear probing, the table is never full */
+    for (; table->slots[slot] != NULL && table->slots[slot]->text_id != text_id;
+           slot = (slot + 1) & (table->capacity - 1));
+    return slot;
+}
+
+static machine_word *clone_machine_word(machine_word *word) {
+    machine_word *copy = (machine_word *) better_malloc(sizeof(machine_word));
+    *copy = *word;
+    /* Same cases as free_code_image */
+    if (word->length > 0) {
+        copy->word.opcode = (opcode_word *) better_malloc(sizeof(opcode_word));
+        *copy->word.opcode = *word->word.opcode;
+    } else if (word->is_operand == TRUE) {
+        copy->word.operand = (operand_word *) better_malloc(sizeof(operand_word));
+        *copy->word.operand = *word->word.operand;
+    } else {
+        copy->word.data2 = (operand_data_word *) better_malloc(sizeof(operand_data_word));
+        *copy->word.data2 = *word->word.data2;
+    }
+    return copy;
+}
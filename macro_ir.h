@@ -0,0 +1,67 @@
+/* Macro bodies parsed once when the macro is defined, and spliced into the images at every use */
+#ifndef _MACRO_IR_H
+#define _MACRO_IR_H
+#include "globals.h"
+#include "intern_pool.h"
+
+/** A macro body line, as the first pass encodes it at address 0 */
+typedef struct macro_line_ir {
+    /** Interned text of the line */
+    intern_id text_id;
+    /** The code words of the line, NULL for words of labels that the second pass resolves */
+    machine_word **code_words;
+    long code_length;
+    /** The data words of a .data/.string line */
+    long *data_words;
+    long data_length;
+} macro_line_ir;
+
+/** The parsed lines of the macros of a single file, by their text */
+typedef struct macro_ir_table {
+    /** Open addressing hash table, NULL for an empty slot */
+    macro_line_ir **slots;
+    /** Number of slots, a power of 2 */
+    unsigned long capacity;
+    long count;
+} macro_ir_table;
+
+/**
+ * Initializes an empty table
+ * @param table The table
+ */
+void init_macro_ir_table(macro_ir_table *table);
+
+/**
+ * Parses and validates a macro body line with the first pass rules, and keeps it if it can be spliced as is:
+ * it has no errors, and doesn't define symbols (labels, .extern) that depend on the place it's used.
+ * Nothing is printed, a line that can't be kept is processed by the first pass at every use.
+ * @param macros The table
+ * @param content The body line, as read by fgets
+ */
+void define_macro_line(macro_ir_table *macros, char *content);
+
+/**
+ * Finds the parsed form of a line. Doesn't change the table, so several threads can look up concurrently.
+ * @param table The table, may be NULL
+ * @param content The line
+ * @return The parsed line, NULL if the line isn't a kept macro body line
+ */
+macro_line_ir *find_macro_line(macro_ir_table *table, char *content);
+
+/**
+ * Adds a copy of the line's words to the images, exactly like the first pass would for the line at this place
+ * @param ir The parsed line
+ * @param ic Pointer to the instruction counter, advanced by the code length
+ * @param dc Pointer to the data counter, advanced by the data length
+ * @param code_img The code image array, NULL to only count the code words (when checking)
+ * @param data_img The data image array
+ */
+void splice_macro_line(macro_line_ir *ir, long *ic, long *dc, machine_word **code_img, long *data_img);
+
+/**
+ * Deallocates the parsed lines of the table
+ * @param table The table
+ */
+void free_macro_ir_table(macro_ir_table *table);
+
+#endif
@@ -1,6 +1,5 @@
 #include <stdio.h>
 #include <string.h>
-#include <ctype.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include "opcode_builder.h"
@@ -21,11 +20,17 @@
 static bool validate_operand_addressing(line_descriptor line, addressing_type op1_addressing, addressing_type op2_addressing,
                                         int op1_valid_addr_count, int op2_valid_addr_count, ...);
 
+/**
+ * Sets an operand view, splitting the label and register of label[rN]
+ * @param operand The view to set
+ * @param text Start of the operand in the line
+ * @param length The length of the operand
+ */
+static void split_operand(operand_view *operand, char *text, int length);
+
 
-bool analyze_operands(line_descriptor line, int i, char **operands_out, int *operand_count) {
-	int j;
+bool analyze_operands(line_descriptor line, int i, operand_view *operands_out, int *operand_count) {
 	*operand_count = 0;
-    operands_out[0] = operands_out[1] = NULL;
 	SKIP_TO_NEXT_NON_WHITESPACE(line.content, i)
 	if (line.content[i] == ',') {
         fprintf_error_specific(line, "[ERROR] Unexpected comma after command.");
@@ -34,22 +39,17 @@ bool analyze_operands(line_descriptor line, int i, char **operands_out, int *ope
 
 	/* Until not too many operands (max of 2) and it's not the end of the line */
 	for (*operand_count = 0; line.content[i] != EOF && line.content[i] != '\n' && line.content[i];) {
+        int start = i;
         /* Sanity check for 2 < operands */
         if (*operand_count == 2) {
             fprintf_error_specific(line, "[ERROR] Operands number is bigger than 2");
-			free(operands_out[0]);
-			free(operands_out[1]);
 			return FALSE; /* an error occurred */
 		}
 
-		/* Allocate memory to save the operand */
-		operands_out[*operand_count] = better_malloc(MAX_LINE_LENGTH);
 		/* as long as we're still on same operand */
-		for (j = 0; line.content[i] && line.content[i] != '\t' && line.content[i] != ' ' && line.content[i] != '\n' && line.content[i] != EOF &&
-		            line.content[i] != ','; i++, j++) {
-            operands_out[*operand_count][j] = line.content[i];
-		}
-        operands_out[*operand_count][j] = '\0';
+		for (; line.content[i] && line.content[i] != '\t' && line.content[i] != ' ' && line.content[i] != '\n' && line.content[i] != EOF &&
+		            line.content[i] != ','; i++);
+        split_operand(&operands_out[*operand_count], line.content + start, i - start);
 		(*operand_count)++; /* We've just saved another operand! */
 		SKIP_TO_NEXT_NON_WHITESPACE(line.content, i)
 
@@ -57,11 +57,6 @@ bool analyze_operands(line_descriptor line, int i, char **operands_out, int *ope
 		else if (line.content[i] != ',') {
 			/* After operand & after white chars there's something that isn't ',' or end of line.. */
             fprintf_error_specific(line, "[ERROR] Only whitespace and comma supposed to separate operands");
-			/* Release operands dynamically allocated memory */
-			free(operands_out[0]);
-			if (*operand_count > 1) {
-				free(operands_out[1]);
-			}
 			return FALSE;
 		}
 		i++;
@@ -71,18 +66,28 @@ bool analyze_operands(line_descriptor line, int i, char **operands_out, int *ope
             fprintf_error_specific(line, "[ERROR] Missing operand after comma.");
 		else if (line.content[i] == ',') fprintf_error_specific(line, "[ERROR] Consecutive commas.");
 		else continue; /* No errors, continue */
-		{ /* Error found! (didn't continue) */
-			/* No one forgot you two! */
-			free(operands_out[0]);
-			if (*operand_count > 1) {
-				free(operands_out[1]);
-			}
-			return FALSE;
-		}
+		return FALSE; /* Error found! (didn't continue) */
 	}
 	return TRUE;
 }
 
+static void split_operand(operand_view *operand, char *text, int length) {
+    char *open_brace = memchr(text, '[', length);
+    char *closing_brace = memchr(text, ']', length);
+    operand->text = text;
+    operand->length = operand->label_length = length;
+    operand->index_register = NULL;
+    operand->index_register_length = 0;
+    /* test for ....[XX]<-- , the label ends at the first brace of the two */
+    if (open_brace != NULL && closing_brace != NULL) {
+        operand->label_length = (int) ((open_brace < closing_brace ? open_brace : closing_brace) - text);
+        operand->index_register = open_brace + 1;
+        /* Without a closing brace after it, the register is the rest of the operand */
+        operand->index_register_length = (int) ((closing_brace > open_brace ? closing_brace : text + length) -
+                                                operand->index_register);
+    }
+}
+
 /**
  * ABSOLUTE single lookup table element
  */
@@ -127,27 +132,35 @@ void get_opcode_func(char *cmd, opcode *opcode_out, funct *funct_out) {
 	}
 }
 
-addressing_type get_addressing_type(char *operand) {
+char *get_command_name(opcode op, funct fun) {
+	struct cmd_lookup_element *e;
+	for (e = lookup_table; e->cmd != NULL; e++) {
+		if (e->op == op && e->fun == fun) return e->cmd;
+	}
+	return NULL;
+}
+
+addressing_type get_addressing_type(operand_view *operand) {
     /* if nothing, just return none */
-	if (operand[0] == '\0'){
+	if (operand->length == 0){
         return NONE_ADDR;
     }
 
 	/* if first char is 'r', second is number in range 0-19 and third is end of string, it's a register */
 
-	if (get_regular_register_by_name(operand) != NONE_REGISTER){
+	if (get_register_view(operand->text, operand->length) != NONE_REGISTER){
         return REGISTER_ADDR;
     }
     /*if operand starts with # and follows with base10 number => Immediate addressing */
-    if (operand[0] == '#' && is_integer(operand + 1)) {
+    if (operand->text[0] == '#' && is_integer_view(operand->text + 1, operand->length - 1)) {
         return IMMEDIATE_ADDR;
     }
     /* if operand is a valid label name, it's directly addressed */
-    if (is_valid_label_name(operand)) {
+    if (is_valid_label_view(operand->text, operand->length)) {
         return DIRECT_ADDR;
     }
 
-    if(get_index_register_by_name(operand) != NONE_REGISTER){
+    if(get_index_register(operand) != NONE_REGISTER){
         return INDEX_ADDR;
     }
 
@@ -213,15 +226,17 @@ bool validate_opcode_operands(line_descriptor line, addressing_type first_addres
 }
 
 
-int encode_opcode_wards(line_descriptor line, opcode line_opcode, funct line_funct, int op_count, char *operands[2],
-                        opcode_word** opcode_encode, operand_word** operand_encode) {
+int encode_opcode_wards(line_descriptor line, opcode line_opcode, funct line_funct, int op_count,
+                        operand_view operands[2], opcode_word** opcode_encode, operand_word** operand_encode) {
 	/* Get addressing types and validate them: */
-	addressing_type first_addressing = op_count >= 1 ? get_addressing_type(operands[0]) : NONE_ADDR;
-	addressing_type second_addressing = op_count == 2 ? get_addressing_type(operands[1]) : NONE_ADDR;
+	addressing_type first_addressing = op_count >= 1 ? get_addressing_type(&operands[0]) : NONE_ADDR;
+	addressing_type second_addressing = op_count == 2 ? get_addressing_type(&operands[1]) : NONE_ADDR;
 	/* validate operands by opcode - on failure exit */
 	if (!validate_opcode_operands(line, first_addressing, second_addressing, line_opcode, op_count)) {
 		return 0;
 	}
+	/* Nothing to build when only checking */
+	if (opcode_encode == NULL) return 2;
 	/* Create the code word by the data: */
 
     (*opcode_encode) = (opcode_word*) better_malloc(sizeof(opcode_word));
@@ -250,17 +265,17 @@ int encode_opcode_wards(line_descriptor line, opcode line_opcode, funct line_fun
         (*operand_encode)->source_addressing = first_addressing;
 
         if(second_addressing == REGISTER_ADDR || second_addressing == INDEX_ADDR ){
-            (*operand_encode)->destination_register = get_register_by_name_and_addressing(operands[1],second_addressing);
+            (*operand_encode)->destination_register = get_register_by_name_and_addressing(&operands[1],second_addressing);
         }
         if(first_addressing == REGISTER_ADDR || first_addressing == INDEX_ADDR ){
-            (*operand_encode)->source_register = get_register_by_name_and_addressing(operands[0],first_addressing);
+            (*operand_encode)->source_register = get_register_by_name_and_addressing(&operands[0],first_addressing);
         }
     }
 
     else if (CLR_OP <= line_opcode && line_opcode <=PRN_OP){
         (*operand_encode)->destination_addressing = first_addressing;
         if(first_addressing == REGISTER_ADDR || first_addressing == INDEX_ADDR ){
-            (*operand_encode)->destination_register = get_register_by_name_and_addressing(operands[0],first_addressing);
+            (*operand_encode)->destination_register = get_register_by_name_and_addressing(&operands[0],first_addressing);
         }
     }
 
@@ -270,7 +285,7 @@ int encode_opcode_wards(line_descriptor line, opcode line_opcode, funct line_fun
 static bool validate_operand_addressing(line_descriptor line, addressing_type op1_addressing, addressing_type op2_addressing, int op1_valid_addr_count,
                                         int op2_valid_addr_count, ...) {
 	int i;
-	bool is_valid;
+	bool is_valid = FALSE;
 	va_list list;
 
 	addressing_type op1_valids[4], op2_valids[4];
@@ -316,55 +331,39 @@ static bool validate_operand_addressing(line_descriptor line, addressing_type op
 
 
 reg get_regular_register_by_name(char *name) {
-    int name_len = strlen(name);
-
-    if (2<= name_len && name_len <=3 && name[0] == REGISTER_PREFIX) {
-        char *reg_num_str = &name[1];
-
-        /* validate we are working only with digits due to atoi limitations */
-        if (isdigit(reg_num_str[0]) &&( name_len == 2 || isdigit(reg_num_str[1]))) {
-            int reg_num_int = atoi(reg_num_str);
-            /* registers are numbered between 0 to MAX_REGISTER  */
-            if (0 <= reg_num_int && reg_num_int <= MAX_REGISTER) {
-                return reg_num_int;
-            }
+    return get_register_view(name, (int) strlen(name));
+}
+
+reg get_register_view(char *name, int length) {
+    /* 'r' followed by one or two digits */
+    if (2 <= length && length <= 3 && name[0] == REGISTER_PREFIX && (CHAR_CLASS(name[1]) & CHAR_DIGIT) &&
+        (length == 2 || (CHAR_CLASS(name[2]) & CHAR_DIGIT))) {
+        int reg_num_int = name[1] - '0';
+        if (length == 3) reg_num_int = reg_num_int * 10 + name[2] - '0';
+        /* registers are numbered between 0 to MAX_REGISTER  */
+        if (reg_num_int <= MAX_REGISTER) {
+            return reg_num_int;
         }
     }
 	return NONE_REGISTER; /* No match */
 }
 
-reg get_index_register_by_name(char *operand) {
-
-    int open_braces_index,closing_braces_index;
-    char* operand_temp =better_malloc(MAX_LINE_LENGTH);
-    strcpy(operand_temp, operand);
-
-    open_braces_index = index_of_char(operand_temp, '[');
-    closing_braces_index = index_of_char(operand_temp, ']');
-
+reg get_index_register(operand_view *operand) {
+    reg reg_num;
     /* test for ....[XX]<-- */
-    if (open_braces_index != -1 && closing_braces_index !=-1){
-        char *register_str = operand_temp+open_braces_index+1;
-        reg reg_num;
-        operand_temp[open_braces_index] = '\0'; /* separating to test only the label*/
-        operand_temp[closing_braces_index] = '\0'; /* closing the second string */
-        reg_num = get_regular_register_by_name(register_str);
-
-
-        if(is_valid_label_name(operand_temp) && 10<=reg_num && reg_num <= 15 ){
-            free(operand_temp);
-            return reg_num;
-        }
+    if (operand->index_register == NULL) return NONE_REGISTER;
+    reg_num = get_register_view(operand->index_register, operand->index_register_length);
+    if (is_valid_label_view(operand->text, operand->label_length) && 10 <= reg_num && reg_num <= 15) {
+        return reg_num;
     }
-    free(operand_temp);
     return NONE_REGISTER; /* No match */
 }
 
-reg get_register_by_name_and_addressing(char *name, addressing_type addr_type){
+reg get_register_by_name_and_addressing(operand_view *operand, addressing_type addr_type){
     if(addr_type == INDEX_ADDR){
-        return get_index_register_by_name(name);
+        return get_index_register(operand);
     }
-    return get_regular_register_by_name(name);
+    return get_register_view(operand->text, operand->length);
 }
 
 
@@ -12,12 +12,20 @@
  */
 void get_opcode_func(char* cmd, opcode *opcode_out, funct *funct_out);
 
+/**
+ * Finds the name of a command by its opcode and funct, the opposite of get_opcode_func
+ * @param op The opcode
+ * @param fun The funct
+ * @return The command name, NULL if there's no such command
+ */
+char *get_command_name(opcode op, funct fun);
+
 /**
  * Returns the addressing type of an operand
- * @param operand The operand's string
+ * @param operand The operand's view
  * @return The addressing type of the operand
  */
-addressing_type get_addressing_type(char *operand);
+addressing_type get_addressing_type(operand_view *operand);
 
 /**
  * Validates and Builds a code word by the opcode, funct, operand count and operand strings
@@ -25,12 +33,12 @@ addressing_type get_addressing_type(char *operand);
  * @param line_funct The current funct
  * @param op_count The operands count
  * @param operands a 2-cell array of pointers to first and second operands.
- * @param opcode_encode struct of the opcode word OUTPUT
+ * @param opcode_encode struct of the opcode word OUTPUT, NULL to only validate (--check)
  * @param operand_encode struct of the operand word OUTPUT
  * @return Number of words to add(L from step 13 first pass) else 0
  */
-int encode_opcode_wards(line_descriptor line, opcode line_opcode, funct line_funct, int op_count, char *operands[2],
-                        opcode_word** opcode_encode, operand_word** operand_encode);
+int encode_opcode_wards(line_descriptor line, opcode line_opcode, funct line_funct, int op_count,
+                        operand_view operands[2], opcode_word** opcode_encode, operand_word** operand_encode);
 
 /**
  * Returns the register enum value by it's name
@@ -40,20 +48,28 @@ int encode_opcode_wards(line_descriptor line, opcode line_opcode, funct line_fun
 reg get_regular_register_by_name(char *name);
 
 /**
- * Returns the index register enum value by it's name
- * @param name register name
+ * Returns the register enum value by it's name, like get_regular_register_by_name
+ * @param name The name of the register, doesn't have to be null terminated
+ * @param length The length of the name
+ * @return The enum value of the register if found. otherwise, returns NONE_REGISTER
+ */
+reg get_register_view(char *name, int length);
+
+/**
+ * Returns the index register of a label[rN] operand
+ * @param operand The operand's view
  * @return The enum value of the register if found. otherwise, returns NONE_REGISTER
  */
-reg get_index_register_by_name(char *name);
+reg get_index_register(operand_view *operand);
 
 
 /**
  * Register by name + index/register handling
- * @param name register name
+ * @param operand The operand's view
  * @param addr_type addressing type
  * @return enum value of register if found else NONE_REGISTER
  */
-reg get_register_by_name_and_addressing(char *name, addressing_type addr_type);
+reg get_register_by_name_and_addressing(operand_view *operand, addressing_type addr_type);
 
 /**
  * Builds a data word by the operand's addressing type, value and whether the symbol (if it is one) is external.
@@ -65,14 +81,14 @@ reg get_register_by_name_and_addressing(char *name, addressing_type addr_type);
 operand_data_word * encode_operand_data(addressing_type addressing, int data, bool external_symbol);
 
 /**
- * Separates the operands from a certain index, puts each operand into the operands_out array,
- * and puts the found operand count in operand count argument
+ * Separates the operands from a certain index, puts a view of each operand into the operands_out array,
+ * and puts the found operand count in operand count argument. Nothing is allocated, the views point into the line.
  * @param line The command text
  * @param i The index to start analyzing from
- * @param operands_out At least a 2-cell buffer of strings for the extracted operand strings
+ * @param operands_out At least a 2-cell buffer for the operand views
  * @param operand_count The operands_out of the detected operands count
  * @return Whether analyzing succeeded
  */
-bool analyze_operands(line_descriptor line, int i, char **operands_out, int *operand_count);
+bool analyze_operands(line_descriptor line, int i, operand_view *operands_out, int *operand_count);
 
 #endif
\ No newline at end of file
@@ -1,6 +1,9 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include "helper.h"
+#include "output_module.h"
 #include "symbol_table.h"
 #include "linkedlist.h"
 
@@ -15,92 +18,386 @@
  */
 static bool write_ob(machine_word **code_img, long *data_img, long icf, long dcf, char *filename);
 
+/** A range of .ob words (code words first, then data words), formatted into its own region of the file text */
+typedef struct ob_range {
+    machine_word **code_img;
+    long *data_img;
+    long code_count;
+    /** Word indexes [from, to) */
+    long from, to;
+    /** Where the range's first line goes */
+    char *text;
+} ob_range;
+
+/** Writing of a single .ext or .ent file on its own thread */
+typedef struct symbol_file_job {
+    char *filename;
+    table symbol_table;
+    external_reference_log *external_references;
+    bool succeeded;
+} symbol_file_job;
+
+/**
+ * Writes the .ob file with its words formatted by several threads into a single buffer.
+ * Every line has a fixed width for its address's digit count, so each range's region is known up front.
+ * @param code_img The code image
+ * @param data_img The data image
+ * @param icf The final instruction counter
+ * @param dcf The final data counter
+ * @param filename The filename, without the extension
+ * @param threads Maximum number of threads
+ * @return Whether succeeded
+ */
+static bool write_ob_concurrently(machine_word **code_img, long *data_img, long icf, long dcf, char *filename,
+                                  int threads);
+
+/**
+ * Thread body - formats a range of .ob words into its region
+ * @param arg The ob_range
+ * @return NULL
+ */
+static void *format_ob_range(void *arg);
+
+/**
+ * Calculates the length of the .ob lines of the given addresses
+ * @param from The first address
+ * @param to The address after the last one
+ * @return Length of the lines text
+ */
+static long ob_text_length(long from, long to);
+
 /**
- * Writes a symbol table to a file. Each symbol and it's address in line, separated by a single space.
- * @param tab The symbol table to write
+ * Thread body - writes the .ext file
+ * @param arg The symbol_file_job
+ * @return NULL
+ */
+static void *run_external_file_job(void *arg);
+
+/**
+ * Thread body - writes the .ent file
+ * @param arg The symbol_file_job
+ * @return NULL
+ */
+static void *run_entries_file_job(void *arg);
+
+/**
+ * Sets the address text to the given value
+ * @param address The address to set
+ * @param value The address value
+ */
+static void init_ob_address(ob_address *address, long value);
+
+/**
+ * Formats a word as an .ob line by table lookups instead of printf, and advances the address
+ * @param buffer Destination of at least MAX_OB_LINE_LENGTH chars, not null terminated
+ * @param address The address of the word, incremented to the next one
+ * @param val The 20 bit word value
+ * @return Length of the formatted line
+ */
+static int format_ob_word(char *buffer, ob_address *address, long val);
+
+/**
+ * Formats consecutive data image words as .ob lines
+ * @param buffer Destination of at least count * MAX_OB_LINE_LENGTH chars
+ * @param address The address of the first word, advanced past the last one
+ * @param data The data words
+ * @param count The amount of words to format
+ * @return Length of the formatted lines
+ */
+static int format_ob_data_words(char *buffer, ob_address *address, long *data, int count);
+
+/**
+ * Writes the formatted lines of the block and empties it, a short write marks the writer as failed
+ * @param writer The writer
+ */
+static void flush_ob_block(ob_writer *writer);
+
+/**
+ * Calculates the 20 bit value of a code image word
+ * @param word The code word
+ * @return The word value
+ */
+static long code_word_value(machine_word *word);
+
+/**
+ * Writes the entry symbols of the table to a file. Each symbol and it's address in line, separated by a single space.
+ * @param tab The symbol table, only ENTRY_SYMBOL entries are written
  * @param filename The filename without the extension
  * @param file_extension The extension of the file, including dot before
  * @return Whether succeeded
  */
 static bool write_entries_file(table tab, char *filename, char *file_extension);
 
-bool write_external_file(table tab, char *filename, char *file_extension);
+/**
+ * Writes the external references to a file, base and offset address lines for each.
+ * @param external_references The external references log
+ * @param filename The filename without the extension
+ * @param file_extension The extension of the file, including dot before
+ * @return Whether succeeded
+ */
+bool write_external_file(external_reference_log *external_references, char *filename, char *file_extension);
 
 int write_output_files(machine_word **code_img, long *data_img, long icf, long dcf, char *filename,
-                       table symbol_table) {
-	bool success_flag;
-	table externals = filter_table_by_type(symbol_table, EXTERNAL_REFERENCE);
-	table entries = filter_table_by_type(symbol_table, ENTRY_SYMBOL);
-	/* Write .ob file */
-    success_flag = write_ob(code_img, data_img, icf, dcf, filename) &&
-	         /* Write *.ent and *.ext files: call with symbols from external references type or entry type only */
-             write_external_file(externals, filename, ".ext") &&
-                   write_entries_file(entries, filename, ".ent");
-	/* Release filtered tables */
-	free_table(externals);
-	free_table(entries);
-	return success_flag;
+                       table symbol_table, external_reference_log *external_references, int threads) {
+    pthread_t external_thread, entries_thread;
+    symbol_file_job external_job, entries_job;
+    bool external_started, entries_started, ob_succeeded;
+    if (threads < 2) {
+        /* Write .ob file */
+        return write_ob(code_img, data_img, icf, dcf, filename) &&
+               write_symbol_files(filename, symbol_table, external_references);
+    }
+
+    /* .ext and .ent on their own threads while this one writes the .ob */
+    external_job.filename = entries_job.filename = filename;
+    external_job.symbol_table = entries_job.symbol_table = symbol_table;
+    external_job.external_references = entries_job.external_references = external_references;
+    external_started = pthread_create(&external_thread, NULL, run_external_file_job, &external_job) == 0;
+    entries_started = pthread_create(&entries_thread, NULL, run_entries_file_job, &entries_job) == 0;
+
+    ob_succeeded = write_ob_concurrently(code_img, data_img, icf, dcf, filename, threads);
+
+    if (external_started) pthread_join(external_thread, NULL);
+    else run_external_file_job(&external_job);
+    if (entries_started) pthread_join(entries_thread, NULL);
+    else run_entries_file_job(&entries_job);
+    return ob_succeeded && external_job.succeeded && entries_job.succeeded;
+}
+
+bool write_symbol_files(char *filename, table symbol_table, external_reference_log *external_references) {
+	/* Write *.ent and *.ext files: external references log and the entry type symbols */
+	return write_external_file(external_references, filename, ".ext") &&
+	       write_entries_file(symbol_table, filename, ".ent");
 }
 
 static bool write_ob(machine_word **code_img, long *data_img, long icf, long dcf, char *filename) {
-	int i;
-    long val;
-    int a,b,c,d,e;
-	FILE *file_desc;
+    ob_writer writer;
 	/* add extension of file to open */
 	char *output_filename = strcat_to_new(filename, ".ob");
 	/* Try to open the file for writing */
-	file_desc = fopen(output_filename, "w");
-	if (file_desc == NULL) {
-		printf("Can't create or rewrite to file %s.", output_filename);
+	if (!open_ob_writer(&writer, output_filename, icf, dcf)) {
         free(output_filename);
 		return FALSE;
 	}
+
+	/* starting from index 0, not IC_INIT_VALUE as icf, so we have to subtract it. */
+    write_ob_code_words(&writer, code_img, 0, icf - IC_INIT_VALUE);
+	/* Write data2 image. */
+    write_ob_data_words(&writer, data_img, dcf);
+
+	/* Close the file */
+    if (!close_ob_writer(&writer)) {
+        printf("Can't write to file %s.", output_filename);
+        free(output_filename);
+        return FALSE;
+    }
     free(output_filename);
+	return TRUE;
+}
 
-	/* print code image length and data2 image length */
-	fprintf(file_desc, "%ld %ld\n", icf - IC_INIT_VALUE, dcf);
+static bool write_ob_concurrently(machine_word **code_img, long *data_img, long icf, long dcf, char *filename,
+                                  int threads) {
+    FILE *file_desc;
+    char *output_filename, *text;
+    ob_range *ranges;
+    pthread_t *range_threads;
+    bool *started, succeeded;
+    int header_length;
+    long i, text_length, code_count = icf - IC_INIT_VALUE, word_count = code_count + dcf;
+    long range_count = word_count / OB_MIN_RANGE_WORDS;
 
+    if (range_count > threads) range_count = threads;
+    if (range_count < 2) return write_ob(code_img, data_img, icf, dcf, filename);
 
-	/* starting from index 0, not IC_INIT_VALUE as icf, so we have to subtract it. */
-	for (i = 0; i < icf - IC_INIT_VALUE; i++) {
+    output_filename = strcat_to_new(filename, ".ob");
+    if ((file_desc = fopen(output_filename, "w")) == NULL) {
+        printf("Can't create or rewrite to file %s.", output_filename);
+        free(output_filename);
+        return FALSE;
+    }
+
+    /* The header (code and data lengths), then a fixed width line per word */
+    text_length = ob_text_length(IC_INIT_VALUE, IC_INIT_VALUE + word_count);
+    /* Two longs fit in the room of two lines */
+    text = (char *) better_malloc(2 * MAX_OB_LINE_LENGTH + text_length);
+    header_length = sprintf(text, "%ld %ld\n", code_count, dcf);
+    text_length += header_length;
+
+    ranges = (ob_range *) better_malloc(range_count * sizeof(ob_range));
+    range_threads = (pthread_t *) better_malloc(range_count * sizeof(pthread_t));
+    started = (bool *) better_malloc(range_count * sizeof(bool));
+    for (i = 0; i < range_count; i++) {
+        ob_range *range = &ranges[i];
+        range->code_img = code_img;
+        range->data_img = data_img;
+        range->code_count = code_count;
+        range->from = word_count * i / range_count;
+        range->to = word_count * (i + 1) / range_count;
+        range->text = text + header_length + ob_text_length(IC_INIT_VALUE, IC_INIT_VALUE + range->from);
+        /* The first range is formatted here */
+        started[i] = i > 0 && pthread_create(&range_threads[i], NULL, format_ob_range, range) == 0;
+    }
+    for (i = 0; i < range_count; i++) {
+        if (started[i]) pthread_join(range_threads[i], NULL);
+        else format_ob_range(&ranges[i]);
+    }
+
+    /* A short write (a full disk, for example) or a failed flush on close fails the file */
+    succeeded = fwrite(text, 1, text_length, file_desc) == (size_t) text_length;
+    if (fclose(file_desc) != 0) succeeded = FALSE;
+    if (!succeeded) printf("Can't write to file %s.", output_filename);
+    free(output_filename);
+    free(started);
+    free(range_threads);
+    free(ranges);
+    free(text);
+    return succeeded;
+}
+
+static void *format_ob_range(void *arg) {
+    ob_range *range = (ob_range *) arg;
+    ob_address address;
+    char *text = range->text;
+    long i;
+    init_ob_address(&address, IC_INIT_VALUE + range->from);
+    for (i = range->from; i < range->to && i < range->code_count; i++) {
+        text += format_ob_word(text, &address, code_word_value(range->code_img[i]));
+    }
+    if (i < range->to) {
+        format_ob_data_words(text, &address, range->data_img + (i - range->code_count), (int) (range->to - i));
+    }
+    return NULL;
+}
+
+static long ob_text_length(long from, long to) {
+    /* Addresses are padded to 4 digits, so every line up to 9999 has the same width, then one more per digit */
+    long length = 0, band_start = 0, band_end = 10000;
+    int digits = 4;
+    for (; band_start < to; band_start = band_end, band_end *= 10, digits++) {
+        long first = from > band_start ? from : band_start;
+        long last = to < band_end ? to : band_end;
+        if (first < last) length += (last - first) * (digits + OB_WORD_TEXT_LENGTH);
+    }
+    return length;
+}
+
+static void *run_external_file_job(void *arg) {
+    symbol_file_job *job = (symbol_file_job *) arg;
+    job->succeeded = write_external_file(job->external_references, job->filename, ".ext");
+    return NULL;
+}
 
-        /* Only first opcode wards contain length field */
-        if (code_img[i]->length > 0) {
+static void *run_entries_file_job(void *arg) {
+    symbol_file_job *job = (symbol_file_job *) arg;
+    job->succeeded = write_entries_file(job->symbol_table, job->filename, ".ent");
+    return NULL;
+}
 
-            opcode_word *opc = code_img[i]->word.opcode;
-            val = 1<< opc->opcode | 1<<(opc->ARE+16);
+bool open_ob_writer(ob_writer *writer, char *path, long icf, long dcf) {
+	writer->file_desc = fopen(path, "w");
+	if (writer->file_desc == NULL) {
+		printf("Can't create or rewrite to file %s.", path);
+		return FALSE;
+	}
+	/* print code image length and data2 image length */
+	fprintf(writer->file_desc, "%ld %ld\n", icf - IC_INIT_VALUE, dcf);
+    init_ob_address(&writer->address, IC_INIT_VALUE);
+    writer->block_fill = 0;
+    writer->write_failed = FALSE;
+    return TRUE;
+}
 
-        } else if (code_img[i]->is_operand == TRUE) {
-            operand_word *opw  =code_img[i]->word.operand;
-            val = 1<<(opw->ARE+16) | opw->funct<<12 | opw->source_register<<8 | opw->source_addressing<<6 | opw->destination_register<<2 | opw->destination_addressing;
-        } else{
-            operand_data_word *opdw = code_img[i]->word.data2;
-            val = 1<<(opdw->ARE+16) | opdw->data;
+void write_ob_code_words(ob_writer *writer, machine_word **code_img, long from, long to) {
+    long i;
+    for (i = from; i < to; i++) {
+        if (writer->block_fill > OB_BLOCK_SIZE - MAX_OB_LINE_LENGTH) {
+            flush_ob_block(writer);
         }
-        e = val & E_MASK;
-        d = (val & D_MASK)>>4;
-        c = (val & C_MASK)>>8;
-        b = (val & B_MASK)>>12;
-        a = (val & A_MASK)>>16;
-        fprintf(file_desc,"%04d A%x-B%x-C%x-D%x-E%x\n", IC_INIT_VALUE +i ,a,b,c,d,e);
+        writer->block_fill += format_ob_word(writer->block + writer->block_fill, &writer->address,
+                                             code_word_value(code_img[i]));
     }
+}
 
-	/* Write data2 image. */
-	for (i = 0; i < dcf; i++) {
-
-		val = data_img[i] | 1<<(ABSOLUTE+16);
-        e = val & E_MASK;
-        d = (val & D_MASK)>>4;
-        c = (val & C_MASK)>>8;
-        b = (val & B_MASK)>>12;
-        a = 4; /* It's always 4 because its only data */
-        fprintf(file_desc,"%04ld A%x-B%x-C%x-D%x-E%x\n", icf +i ,a,b,c,d,e);
+void write_ob_data_words(ob_writer *writer, long *data_img, long dcf) {
+    long i;
+	/* a block at a time */
+	for (i = 0; i < dcf;) {
+        long count = (OB_BLOCK_SIZE - writer->block_fill) / MAX_OB_LINE_LENGTH;
+        if (count > dcf - i) count = dcf - i;
+        writer->block_fill += format_ob_data_words(writer->block + writer->block_fill, &writer->address,
+                                                   data_img + i, (int) count);
+        i += count;
+        flush_ob_block(writer);
 	}
+}
 
-	/* Close the file */
-	fclose(file_desc);
-	return TRUE;
+bool close_ob_writer(ob_writer *writer) {
+    flush_ob_block(writer);
+    if (fclose(writer->file_desc) != 0) writer->write_failed = TRUE;
+    return !writer->write_failed;
+}
+
+static void flush_ob_block(ob_writer *writer) {
+    if (fwrite(writer->block, 1, writer->block_fill, writer->file_desc) != (size_t) writer->block_fill) {
+        writer->write_failed = TRUE;
+    }
+    writer->block_fill = 0;
+}
+
+static long code_word_value(machine_word *word) {
+    /* Only first opcode wards contain length field */
+    if (word->length > 0) {
+        opcode_word *opc = word->word.opcode;
+        return 1<< opc->opcode | 1<<(opc->ARE+16);
+    } else if (word->is_operand == TRUE) {
+        operand_word *opw = word->word.operand;
+        return 1<<(opw->ARE+16) | opw->funct<<12 | opw->source_register<<8 | opw->source_addressing<<6 | opw->destination_register<<2 | opw->destination_addressing;
+    } else {
+        operand_data_word *opdw = word->word.data2;
+        return 1<<(opdw->ARE+16) | opdw->data;
+    }
+}
+
+/* Lowercase hex digit of every nibble. A word has 5 nibbles, A to E */
+static const char hex_digits[] = "0123456789abcdef";
+
+static void init_ob_address(ob_address *address, long value) {
+    address->length = sprintf(address->digits, "%04ld", value);
+}
+
+static int format_ob_word(char *buffer, ob_address *address, long val) {
+    int i, length = address->length;
+
+    memcpy(buffer, address->digits, length);
+    memcpy(buffer + length, " A0-B0-C0-D0-E0\n", OB_WORD_TEXT_LENGTH);
+    buffer[length + 2] = hex_digits[((val & A_MASK) >> 16) & 0xf];
+    buffer[length + 5] = hex_digits[(val >> 12) & 0xf];
+    buffer[length + 8] = hex_digits[(val >> 8) & 0xf];
+    buffer[length + 11] = hex_digits[(val >> 4) & 0xf];
+    buffer[length + 14] = hex_digits[val & 0xf];
+
+    /* Move to the next address, like an odometer */
+    for (i = length - 1; i >= 0 && address->digits[i] == '9'; i--) {
+        address->digits[i] = '0';
+    }
+    if (i >= 0) {
+        address->digits[i]++;
+    } else {
+        memmove(address->digits + 1, address->digits, length);
+        address->digits[0] = '1';
+        address->length++;
+    }
+    return length + OB_WORD_TEXT_LENGTH;
+}
+
+static int format_ob_data_words(char *buffer, ob_address *address, long *data, int count) {
+    int i, length = 0;
+    for (i = 0; i < count; i++) {
+        /* Data words are always absolute, only the low 16 bits are kept */
+        length += format_ob_word(buffer + length, address,
+                                 (data[i] & (B_MASK | C_MASK | D_MASK | E_MASK)) | 1 << (ABSOLUTE + 16));
+    }
+    return length;
 }
 
 static bool write_entries_file(table tab, char *filename, char *file_extension) {
@@ -116,19 +413,24 @@ static bool write_entries_file(table tab, char *filename, char *file_extension)
 	}
     free(full_filename);
 	/* stop if empty */
-	if (tab == NULL) return TRUE;
+	if ((tab = next_entry_of_type(tab, ENTRY_SYMBOL)) == NULL) {
+        fclose(file_desc);
+        return TRUE;
+    }
 
 	/* Write first line without \n to avoid extraneous line breaks */
 	fprintf(file_desc, "%s,%ld,%ld", tab->key, tab->base, tab->offset);
-	while ((tab = tab->next) != NULL) {
+	while ((tab = next_entry_of_type(tab->next, ENTRY_SYMBOL)) != NULL) {
 		fprintf(file_desc, "\n%s,%ld,%ld", tab->key, tab->base, tab->offset);
 	}
 	fclose(file_desc);
 	return TRUE;
 }
 
-bool write_external_file(table tab, char *filename, char *file_extension){
+bool write_external_file(external_reference_log *external_references, char *filename, char *file_extension){
     FILE *file_desc;
+    long i;
+    external_reference *reference;
     /* concatenate filename & extension, and open the file for writing: */
     char *full_filename = strcat_to_new(filename, file_extension);
     file_desc = fopen(full_filename, "w");
@@ -139,15 +441,20 @@ bool write_external_file(table tab, char *filename, char *file_extension){
         return FALSE;
     }
     free(full_filename);
-    /* if table is null, nothing to write */
-    if (tab == NULL) return TRUE;
+    /* if there are no references, nothing to write */
+    if (external_references->count == 0) {
+        fclose(file_desc);
+        return TRUE;
+    }
 
     /* Write first line without \n to avoid extraneous line breaks */
-    fprintf(file_desc, "%s BASE %ld\n", tab->key, tab->value);
-    fprintf(file_desc, "%s OFFSET %ld\n", tab->key, tab->value+1);
-    while ((tab = tab->next) != NULL) {
-        fprintf(file_desc, "\n%s BASE %ld", tab->key, tab->value);
-        fprintf(file_desc, "\n%s OFFSET %ld", tab->key, tab->value+1);
+    reference = external_references->references;
+    fprintf(file_desc, "%s BASE %ld\n", reference->symbol->key, reference->address);
+    fprintf(file_desc, "%s OFFSET %ld\n", reference->symbol->key, reference->address+1);
+    for (i = 1; i < external_references->count; i++) {
+        reference = &external_references->references[i];
+        fprintf(file_desc, "\n%s BASE %ld", reference->symbol->key, reference->address);
+        fprintf(file_desc, "\n%s OFFSET %ld", reference->symbol->key, reference->address+1);
         fprintf(file_desc,"\n");
     }
     fclose(file_desc);
@@ -1,23 +1,101 @@
 /* Output files related functions */
 #ifndef OUTPUT_MODULE_H
 #define OUTPUT_MODULE_H
+#include <stdio.h>
 #include "globals.h"
 #include "symbol_table.h"
 
 /**
- * Writes the output files of a single assembled file
+ * Writes the output files of a single assembled file.
+ * With more than one thread the .ob, .ext and .ent files are written concurrently,
+ * and the words of a large .ob file are formatted by several threads.
  * @param code_img The code image
  * @param data_img The data image
  * @param icf The final instruction counter
  * @param dcf The final data counter
  * @param filename The filename (without the extension)
- * @param ent_table The entries table
- * @param ext_table The external references table
+ * @param symbol_table The symbol table, containing the entries
+ * @param external_references The external references log
+ * @param threads Maximum number of threads, 1 writes the files one after the other
  * @return True if good False if bad
  */
 int write_output_files(machine_word **code_img, long *data_img, long icf, long dcf, char *filename,
-                       table symbol_table);
+                       table symbol_table, external_reference_log *external_references, int threads);
 
+/** Fewest .ob words that are worth formatting by another thread */
+#define OB_MIN_RANGE_WORDS 4096
+
+
+/** Length of a formatted word without its address: " A4-B0-C0-D0-E4\n" */
+#define OB_WORD_TEXT_LENGTH 16
+
+/** Longest .ob word line, for addresses of up to 8 digits */
+#define MAX_OB_LINE_LENGTH (8 + OB_WORD_TEXT_LENGTH)
+
+/** Size of the output block that formatted lines are gathered in before writing */
+#define OB_BLOCK_SIZE 4096
+
+/** Decimal text of the current .ob address, zero padded to 4 digits like %04ld */
+typedef struct ob_address {
+    /** Fits any long with its sign and the terminator */
+    char digits[21];
+    int length;
+} ob_address;
+
+/** Writes an .ob file incrementally, code words first and then the data words */
+typedef struct ob_writer {
+    FILE *file_desc;
+    /** Address of the next word */
+    ob_address address;
+    /** Formatted lines that weren't written yet */
+    char block[OB_BLOCK_SIZE];
+    int block_fill;
+    /** Whether a block was written only partly (a full disk, for example) */
+    bool write_failed;
+} ob_writer;
+
+/**
+ * Creates the .ob file and writes its header (code and data lengths)
+ * @param writer The writer to initialize
+ * @param path The full path of the file to write
+ * @param icf The final instruction counter
+ * @param dcf The final data counter
+ * @return Whether succeeded
+ */
+bool open_ob_writer(ob_writer *writer, char *path, long icf, long dcf);
+
+/**
+ * Writes a range of the code image, must follow the previously written range
+ * @param writer The writer
+ * @param code_img The code image
+ * @param from Index (address - IC_INIT_VALUE) of the first word to write
+ * @param to Index after the last word to write
+ */
+void write_ob_code_words(ob_writer *writer, machine_word **code_img, long from, long to);
+
+/**
+ * Writes the whole data image, after all the code words
+ * @param writer The writer
+ * @param data_img The data image
+ * @param dcf The final data counter
+ */
+void write_ob_data_words(ob_writer *writer, long *data_img, long dcf);
+
+/**
+ * Writes what's left and closes the file
+ * @param writer The writer
+ * @return Whether all the blocks were written and the file was closed successfully
+ */
+bool close_ob_writer(ob_writer *writer);
+
+/**
+ * Writes the .ext and .ent files of a single assembled file
+ * @param filename The filename (without the extension)
+ * @param symbol_table The symbol table, containing the entries
+ * @param external_references The external references log
+ * @return True if good False if bad
+ */
+bool write_symbol_files(char *filename, table symbol_table, external_reference_log *external_references);
 
 /***
  * Output the lines after macro expansion to file
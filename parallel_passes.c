@@ -0,0 +1,351 @@
+/* Passes over the lines of a large file, split into chunks that are processed by several threads */
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "parallel_passes.h"
+#include "helper.h"
+#include "symbol_table.h"
+#include "second_pass.h"
+#include "trace.h"
+
+/** Labels of a single line in a chunk, merged into the symbol table after all the chunks are done */
+typedef struct chunk_line_symbols {
+    long line_index;
+    /** The label that the line checks for being already defined, empty if none */
+    char label[MAX_LABEL_LENGTH + 1];
+    /** The symbols that the line added, with chunk-local values */
+    table added;
+} chunk_line_symbols;
+
+/** A range of lines, and everything the first pass built from them */
+typedef struct first_pass_chunk {
+    assembly_unit *unit;
+    /** The lines [first_line, end_line) */
+    long first_line, end_line;
+    /** Chunk-local counters, start from IC_INIT_VALUE and 0 like a whole file */
+    long ic, dc;
+    machine_word **code_img;
+    long *data_img;
+    /** Lines with labels, in line order */
+    chunk_line_symbols *symbols;
+    long symbol_count;
+    long symbol_capacity;
+    /** Error messages of the chunk's lines, in line order */
+    diagnostic_log diagnostics;
+    bool success;
+} first_pass_chunk;
+
+/** A range of lines, and the external references that were found while resolving them */
+typedef struct second_pass_chunk {
+    assembly_unit *unit;
+    /** The lines [first_line, end_line) */
+    long first_line, end_line;
+    external_reference_log external_references;
+    bool success;
+} second_pass_chunk;
+
+/**
+ * Thread body - runs the first pass on the lines of a chunk
+ * @param arg The first_pass_chunk
+ * @return NULL
+ */
+static void *run_first_pass_chunk(void *arg);
+
+/**
+ * Thread body - resolves the operand words of the code lines of a chunk, stops at the first failure
+ * @param arg The second_pass_chunk
+ * @return NULL
+ */
+static void *run_second_pass_chunk(void *arg);
+
+/**
+ * Moves the chunk's words into the unit's images, at the chunk's final addresses
+ * @param unit The unit
+ * @param chunk The chunk
+ * @param base_ic Count of code words before the chunk
+ * @param base_dc Count of data words before the chunk
+ */
+static void merge_chunk_images(assembly_unit *unit, first_pass_chunk *chunk, long base_ic, long base_dc);
+
+/**
+ * Merges the chunk's labels into the unit's symbol table, and its error messages into the unit's log,
+ * both in line order. A line whose label is already defined is reported, and its symbols and other errors dropped.
+ * @param unit The unit
+ * @param chunk The chunk
+ * @param base_ic Count of code words before the chunk
+ * @param base_dc Count of data words before the chunk
+ * @param diagnostics The unit's error messages
+ */
+static void merge_chunk_symbols(assembly_unit *unit, first_pass_chunk *chunk, long base_ic, long base_dc,
+                                diagnostic_log *diagnostics);
+
+void run_first_pass(assembly_unit *unit, int threads) {
+    first_pass_chunk *chunks;
+    pthread_t *chunk_threads;
+    bool *started;
+    diagnostic_log diagnostics;
+    long i, base_ic, base_dc, chunk_count = unit->line_count / PARALLEL_MIN_CHUNK_LINES;
+
+    if (chunk_count > threads) chunk_count = threads;
+    if (chunk_count > MAX_PASS_THREADS) chunk_count = MAX_PASS_THREADS;
+    if (chunk_count < 2) {
+        for (i = 0; i < unit->line_count; i++) {
+            first_pass_line(unit, i);
+        }
+        return;
+    }
+
+    chunks = (first_pass_chunk *) better_malloc(chunk_count * sizeof(first_pass_chunk));
+    chunk_threads = (pthread_t *) better_malloc(chunk_count * sizeof(pthread_t));
+    started = (bool *) better_malloc(chunk_count * sizeof(bool));
+    for (i = 0; i < chunk_count; i++) {
+        first_pass_chunk *chunk = &chunks[i];
+        chunk->unit = unit;
+        chunk->first_line = unit->line_count * i / chunk_count;
+        chunk->end_line = unit->line_count * (i + 1) / chunk_count;
+        chunk->ic = IC_INIT_VALUE;
+        chunk->dc = 0;
+        chunk->code_img = (machine_word **) better_malloc(CODE_ARR_IMG_LENGTH * sizeof(machine_word *));
+        memset(chunk->code_img, 0, CODE_ARR_IMG_LENGTH * sizeof(machine_word *));
+        chunk->data_img = (long *) better_malloc(CODE_ARR_IMG_LENGTH * sizeof(long));
+        chunk->symbols = NULL;
+        chunk->symbol_count = chunk->symbol_capacity = 0;
+        init_diagnostic_log(&chunk->diagnostics);
+        chunk->success = TRUE;
+        /* If a thread can't be started, its chunk runs here after the others were started */
+        started[i] = pthread_create(&chunk_threads[i], NULL, run_first_pass_chunk, chunk) == 0;
+    }
+    for (i = 0; i < chunk_count; i++) {
+        if (started[i]) pthread_join(chunk_threads[i], NULL);
+        else run_first_pass_chunk(&chunks[i]);
+    }
+
+    /* Prefix sum of the chunk sizes gives the final addresses, then merge in line order */
+    init_diagnostic_log(&diagnostics);
+    base_ic = base_dc = 0;
+    for (i = 0; i < chunk_count; i++) {
+        first_pass_chunk *chunk = &chunks[i];
+        merge_chunk_images(unit, chunk, base_ic, base_dc);
+        merge_chunk_symbols(unit, chunk, base_ic, base_dc, &diagnostics);
+        if (!chunk->success) unit->success = FALSE;
+        base_ic += chunk->ic - IC_INIT_VALUE;
+        base_dc += chunk->dc;
+        free(chunk->code_img);
+        free(chunk->data_img);
+        free(chunk->symbols);
+    }
+    unit->ic = IC_INIT_VALUE + base_ic;
+    unit->dc = base_dc;
+
+    print_diagnostics(&diagnostics);
+    free_diagnostic_log(&diagnostics);
+    free(started);
+    free(chunk_threads);
+    free(chunks);
+}
+
+static void *run_first_pass_chunk(void *arg) {
+    first_pass_chunk *chunk = (first_pass_chunk *) arg;
+    double start = trace_now();
+    long i;
+    for (i = chunk->first_line; i < chunk->end_line; i++) {
+        table line_symbols = NULL;
+        char label[MAX_LABEL_LENGTH + 1];
+        bool is_too_long = chunk->unit->lines[i].is_too_long;
+        line_descriptor line = get_unit_line(chunk->unit, i);
+        line.diagnostics = &chunk->diagnostics;
+        chunk->unit->lines[i].ic = chunk->ic;
+        chunk->unit->lines[i].dc = chunk->dc;
+
+        /* Each line gets its own table, so the merge knows which line added which symbol */
+        if (!first_pass_line_into(line, is_too_long, &chunk->ic, &chunk->dc, chunk->code_img, chunk->data_img,
+                                  &line_symbols, chunk->unit->macro_ir)) {
+            chunk->success = FALSE;
+        }
+        if (is_too_long || !find_checked_label(line, label)) label[0] = '\0';
+        if (label[0] == '\0' && line_symbols == NULL) continue;
+
+        if (chunk->symbol_count == chunk->symbol_capacity) {
+            chunk_line_symbols *grown;
+            chunk->symbol_capacity = chunk->symbol_capacity ? chunk->symbol_capacity * 2 : 256;
+            grown = (chunk_line_symbols *) better_malloc(chunk->symbol_capacity * sizeof(chunk_line_symbols));
+            if (chunk->symbol_count) memcpy(grown, chunk->symbols, chunk->symbol_count * sizeof(chunk_line_symbols));
+            free(chunk->symbols);
+            chunk->symbols = grown;
+        }
+        chunk->symbols[chunk->symbol_count].line_index = i;
+        strcpy(chunk->symbols[chunk->symbol_count].label, label);
+        chunk->symbols[chunk->symbol_count].added = line_symbols;
+        chunk->symbol_count++;
+    }
+    trace_span("first_pass_chunk", chunk->unit->filename, start);
+    return NULL;
+}
+
+static void merge_chunk_images(assembly_unit *unit, first_pass_chunk *chunk, long base_ic, long base_dc) {
+    long i, count = chunk->ic - IC_INIT_VALUE;
+    for (i = chunk->first_line; i < chunk->end_line; i++) {
+        unit->lines[i].ic += base_ic;
+        unit->lines[i].dc += base_dc;
+    }
+    /* A sequential pass would have overflowed the image, stop at its end like the chunk itself does */
+    if (base_ic + count > CODE_ARR_IMG_LENGTH) count = base_ic < CODE_ARR_IMG_LENGTH ? CODE_ARR_IMG_LENGTH - base_ic : 0;
+    memcpy(unit->code_img + base_ic, chunk->code_img, count * sizeof(machine_word *));
+    if (count < chunk->ic - IC_INIT_VALUE) {
+        memmove(chunk->code_img, chunk->code_img + count, (chunk->ic - IC_INIT_VALUE - count) * sizeof(machine_word *));
+        free_code_image(chunk->code_img, chunk->ic - IC_INIT_VALUE - count);
+    }
+
+    count = chunk->dc;
+    if (base_dc + count > CODE_ARR_IMG_LENGTH) count = base_dc < CODE_ARR_IMG_LENGTH ? CODE_ARR_IMG_LENGTH - base_dc : 0;
+    memcpy(unit->data_img + base_dc, chunk->data_img, count * sizeof(long));
+}
+
+static void merge_chunk_symbols(assembly_unit *unit, first_pass_chunk *chunk, long base_ic, long base_dc,
+                                diagnostic_log *diagnostics) {
+    long i, next_diagnostic = 0;
+    diagnostic *items = chunk->diagnostics.items;
+
+    for (i = 0; i < chunk->symbol_count; i++) {
+        chunk_line_symbols *symbols = &chunk->symbols[i];
+        long line_number = symbols->line_index + 1;
+        table entry;
+
+        /* Errors of the lines before this one */
+        for (; next_diagnostic < chunk->diagnostics.count && items[next_diagnostic].line_number < line_number;
+               next_diagnostic++) {
+            add_diagnostic(diagnostics, items[next_diagnostic].line_number, items[next_diagnostic].text);
+        }
+
+        if (symbols->label[0] != '\0' &&
+            find_by_types(unit->symbol_table, symbols->label, 3, EXTERNAL_SYMBOL, DATA_SYMBOL, CODE_SYMBOL) != NULL) {
+            /* The sequential pass stops at this check, nothing the rest of the line did counts */
+            line_descriptor line = get_unit_line(unit, symbols->line_index);
+            line.diagnostics = diagnostics;
+            fprintf_error_specific(line, "Symbol %s is already defined.", symbols->label);
+            unit->success = FALSE;
+            for (; next_diagnostic < chunk->diagnostics.count && items[next_diagnostic].line_number == line_number;
+                   next_diagnostic++);
+        } else {
+            for (entry = symbols->added; entry != NULL; entry = entry->next) {
+                long value = entry->value;
+                if (entry->type == CODE_SYMBOL) value += base_ic;
+                else if (entry->type == DATA_SYMBOL) value += base_dc;
+                add_table_item(&unit->symbol_table, entry->key, value, entry->type);
+            }
+        }
+        free_table(symbols->added);
+    }
+    for (; next_diagnostic < chunk->diagnostics.count; next_diagnostic++) {
+        add_diagnostic(diagnostics, items[next_diagnostic].line_number, items[next_diagnostic].text);
+    }
+    free_diagnostic_log(&chunk->diagnostics);
+}
+
+void run_second_pass(assembly_unit *unit, int threads) {
+    second_pass_chunk *chunks;
+    pthread_t *chunk_threads;
+    bool *started, *unresolved, success = TRUE;
+    long i, j, word_count = unit->icf - IC_INIT_VALUE, chunk_count = unit->line_count / PARALLEL_MIN_CHUNK_LINES;
+
+    if (chunk_count > threads) chunk_count = threads;
+    if (chunk_count > MAX_PASS_THREADS) chunk_count = MAX_PASS_THREADS;
+    if (chunk_count < 2) {
+        for (i = 0; i < unit->line_count; i++) {
+            second_pass_line(unit, i);
+        }
+        return;
+    }
+
+    /* The words that are filled now, to roll them back if a symbol is missing */
+    unresolved = (bool *) better_malloc((word_count + 1) * sizeof(bool));
+    for (j = 0; j < word_count; j++) {
+        unresolved[j] = unit->code_img[j] == NULL;
+    }
+
+    chunks = (second_pass_chunk *) better_malloc(chunk_count * sizeof(second_pass_chunk));
+    chunk_threads = (pthread_t *) better_malloc(chunk_count * sizeof(pthread_t));
+    started = (bool *) better_malloc(chunk_count * sizeof(bool));
+    for (i = 0; i < chunk_count; i++) {
+        second_pass_chunk *chunk = &chunks[i];
+        chunk->unit = unit;
+        chunk->first_line = unit->line_count * i / chunk_count;
+        chunk->end_line = unit->line_count * (i + 1) / chunk_count;
+        init_external_reference_log(&chunk->external_references);
+        chunk->success = TRUE;
+        started[i] = pthread_create(&chunk_threads[i], NULL, run_second_pass_chunk, chunk) == 0;
+    }
+    for (i = 0; i < chunk_count; i++) {
+        if (started[i]) pthread_join(chunk_threads[i], NULL);
+        else run_second_pass_chunk(&chunks[i]);
+        if (!chunks[i].success) success = FALSE;
+    }
+
+    /* The chunks are in line order, and so in address order */
+    for (i = 0; i < chunk_count; i++) {
+        external_reference_log *references = &chunks[i].external_references;
+        if (success) {
+            for (j = 0; j < references->count; j++) {
+                add_external_reference(&unit->external_references, references->references[j].symbol,
+                                       references->references[j].address);
+            }
+        }
+        free_external_reference_log(references);
+    }
+
+    if (success) {
+        /* Code lines are done, only the .entry lines are left */
+        unit->ic = unit->icf;
+        for (i = 0; i < unit->line_count; i++) {
+            line_descriptor line = get_unit_line(unit, i);
+            j = 0;
+            SKIP_TO_NEXT_NON_WHITESPACE(line.content, j)
+            if (line.content[j] == '.' && !process_line_second_pass(line, &unit->ic, unit->code_img,
+                                                                    &unit->symbol_table, &unit->external_references)) {
+                unit->success = FALSE;
+            }
+        }
+    } else {
+        /* The chunks printed nothing, so do it all again sequentially for the diagnostics */
+        for (j = 0; j < word_count; j++) {
+            if (unresolved[j]) free_code_image(unit->code_img + j, 1);
+        }
+        for (i = 0; i < unit->line_count; i++) {
+            second_pass_line(unit, i);
+        }
+    }
+
+    free(started);
+    free(chunk_threads);
+    free(chunks);
+    free(unresolved);
+}
+
+static void *run_second_pass_chunk(void *arg) {
+    second_pass_chunk *chunk = (second_pass_chunk *) arg;
+    assembly_unit *unit = chunk->unit;
+    diagnostic_log ignored;
+    double start = trace_now();
+    long i;
+
+    /* Nothing is printed here, a failure is repeated by the sequential pass */
+    init_diagnostic_log(&ignored);
+    for (i = chunk->first_line; i < chunk->end_line && chunk->success; i++) {
+        long ic = unit->lines[i].ic;
+        long end_ic = i + 1 < unit->line_count ? unit->lines[i + 1].ic : unit->icf;
+        line_descriptor line;
+        /* Only code lines left words in the image */
+        if (ic == end_ic) continue;
+        line = get_unit_line(unit, i);
+        line.diagnostics = &ignored;
+        if (!add_symbol_to_machine_code(line, &ic, unit->code_img, &unit->symbol_table,
+                                        &chunk->external_references)) {
+            chunk->success = FALSE;
+        }
+    }
+    free_diagnostic_log(&ignored);
+    trace_span("second_pass_chunk", unit->filename, start);
+    return NULL;
+}
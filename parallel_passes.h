@@ -0,0 +1,36 @@
+/* Passes over the lines of a large file, split into chunks that are processed by several threads */
+#ifndef _PARALLEL_PASSES_H
+#define _PARALLEL_PASSES_H
+#include "globals.h"
+#include "assembly_unit.h"
+
+/** Files with less lines than this per thread are processed by fewer threads */
+#define PARALLEL_MIN_CHUNK_LINES 512
+
+/** Maximum number of threads of a single pass */
+#define MAX_PASS_THREADS 64
+
+/**
+ * Runs the first pass on all the lines of the unit.
+ * Large files are split into consecutive chunks of lines, each one encoded by its own thread into
+ * chunk-local code/data images with counters that start from zero. A prefix sum of the chunk sizes then
+ * gives every chunk its final addresses, and the chunks' labels are merged into the symbol table in line order,
+ * so duplicate labels and the order of the error messages are exactly like a sequential pass.
+ * @param unit The unit, with all the source lines added
+ * @param threads Maximum number of threads, 1 runs the pass sequentially
+ */
+void run_first_pass(assembly_unit *unit, int threads);
+
+/**
+ * Runs the second pass on all the lines of the unit.
+ * After the first pass the symbol table is read-only, so the operand words of large files are resolved
+ * by several threads, each over a chunk of the code lines and with its own log of external references.
+ * The logs are merged in address order, then the .entry lines are checked in order.
+ * If an operand can't be resolved the threads' work is rolled back and the pass runs sequentially,
+ * so the error messages are exactly like a sequential pass.
+ * @param unit The unit, after a successful first pass
+ * @param threads Maximum number of threads, 1 runs the pass sequentially
+ */
+void run_second_pass(assembly_unit *unit, int threads);
+
+#endif
@@ -0,0 +1,203 @@
+/* Hardware performance counters (--counters) - cycles, instructions and misses of every phase of a file */
+/* syscall() isn't part of POSIX, and perf_event_open has no libc wrapper */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "phase_counters.h"
+#include "helper.h"
+
+/** Totals of all the files of all the workers */
+typedef struct counter_totals {
+    long files;
+    long microseconds[PHASE_COUNT];
+    unsigned long values[PHASE_COUNT][HARDWARE_COUNTER_COUNT];
+    /** Files whose counter could be read in the phase */
+    long sampled[PHASE_COUNT][HARDWARE_COUNTER_COUNT];
+} counter_totals;
+
+static char *phase_names[PHASE_COUNT] = {"expand_macros", "first_pass", "second_pass", "write_outputs"};
+
+static char *counter_names[HARDWARE_COUNTER_COUNT] = {"cycles", "instructions", "cache-misses", "branch-misses"};
+
+/** perf_event_open configs of the counters, by hardware_counter */
+static unsigned long counter_configs[HARDWARE_COUNTER_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+
+/** The totals, in memory shared with the workers, NULL if not counting */
+static counter_totals *totals = NULL;
+
+/** Process that started counting, it reports the totals */
+static long counting_pid;
+
+/** Process that opened the counters, 0 if none did */
+static long counters_pid = 0;
+
+/** The counters of the process, -1 for a counter that couldn't be opened */
+static int counter_fds[HARDWARE_COUNTER_COUNT];
+
+/**
+ * Opens the counters of the calling process, unless it already did. A forked worker closes the counters it
+ * inherited, they count its parent.
+ */
+static void open_counters(void);
+
+/**
+ * Prints the header of a counters table
+ * @param prefix The line prefix
+ */
+static void print_counters_header(char *prefix);
+
+/**
+ * Prints a line of a counters table
+ * @param prefix The line prefix
+ * @param phase The phase
+ * @param ms Wall-clock time
+ * @param values The counters
+ * @param is_available Whether each counter was read
+ */
+static void print_counters_line(char *prefix, counter_phase phase, double ms, unsigned long *values,
+                                bool *is_available);
+
+/**
+ * Returns the monotonic clock in milliseconds
+ */
+static double now_ms(void);
+
+bool start_phase_counters(void) {
+    int zero_fd;
+    void *memory;
+    if (totals != NULL) return TRUE;
+    /* MAP_ANONYMOUS needs more than POSIX, a shared mapping of /dev/zero is the same thing */
+    if ((zero_fd = open("/dev/zero", O_RDWR)) < 0) return FALSE;
+    memory = mmap(NULL, sizeof(counter_totals), PROT_READ | PROT_WRITE, MAP_SHARED, zero_fd, 0);
+    close(zero_fd);
+    if (memory == MAP_FAILED) return FALSE;
+    totals = (counter_totals *) memory;
+    counting_pid = (long) getpid();
+    open_counters();
+    return TRUE;
+}
+
+bool is_counting_phases(void) {
+    return totals != NULL;
+}
+
+void init_file_counters(file_counters *counters) {
+    memset(counters, 0, sizeof(file_counters));
+}
+
+void read_counter_sample(counter_sample *sample) {
+    int i;
+    open_counters();
+    for (i = 0; i < HARDWARE_COUNTER_COUNT; i++) {
+        __u64 value;
+        sample->is_available[i] = counter_fds[i] >= 0 && read(counter_fds[i], &value, sizeof(value)) == sizeof(value);
+        sample->values[i] = sample->is_available[i] ? (unsigned long) value : 0;
+    }
+    sample->ms = now_ms();
+}
+
+void add_phase_sample(file_counters *counters, counter_phase phase, counter_sample *start) {
+    counter_sample end, *sum = &counters->phases[phase];
+    int i;
+    read_counter_sample(&end);
+    sum->ms += end.ms - start->ms;
+    for (i = 0; i < HARDWARE_COUNTER_COUNT; i++) {
+        if (!start->is_available[i] || !end.is_available[i]) continue;
+        sum->values[i] += end.values[i] - start->values[i];
+        sum->is_available[i] = TRUE;
+    }
+}
+
+void report_file_counters(char *filename, file_counters *counters) {
+    char *prefix = strcat_to_new(filename, ": ");
+    int phase, i;
+    print_counters_header(prefix);
+    for (phase = 0; phase < PHASE_COUNT; phase++) {
+        counter_sample *sum = &counters->phases[phase];
+        print_counters_line(prefix, (counter_phase) phase, sum->ms, sum->values, sum->is_available);
+        if (totals == NULL) continue;
+        /* Workers add their files at the same time */
+        __atomic_fetch_add(&totals->microseconds[phase], (long) (sum->ms * 1000), __ATOMIC_RELAXED);
+        for (i = 0; i < HARDWARE_COUNTER_COUNT; i++) {
+            if (!sum->is_available[i]) continue;
+            __atomic_fetch_add(&totals->values[phase][i], sum->values[i], __ATOMIC_RELAXED);
+            __atomic_fetch_add(&totals->sampled[phase][i], 1, __ATOMIC_RELAXED);
+        }
+    }
+    if (totals != NULL) __atomic_fetch_add(&totals->files, 1, __ATOMIC_RELAXED);
+    free(prefix);
+}
+
+void report_total_counters(void) {
+    int phase, i;
+    char prefix[64];
+    if (totals == NULL || (long) getpid() != counting_pid) return;
+    sprintf(prefix, "total of %ld files: ", totals->files);
+    print_counters_header(prefix);
+    for (phase = 0; phase < PHASE_COUNT; phase++) {
+        bool is_available[HARDWARE_COUNTER_COUNT];
+        for (i = 0; i < HARDWARE_COUNTER_COUNT; i++) {
+            is_available[i] = totals->sampled[phase][i] > 0;
+        }
+        print_counters_line(prefix, (counter_phase) phase, totals->microseconds[phase] / 1000.0,
+                            totals->values[phase], is_available);
+    }
+    fflush(stdout);
+}
+
+static void open_counters(void) {
+    long pid = (long) getpid();
+    int i;
+    if (counters_pid == pid) return;
+    for (i = 0; i < HARDWARE_COUNTER_COUNT; i++) {
+        struct perf_event_attr attr;
+        if (counters_pid != 0 && counter_fds[i] >= 0) close(counter_fds[i]);
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = counter_configs[i];
+        /* The threads of the parallel passes are counted too, once they're joined */
+        attr.inherit = 1;
+        /* Allowed for unprivileged users with the default perf_event_paranoid */
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        counter_fds[i] = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    counters_pid = pid;
+}
+
+static void print_counters_header(char *prefix) {
+    int i;
+    printf("%s%-14s %10s", prefix, "phase", "ms");
+    for (i = 0; i < HARDWARE_COUNTER_COUNT; i++) {
+        printf(" %14s", counter_names[i]);
+    }
+    printf("\n");
+}
+
+static void print_counters_line(char *prefix, counter_phase phase, double ms, unsigned long *values,
+                                bool *is_available) {
+    int i;
+    printf("%s%-14s %10.3f", prefix, phase_names[phase], ms);
+    for (i = 0; i < HARDWARE_COUNTER_COUNT; i++) {
+        /* Unavailable counters leave only the wall-clock time */
+        if (is_available[i]) printf(" %14lu", values[i]);
+        else printf(" %14s", "-");
+    }
+    printf("\n");
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
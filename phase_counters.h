@@ -0,0 +1,83 @@
+/* Hardware performance counters (--counters) - cycles, instructions and misses of every phase of a file */
+#ifndef _PHASE_COUNTERS_H
+#define _PHASE_COUNTERS_H
+#include "globals.h"
+
+/** The phases of assembling a file */
+typedef enum counter_phase {
+    EXPAND_PHASE,
+    FIRST_PASS_PHASE,
+    SECOND_PASS_PHASE,
+    OUTPUT_PHASE,
+    PHASE_COUNT
+} counter_phase;
+
+/** The hardware events that are counted */
+typedef enum hardware_counter {
+    CYCLES_COUNTER,
+    INSTRUCTIONS_COUNTER,
+    CACHE_MISSES_COUNTER,
+    BRANCH_MISSES_COUNTER,
+    HARDWARE_COUNTER_COUNT
+} hardware_counter;
+
+/** The counters at a point in time */
+typedef struct counter_sample {
+    double ms;
+    unsigned long values[HARDWARE_COUNTER_COUNT];
+    /** Whether each counter could be read, wall-clock time always can */
+    bool is_available[HARDWARE_COUNTER_COUNT];
+} counter_sample;
+
+/** What the phases of a single file took */
+typedef struct file_counters {
+    /** Differences between the samples at the end and at the start of each phase, summed */
+    counter_sample phases[PHASE_COUNT];
+} file_counters;
+
+/**
+ * Starts counting. Must be called before any thread or worker process starts, as the counters are inherited
+ * by threads and the totals of all the files are kept in memory shared with the workers.
+ * @return Whether succeeded
+ */
+bool start_phase_counters(void);
+
+/**
+ * Returns whether counting
+ */
+bool is_counting_phases(void);
+
+/**
+ * Initializes the counters of a file to zero
+ * @param counters The counters
+ */
+void init_file_counters(file_counters *counters);
+
+/**
+ * Reads the counters of the calling process and its threads. Counters that can't be opened (no hardware
+ * support, or not permitted) are marked unavailable, and only wall-clock time is measured.
+ * @param sample Output, the counters now
+ */
+void read_counter_sample(counter_sample *sample);
+
+/**
+ * Adds what happened since a sample to a phase of the file
+ * @param counters The counters of the file
+ * @param phase The phase
+ * @param start The sample at the start of the phase
+ */
+void add_phase_sample(file_counters *counters, counter_phase phase, counter_sample *start);
+
+/**
+ * Prints the counters of a file, and adds them to the totals
+ * @param filename The filename
+ * @param counters The counters of the file
+ */
+void report_file_counters(char *filename, file_counters *counters);
+
+/**
+ * Prints the totals of all the files, in the process that started counting. Does nothing if not counting.
+ */
+void report_total_counters(void);
+
+#endif
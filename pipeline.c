@@ -0,0 +1,257 @@
+/* Pipelined assembly of a single file:
+ * expander thread -> text batches -> first pass (this thread) -> second pass -> word batches -> formatter thread */
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "pipeline.h"
+#include "helper.h"
+#include "assembly_unit.h"
+#include "concurrent_queue.h"
+#include "output_module.h"
+#include "pre_assembler.h"
+#include "trace.h"
+
+/** Bytes of expanded source in a single text batch */
+#define PIPELINE_TEXT_BATCH_SIZE 16384
+
+/** Code words resolved before they're handed to the formatter */
+#define PIPELINE_WORD_BATCH_SIZE 512
+
+/** Maximum batches in flight between two stages */
+#define PIPELINE_QUEUE_CAPACITY 64
+
+/** Suffix of the .ob file while it's being written, renamed when the file assembles successfully */
+#define PARTIAL_OUTPUT_SUFFIX ".part"
+
+/** A piece of the expanded source, lines may be split between batches */
+typedef struct text_batch {
+    long length;
+    char text[PIPELINE_TEXT_BATCH_SIZE];
+} text_batch;
+
+/** Macro expansion stage */
+typedef struct expander_stage {
+    char *filename;
+    /** Text batches to the first pass, NULL ends the stream */
+    concurrent_queue batches;
+    /** The batch being filled */
+    text_batch *current;
+    /** The .am file, written as the lines are expanded */
+    FILE *am_file;
+    bool am_file_opened;
+    /** Where the origins of the expanded lines go, NULL if not kept */
+    line_origin_log *origins;
+    /** Whether the source file was read */
+    bool succeeded;
+} expander_stage;
+
+/** .ob formatting stage */
+typedef struct formatter_stage {
+    assembly_unit *unit;
+    /** Index after the last resolved code word (long *), NULL ends the stream */
+    concurrent_queue resolved;
+    char *path;
+    bool succeeded;
+} formatter_stage;
+
+/**
+ * Thread function of the expansion stage
+ * @param arg The expander_stage
+ * @return NULL
+ */
+static void *run_expander(void *arg);
+
+/**
+ * Expanded line handler of the expansion stage, adds the line to the current batch and to the .am file
+ * @param context The expander_stage
+ * @param line The expanded line
+ */
+static void batch_expanded_line(void *context, char *line);
+
+/**
+ * Opens the .am file of the expansion stage
+ * @param stage The expander_stage
+ */
+static void open_am_file(expander_stage *stage);
+
+/**
+ * Thread function of the formatting stage
+ * @param arg The formatter_stage
+ * @return NULL
+ */
+static void *run_formatter(void *arg);
+
+/**
+ * Hands the code words up to index to the formatter
+ * @param stage The formatter_stage
+ * @param index Index after the last resolved word
+ */
+static void publish_resolved_words(formatter_stage *stage, long index);
+
+bool assemble_file_pipelined(char *filename, assembly_options *options) {
+    expander_stage expander;
+    formatter_stage formatter;
+    line_splitter splitter;
+    pthread_t expander_thread, formatter_thread;
+    text_batch *batch;
+    long i, published = 0;
+    line_origin_log origins;
+    bool success_flag;
+    double start = trace_now();
+    assembly_unit *unit = create_assembly_unit(filename);
+
+    unit->options = *options;
+    init_line_origin_log(&origins);
+    if (options->line_map) unit->origins = &origins;
+    expander.filename = filename;
+    expander.origins = unit->origins;
+    expander.am_file = NULL;
+    expander.am_file_opened = FALSE;
+    init_concurrent_queue(&expander.batches, PIPELINE_QUEUE_CAPACITY);
+    if (pthread_create(&expander_thread, NULL, run_expander, &expander) != 0) {
+        printf_error("[ERROR] Unable to start the pipeline of file: %s", filename);
+        free_concurrent_queue(&expander.batches);
+        free_assembly_unit(unit);
+        free_line_origin_log(&origins);
+        return FALSE;
+    }
+
+    /* First pass over the lines while they're being expanded */
+    init_line_splitter(&splitter, unit);
+    while ((batch = (text_batch *) concurrent_queue_pop(&expander.batches)) != NULL) {
+        first_pass_text(&splitter, batch->text, batch->length);
+        free(batch);
+    }
+    finish_first_pass_text(&splitter);
+    pthread_join(expander_thread, NULL);
+    free_concurrent_queue(&expander.batches);
+    if (!expander.succeeded) {
+        free_assembly_unit(unit);
+        free_line_origin_log(&origins);
+        return FALSE;
+    }
+
+    finish_first_pass(unit);
+    trace_span("first_pass", filename, start);
+
+    if (unit->success) {
+        /* Second pass, with the resolved words formatted concurrently */
+        formatter.unit = unit;
+        formatter.path = strcat_to_new(filename, ".ob" PARTIAL_OUTPUT_SUFFIX);
+        init_concurrent_queue(&formatter.resolved, PIPELINE_QUEUE_CAPACITY);
+        if (pthread_create(&formatter_thread, NULL, run_formatter, &formatter) != 0) {
+            printf_error("[ERROR] Unable to start the pipeline of file: %s", filename);
+            unit->success = FALSE;
+        } else {
+            start = trace_now();
+            for (i = 0; i < unit->line_count; i++) {
+                second_pass_line(unit, i);
+                if (unit->success && unit->ic - IC_INIT_VALUE - published >= PIPELINE_WORD_BATCH_SIZE) {
+                    published = unit->ic - IC_INIT_VALUE;
+                    publish_resolved_words(&formatter, published);
+                }
+            }
+            if (unit->success) publish_resolved_words(&formatter, unit->icf - IC_INIT_VALUE);
+            concurrent_queue_push(&formatter.resolved, NULL);
+            trace_span("second_pass", filename, start);
+            pthread_join(formatter_thread, NULL);
+
+            /* Keep the .ob only if everything succeeded, like the sequential mode */
+            if (unit->success && formatter.succeeded) {
+                char *ob_filename = strcat_to_new(filename, ".ob");
+                rename(formatter.path, ob_filename);
+                free(ob_filename);
+                start = trace_now();
+                unit->success = write_symbol_files(filename, unit->symbol_table, &unit->external_references) &&
+                                write_optional_outputs(unit);
+                trace_span("write_outputs", filename, start);
+            } else {
+                remove(formatter.path);
+                unit->success = FALSE;
+            }
+        }
+        free_concurrent_queue(&formatter.resolved);
+        free(formatter.path);
+    }
+
+    success_flag = unit->success;
+    free_assembly_unit(unit);
+    free_line_origin_log(&origins);
+    return success_flag;
+}
+
+static void *run_expander(void *arg) {
+    expander_stage *stage = (expander_stage *) arg;
+    double start = trace_now();
+    stage->current = (text_batch *) better_malloc(sizeof(text_batch));
+    stage->current->length = 0;
+    stage->succeeded = expand_macros_to(stage->filename, batch_expanded_line, stage, NULL, stage->origins, NULL);
+    /* An empty source still gets an empty .am */
+    if (stage->succeeded && !stage->am_file_opened) open_am_file(stage);
+    if (stage->am_file_opened && stage->am_file != NULL) fclose(stage->am_file);
+
+    if (stage->current->length > 0) {
+        concurrent_queue_push(&stage->batches, stage->current);
+    } else {
+        free(stage->current);
+    }
+    concurrent_queue_push(&stage->batches, NULL);
+    trace_span("expand_macros", stage->filename, start);
+    return NULL;
+}
+
+static void batch_expanded_line(void *context, char *line) {
+    expander_stage *stage = (expander_stage *) context;
+    long length = strlen(line);
+    if (!stage->am_file_opened) open_am_file(stage);
+    if (stage->am_file != NULL) fputs(line, stage->am_file);
+
+    if (stage->current->length + length > PIPELINE_TEXT_BATCH_SIZE) {
+        concurrent_queue_push(&stage->batches, stage->current);
+        stage->current = (text_batch *) better_malloc(sizeof(text_batch));
+        stage->current->length = 0;
+    }
+    memcpy(stage->current->text + stage->current->length, line, length);
+    stage->current->length += length;
+}
+
+static void open_am_file(expander_stage *stage) {
+    char *full_filename = strcat_to_new(stage->filename, POST_MARCO_SUFFIX);
+    stage->am_file_opened = TRUE;
+    if ((stage->am_file = fopen(full_filename, "w")) == NULL) {
+        printf("Can't create or rewrite to file %s.", full_filename);
+    }
+    free(full_filename);
+}
+
+static void *run_formatter(void *arg) {
+    formatter_stage *stage = (formatter_stage *) arg;
+    ob_writer writer;
+    long from = 0, *resolved;
+    double start = trace_now();
+
+    stage->succeeded = open_ob_writer(&writer, stage->path, stage->unit->icf, stage->unit->dcf);
+    while ((resolved = (long *) concurrent_queue_pop(&stage->resolved)) != NULL) {
+        if (stage->succeeded) write_ob_code_words(&writer, stage->unit->code_img, from, *resolved);
+        from = *resolved;
+        free(resolved);
+    }
+    if (stage->succeeded) {
+        /* The data image is final since the first pass */
+        write_ob_data_words(&writer, stage->unit->data_img, stage->unit->dcf);
+        if (!close_ob_writer(&writer)) {
+            printf("Can't write to file %s.", stage->path);
+            stage->succeeded = FALSE;
+        }
+    }
+    trace_span("format_ob", stage->unit->filename, start);
+    return NULL;
+}
+
+static void publish_resolved_words(formatter_stage *stage, long index) {
+    long *resolved = (long *) better_malloc(sizeof(long));
+    *resolved = index;
+    concurrent_queue_push(&stage->resolved, resolved);
+}
@@ -0,0 +1,17 @@
+/* Pipelined assembly of a single (large) file */
+#ifndef _PIPELINE_H
+#define _PIPELINE_H
+#include "globals.h"
+#include "assembly_unit.h"
+
+/**
+ * Assembles a file with macro expansion, the first pass and .ob formatting running as concurrent stages,
+ * connected by bounded lock-free queues of text and word batches.
+ * Produces the same .am/.ob/.ext/.ent files and errors as the sequential expand_macros and process_file.
+ * @param filename The filename without extension
+ * @param options The optional outputs
+ * @return True if good False if bad
+ */
+bool assemble_file_pipelined(char *filename, assembly_options *options);
+
+#endif
@@ -6,33 +6,294 @@
 #include "helper.h"
 #include "linkedlist.h"
 #include "output_module.h"
+#include "include_cache.h"
+#include "intern_pool.h"
 
-void expand_macros(char* filename){
-    char *filename_with_ext;
-    FILE *file_des;
-    char current_line[MAX_LINE_LENGTH + 2];
-    char field[MAX_LINE_LENGTH+2];
-    bool is_macro = FALSE;
-    list_node* macro_names_list =NULL;
-    list_node *current_macro_to_add = NULL;
-    simple_node* new_file_lines =NULL;
-    //simple_node* macro_lines_temp = NULL;
+/** The directive that splices another file in, .include "file" */
+#define INCLUDE_DIRECTIVE ".include"
+
+/** A file being expanded, linked to the file that included it */
+typedef struct include_frame {
+    char *path;
+    /** Interned path, for line origins */
+    intern_id file;
+    struct include_frame *parent;
+    /** Where include errors are held, NULL prints them right away */
+    diagnostic_log *diagnostics;
+    /** Where the origins of the expanded lines go, NULL if not kept */
+    line_origin_log *origins;
+    /** Where the paths of the files it includes go, NULL if not kept */
+    include_log *includes;
+} include_frame;
+
+/** Expanded lines collected into a list */
+typedef struct expanded_lines {
+    simple_node *head;
+    /** The last line, lines are added after it */
+    simple_node *last;
+} expanded_lines;
+
+/** The macros known to an expansion, and an index of their names */
+typedef struct macro_names {
+    /** The list, in definition order */
+    list_node **list;
+    /** The last macro of the list, macros are added after it */
+    list_node *last;
+    /** Open addressing hash table of the first macro of every name, NULL for an empty slot */
+    list_node **slots;
+    /** Number of slots, a power of 2 */
+    unsigned long capacity;
+    long count;
+} macro_names;
+
+/**
+ * Expanded line handler that collects the lines into a list
+ * @param context The expanded_lines
+ * @param line The expanded line
+ */
+static void collect_expanded_line(void *context, char *line);
+
+/**
+ * Expanded line handler that collects the lines of an included module
+ * @param context The included_module
+ * @param line The expanded line
+ */
+static void collect_module_line(void *context, char *line);
+
+/**
+ * Passes an expanded line to the handler, and keeps its origin if the frame keeps origins
+ * @param frame The file being expanded
+ * @param handler The expanded line handler
+ * @param context Passed to the handler as is
+ * @param line The expanded line
+ * @param line_number The source line it came from
+ * @param macro The macro node the line came from, NULL if not from a macro
+ * @param macro_line The line in the macro body, from 1, 0 if not from a macro
+ */
+static void emit_line(include_frame *frame, expanded_line_handler handler, void *context, char *line,
+                      long line_number, list_node *macro, long macro_line);
+
+/**
+ * Expands the macros and includes of a source file's content
+ * @param text The content
+ * @param length The length of the content
+ * @param frame The file being expanded
+ * @param handler Called with every expanded line
+ * @param context Passed to the handler as is
+ * @param macros Where the macro body lines are parsed when defined, NULL to skip parsing
+ * @param names The macros known so far, the file's macros are added to it
+ * @return False if an include failed
+ */
+static bool expand_source(char *text, long length, include_frame *frame, expanded_line_handler handler,
+                          void *context, macro_ir_table *macros, macro_names *names);
+
+/**
+ * Splices an included file into the expansion, and imports its macros
+ * @param line The .include line
+ * @param frame The including file
+ * @param line_number The line number of the .include line
+ * @param handler Called with every line of the included file
+ * @param context Passed to the handler as is
+ * @param macros Where the imported macro body lines are parsed, NULL to skip parsing
+ * @param names The macros known so far, the included macros are added to it
+ * @return Whether succeeded
+ */
+static bool include_file(char *line, include_frame *frame, long line_number, expanded_line_handler handler,
+                         void *context, macro_ir_table *macros, macro_names *names);
+
+/**
+ * Initializes the macros of an expansion, with no macros
+ * @param names The macros
+ * @param list The list head the macros are added to, NULL
+ */
+static void init_macro_names(macro_names *names, list_node **list);
+
+/**
+ * Adds a macro to the end of the list. A name that's already there keeps finding the first macro.
+ * @param names The macros
+ * @param name The macro name
+ * @return The new list node
+ */
+static list_node *add_macro_name(macro_names *names, char *name);
+
+/**
+ * Finds the first macro of a name
+ * @param names The macros
+ * @param name The name
+ * @return The macro node, NULL if not a macro
+ */
+static list_node *find_macro_name(macro_names *names, char *name);
+
+/**
+ * Finds the slot of a name, or the empty slot where it belongs
+ * @param names The macros, with slots
+ * @param name_id The interned name
+ * @return Index of the slot
+ */
+static unsigned long find_macro_name_slot(macro_names *names, intern_id name_id);
+
+/**
+ * Deallocates the index of the macros, not the list
+ * @param names The macros
+ */
+static void free_macro_names(macro_names *names);
+
+/**
+ * Gets an included file from the cache, expanding it if it's not there yet
+ * @param path The path of the included file
+ * @param frame The including file
+ * @param line_number The line number of the .include line, for errors
+ * @return The module, NULL if the file couldn't be read or expanded
+ */
+static included_module *load_included_module(char *path, include_frame *frame, long line_number);
+
+/**
+ * @param line A source line
+ * @return Whether the line is an .include directive
+ */
+static bool is_include_line(char *line);
+
+/**
+ * Gets the path of the file in an .include line
+ * @param line The .include line
+ * @param frame The including file, relative paths are relative to its directory
+ * @param line_number The line number, for errors
+ * @return The path (allocated), NULL if the line isn't valid
+ */
+static char *get_include_path(char *line, include_frame *frame, long line_number);
+
+/**
+ * Prints, or holds in the frame's log, an error of an .include line
+ * @param frame The including file
+ * @param line_number The line number of the .include line
+ * @param message The message format, with a single %s
+ * @param argument The %s argument
+ */
+static void report_include_error(include_frame *frame, long line_number, char *message, char *argument);
 
+/**
+ * Reads the next line of a content, exactly like fgets with MAX_LINE_LENGTH + 2 would
+ * @param cursor Pointer to the current position, advanced past the line
+ * @param end The end of the content
+ * @param line_buff Buffer of MAX_LINE_LENGTH + 2 chars
+ * @param line_number Pointer to the line number, advanced when a new line starts
+ * @return False at the end of the content
+ */
+static bool next_source_line(char **cursor, char *end, char *line_buff, long *line_number);
+
+/**
+ * Reads a whole file
+ * @param path The path of the file
+ * @param length Set to the length of the content
+ * @return The content (allocated), NULL if the file couldn't be opened
+ */
+static char *read_source_file(char *path, long *length);
+
+bool expand_macros(char* filename, macro_ir_table *macros, line_origin_log *origins, include_log *includes){
+    expanded_lines new_file_lines;
+    new_file_lines.head = new_file_lines.last = NULL;
+
+    if (!expand_macros_to(filename, collect_expanded_line, &new_file_lines, macros, origins, includes)) return FALSE;
+    /* Write the macro to file with POST_MACRO_SUFFIX */
+    write_macro_file(new_file_lines.head,filename);
+    return TRUE;
+}
+
+static void collect_expanded_line(void *context, char *line) {
+    expanded_lines *lines = (expanded_lines *) context;
+    lines->last = insert_string_node_after(&lines->head, lines->last, line);
+}
+
+bool expand_macros_to(char* filename, expanded_line_handler handler, void *context, macro_ir_table *macros,
+                      line_origin_log *origins, include_log *includes){
+    char *filename_with_ext, *text;
+    long length;
+    bool succeeded;
+    list_node* macro_names_list =NULL;
+    macro_names names;
+    include_frame frame;
 
     filename_with_ext = strcat_to_new(filename, PRE_MARCO_SUFFIX);
 
-    /* Try to open file, if something wrong skip */
-    if ((file_des = fopen(filename_with_ext, "r")) == NULL) {
+    /* Try to read file, if something wrong skip */
+    if ((text = read_source_file(filename_with_ext, &length)) == NULL) {
         /* if file couldn't be opened, write to stderr. */
         printf_error("[ERROR] Unable to read file: %s\n", filename);
         free(filename_with_ext); /*free the memory we allocated to the string concat */
-        return;
+        return FALSE;
     }
 
-    /* We'll iterate line by line and write non macro lines to the filename.POST_MACRO_SUFFIX file */
+    frame.path = filename_with_ext;
+    frame.file = intern_string(filename_with_ext);
+    frame.parent = NULL;
+    frame.diagnostics = NULL;
+    frame.origins = origins;
+    frame.includes = includes;
+    init_macro_names(&names, &macro_names_list);
+    succeeded = expand_source(text, length, &frame, handler, context, macros, &names);
+    free_macro_names(&names);
+    free(text);
+    free(filename_with_ext);
+    return succeeded;
+}
+
+bool preload_includes(char *filename) {
+    char *filename_with_ext, *text, *cursor, *end;
+    char current_line[MAX_LINE_LENGTH + 2];
+    char field[MAX_LINE_LENGTH+2];
+    long length, line_number = 0;
+    bool is_macro = FALSE;
+    diagnostic_log ignored;
+    include_frame frame;
+
+    filename_with_ext = strcat_to_new(filename, PRE_MARCO_SUFFIX);
+    if ((text = read_source_file(filename_with_ext, &length)) == NULL) {
+        free(filename_with_ext);
+        return FALSE;
+    }
+
+    /* The errors are printed when the file is assembled */
+    init_diagnostic_log(&ignored);
+    frame.path = filename_with_ext;
+    frame.file = intern_string(filename_with_ext);
+    frame.parent = NULL;
+    frame.diagnostics = &ignored;
+    frame.origins = NULL;
+    frame.includes = NULL;
+    for (cursor = text, end = text + length; next_source_line(&cursor, end, current_line, &line_number);) {
+        get_first_field(current_line, field);
+        if (strcmp("endm", field) == 0) {
+            is_macro = FALSE;
+        } else if (is_macro) {
+            continue;
+        } else if (strcmp("macro", field) == 0) {
+            is_macro = TRUE;
+        } else if (is_include_line(current_line)) {
+            char *path = get_include_path(current_line, &frame, line_number);
+            if (path != NULL) load_included_module(path, &frame, line_number);
+            free(path);
+        }
+    }
+    free_diagnostic_log(&ignored);
+    free(text);
+    free(filename_with_ext);
+    return TRUE;
+}
+
+static bool expand_source(char *text, long length, include_frame *frame, expanded_line_handler handler,
+                          void *context, macro_ir_table *macros, macro_names *names) {
+    char current_line[MAX_LINE_LENGTH + 2];
+    char field[MAX_LINE_LENGTH+2];
+    char *cursor = text, *end = text + length;
+    long line_number = 0;
+    bool is_macro = FALSE, succeeded = TRUE;
+    list_node *current_macro_to_add = NULL;
+    simple_node *last_macro_line = NULL;
+
+    /* We'll iterate line by line and pass non macro lines to the handler */
     /* Remember there are no check for line integrity in this step*/
 
-    while (fgets(current_line, MAX_LINE_LENGTH + 2, file_des) != NULL) {
+    while (next_source_line(&cursor, end, current_line, &line_number)) {
         int index = 0;
         list_node *current_node = NULL;
 
@@ -40,7 +301,7 @@ void expand_macros(char* filename){
         /* Detect if we are in a comment or an empty line */
         if (!current_line[index] || current_line[index] == '\n' || current_line[index] == EOF ||
             current_line[index] == ';') {
-            insert_string_node_at_the_end(&new_file_lines,current_line);
+            emit_line(frame, handler, context, current_line, line_number, NULL, 0);
             continue;
         }
 
@@ -49,28 +310,288 @@ void expand_macros(char* filename){
         if(strcmp("endm",field) == 0 ){
             is_macro =FALSE;
         } else if(is_macro){
-            insert_string_node_at_the_end(&(current_macro_to_add->macro_lines),current_line);
+            last_macro_line = insert_string_node_after(&(current_macro_to_add->macro_lines), last_macro_line,
+                                                       current_line);
+            /* Parse the body once here, instead of at every use */
+            if (macros != NULL) define_macro_line(macros, current_line);
         } else if(strcmp("macro",field) == 0) {
             is_macro = TRUE;
             get_first_field(current_line+index,field);
-            current_macro_to_add = insert_node_list_at_the_end(&macro_names_list, field);
+            current_macro_to_add = add_macro_name(names, field);
+            last_macro_line = NULL;
+        }
+
+        else if (is_include_line(current_line)) {
+            if (!include_file(current_line, frame, line_number, handler, context, macros, names)) {
+                succeeded = FALSE;
+            }
         }
 
-        else if ((current_node = find_node_in_list(macro_names_list,field)) !=NULL){
+        else if ((current_node = find_macro_name(names, field)) !=NULL){
             simple_node *perv;
             simple_node *macro_lines_temp = current_node->macro_lines;
+            long macro_line = 0;
             while(macro_lines_temp != NULL){
-                insert_string_node_at_the_end(&new_file_lines,macro_lines_temp->data);
+                emit_line(frame, handler, context, macro_lines_temp->data, line_number, current_node, ++macro_line);
                 perv = macro_lines_temp;
                 macro_lines_temp = macro_lines_temp->next;
                 free_string_node(&perv);
             }
         } else{
-            insert_string_node_at_the_end(&new_file_lines,current_line);
+            emit_line(frame, handler, context, current_line, line_number, NULL, 0);
         }
 
     }
+    return succeeded;
+}
 
-    /* Write the macro to file with POST_MACRO_SUFFIX */
-    write_macro_file(new_file_lines,filename);
-}
\ No newline at end of file
+static bool include_file(char *line, include_frame *frame, long line_number, expanded_line_handler handler,
+                         void *context, macro_ir_table *macros, macro_names *names) {
+    char *path = get_include_path(line, frame, line_number);
+    included_module *module;
+    list_node *macro;
+    long i;
+
+    if (path == NULL) return FALSE;
+    /* Logged before reading, so a file that can't be read is in the log too */
+    if (frame->includes != NULL) add_include_path(frame->includes, path);
+    module = load_included_module(path, frame, line_number);
+    free(path);
+    if (module == NULL) return FALSE;
+    for (i = 0; frame->includes != NULL && i < module->includes.count; i++) {
+        add_include_path(frame->includes, module->includes.paths[i]);
+    }
+
+    for (i = 0; i < module->line_count; i++) {
+        handler(context, module->lines[i]);
+        if (frame->origins != NULL) add_line_origin(frame->origins, module->origins.origins[i], module->lines[i]);
+    }
+    /* The included macros can be used from here on */
+    for (macro = module->macros; macro != NULL; macro = macro->next) {
+        simple_node *macro_line, *last_macro_line = NULL;
+        list_node *imported = add_macro_name(names, macro->data);
+        for (macro_line = macro->macro_lines; macro_line != NULL; macro_line = macro_line->next) {
+            last_macro_line = insert_string_node_after(&imported->macro_lines, last_macro_line, macro_line->data);
+            if (macros != NULL) define_macro_line(macros, macro_line->data);
+        }
+    }
+    return TRUE;
+}
+
+static included_module *load_included_module(char *path, include_frame *frame, long line_number) {
+    char *text;
+    long length;
+    unsigned long content_hash;
+    include_frame *including;
+    included_module *module;
+    include_frame module_frame;
+    macro_names names;
+
+    for (including = frame; including != NULL; including = including->parent) {
+        if (strcmp(including->path, path) == 0) {
+            report_include_error(frame, line_number, "[ERROR] Including %s creates an include cycle.", path);
+            return NULL;
+        }
+    }
+    if ((text = read_source_file(path, &length)) == NULL) {
+        report_include_error(frame, line_number, "[ERROR] Unable to read included file: %s", path);
+        return NULL;
+    }
+
+    /* A file is expanded once per run, unless its content changed */
+    content_hash = intern_hash(text, (int) length);
+    if ((module = find_included_module(path, content_hash)) != NULL) {
+        free(text);
+        return module;
+    }
+
+    module = (included_module *) better_malloc(sizeof(included_module));
+    module->path = strcat_to_new(path, "");
+    module->content_hash = content_hash;
+    module->lines = NULL;
+    module->line_count = 0;
+    module->macros = NULL;
+    module->next = NULL;
+    init_line_origin_log(&module->origins);
+    init_include_log(&module->includes);
+    module_frame.path = module->path;
+    module_frame.file = intern_string(module->path);
+    module_frame.parent = frame;
+    module_frame.diagnostics = frame->diagnostics;
+    /* Kept for every module, since any including file may need them */
+    module_frame.origins = &module->origins;
+    module_frame.includes = &module->includes;
+    /* Expanded on its own, the macros of the including file aren't known in it */
+    init_macro_names(&names, &module->macros);
+    if (!expand_source(text, length, &module_frame, collect_module_line, module, NULL, &names)) {
+        free_included_module(module);
+        module = NULL;
+    }
+    free_macro_names(&names);
+    free(text);
+    return module != NULL ? add_included_module(module) : NULL;
+}
+
+static void emit_line(include_frame *frame, expanded_line_handler handler, void *context, char *line,
+                      long line_number, list_node *macro, long macro_line) {
+    handler(context, line);
+    if (frame->origins != NULL) {
+        line_origin origin;
+        origin.file = frame->file;
+        origin.line = line_number;
+        origin.macro = macro != NULL ? macro->data_id : NO_INTERN_ID;
+        origin.macro_line = macro_line;
+        add_line_origin(frame->origins, origin, line);
+    }
+}
+
+static void collect_module_line(void *context, char *line) {
+    included_module *module = (included_module *) context;
+    /* Grow at powers of 2 */
+    if ((module->line_count & (module->line_count - 1)) == 0) {
+        char **grown = (char **) better_malloc((module->line_count ? module->line_count * 2 : 1) * sizeof(char *));
+        if (module->line_count) memcpy(grown, module->lines, module->line_count * sizeof(char *));
+        free(module->lines);
+        module->lines = grown;
+    }
+    module->lines[module->line_count++] = strcat_to_new(line, "");
+}
+
+static bool is_include_line(char *line) {
+    int i = 0;
+    SKIP_TO_NEXT_NON_WHITESPACE(line, i)
+    return strncmp(line + i, INCLUDE_DIRECTIVE, strlen(INCLUDE_DIRECTIVE)) == 0 &&
+           (line[i + strlen(INCLUDE_DIRECTIVE)] == ' ' || line[i + strlen(INCLUDE_DIRECTIVE)] == '\t');
+}
+
+static char *get_include_path(char *line, include_frame *frame, long line_number) {
+    int i = 0, start, directory_length;
+    char *path;
+    SKIP_TO_NEXT_NON_WHITESPACE(line, i)
+    i += strlen(INCLUDE_DIRECTIVE);
+    SKIP_TO_NEXT_NON_WHITESPACE(line, i)
+    if (line[i] != '"') {
+        report_include_error(frame, line_number, "[ERROR] Expected a quoted file name after %s", INCLUDE_DIRECTIVE);
+        return NULL;
+    }
+    for (start = ++i; line[i] && line[i] != '"' && line[i] != '\n'; i++);
+    if (line[i] != '"' || i == start) {
+        report_include_error(frame, line_number, "[ERROR] Expected a quoted file name after %s", INCLUDE_DIRECTIVE);
+        return NULL;
+    }
+    line[i] = '\0';
+    /* Relative paths are relative to the including file's directory */
+    directory_length = line[start] == '/' || strrchr(frame->path, '/') == NULL ? 0 :
+                       (int) (strrchr(frame->path, '/') - frame->path) + 1;
+    path = (char *) better_malloc(directory_length + (i - start) + 1);
+    memcpy(path, frame->path, directory_length);
+    strcpy(path + directory_length, line + start);
+    line[i] = '"';
+    for (i++; line[i] == ' ' || line[i] == '\t'; i++);
+    if (line[i] && line[i] != '\n') {
+        report_include_error(frame, line_number, "[ERROR] Extraneous text after %s file name", INCLUDE_DIRECTIVE);
+        free(path);
+        return NULL;
+    }
+    return path;
+}
+
+static void report_include_error(include_frame *frame, long line_number, char *message, char *argument) {
+    line_descriptor line;
+    line.line_number = line_number;
+    line.full_file_name = frame->path;
+    line.content = "";
+    line.diagnostics = frame->diagnostics;
+    fprintf_error_specific(line, message, argument);
+}
+
+static bool next_source_line(char **cursor, char *end, char *line_buff, long *line_number) {
+    int length = 0;
+    if (*cursor == end) return FALSE;
+    if (*line_number == 0 || (*cursor)[-1] == '\n') (*line_number)++;
+    /* Like fgets with MAX_LINE_LENGTH + 2, a longer line is read in parts */
+    while (*cursor < end && length < MAX_LINE_LENGTH + 1) {
+        line_buff[length++] = **cursor;
+        if (*((*cursor)++) == '\n') break;
+    }
+    line_buff[length] = '\0';
+    return TRUE;
+}
+
+static char *read_source_file(char *path, long *length) {
+    FILE *file_des;
+    long capacity = 4096;
+    char *text;
+    size_t read_count;
+
+    if ((file_des = fopen(path, "r")) == NULL) return NULL;
+    text = (char *) better_malloc(capacity);
+    *length = 0;
+    while ((read_count = fread(text + *length, 1, capacity - *length, file_des)) > 0) {
+        *length += (long) read_count;
+        if (*length == capacity) {
+            char *grown = (char *) better_malloc(capacity * 2);
+            memcpy(grown, text, *length);
+            free(text);
+            text = grown;
+            capacity *= 2;
+        }
+    }
+    fclose(file_des);
+    return text;
+}
+
+static void init_macro_names(macro_names *names, list_node **list) {
+    names->list = list;
+    names->last = NULL;
+    names->slots = NULL;
+    names->capacity = 0;
+    names->count = 0;
+}
+
+static list_node *add_macro_name(macro_names *names, char *name) {
+    list_node *macro = insert_node_list_after(names->list, names->last, name);
+    unsigned long slot;
+    names->last = macro;
+    if ((unsigned long) (names->count + 1) * 2 > names->capacity) {
+        /* Double the slots, so the table is at most half full */
+        list_node **old_slots = names->slots;
+        unsigned long old_capacity = names->capacity, i;
+        names->capacity = old_capacity ? old_capacity * 2 : 16;
+        names->slots = (list_node **) better_malloc(names->capacity * sizeof(list_node *));
+        memset(names->slots, 0, names->capacity * sizeof(list_node *));
+        for (i = 0; i < old_capacity; i++) {
+            if (old_slots[i] != NULL) names->slots[find_macro_name_slot(names, old_slots[i]->data_id)] = old_slots[i];
+        }
+        free(old_slots);
+    }
+    slot = find_macro_name_slot(names, macro->data_id);
+    /* A macro defined again keeps using the first definition, like the list did */
+    if (names->slots[slot] == NULL) {
+        names->slots[slot] = macro;
+        names->count++;
+    }
+    return macro;
+}
+
+static list_node *find_macro_name(macro_names *names, char *name) {
+    /* A name that was never interned isn't a macro */
+    intern_id name_id = find_interned(name, (int) strlen(name));
+    if (name_id == NO_INTERN_ID || names->capacity == 0) return NULL;
+    return names->slots[find_macro_name_slot(names, name_id)];
+}
+
+static unsigned long find_macro_name_slot(macro_names *names, intern_id name_id) {
+    unsigned long slot = ((unsigned long) name_id * 2654435761UL) & (names->capacity - 1);
+    while (names->slots[slot] != NULL && names->slots[slot]->data_id != name_id) {
+        slot = (slot + 1) & (names->capacity - 1);
+    }
+    return slot;
+}
+
+static void free_macro_names(macro_names *names) {
+    free(names->slots);
+    names->slots = NULL;
+    names->capacity = 0;
+    names->count = 0;
+}
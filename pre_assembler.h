@@ -1,6 +1,46 @@
 #ifndef ASSEMBLER_PRE_ASSEMBLER_H
 #define ASSEMBLER_PRE_ASSEMBLER_H
 
-void expand_macros(char* filename);
+#include "globals.h"
+#include "macro_ir.h"
+#include "line_map.h"
+#include "include_cache.h"
 
-#endif //ASSEMBLER_PRE_ASSEMBLER_H
+/** Receives the expanded source line by line, in order */
+typedef void (*expanded_line_handler)(void *context, char *line);
+
+/***
+ * Expands the macros and includes of filename.as into filename.am
+ * @param filename The filename without extension
+ * @param macros Where the macro body lines are parsed when defined, NULL to skip parsing
+ * @param origins Where the origins of the expanded lines are added, NULL if not kept
+ * @param includes Where the paths of the included files are added, even of those that couldn't be read,
+ *                 NULL if not kept
+ * @return False if the source file couldn't be read or an include failed, no filename.am is written then
+ */
+bool expand_macros(char* filename, macro_ir_table *macros, line_origin_log *origins, include_log *includes);
+
+/***
+ * Expands the macros of filename.as, passing each output line to the handler instead of writing a file.
+ * The files of .include "file" lines are spliced in, each file is expanded once per run and its macros imported.
+ * @param filename The filename without extension
+ * @param handler Called with every expanded line (including its '\n' if exists)
+ * @param context Passed to the handler as is
+ * @param macros Where the macro body lines are parsed when defined, NULL to skip parsing
+ * @param origins Where the origins of the expanded lines are added, NULL if not kept
+ * @param includes Where the paths of the included files are added, even of those that couldn't be read,
+ *                 NULL if not kept
+ * @return False if the source file couldn't be read or an include failed
+ */
+bool expand_macros_to(char* filename, expanded_line_handler handler, void *context, macro_ir_table *macros,
+                      line_origin_log *origins, include_log *includes);
+
+/***
+ * Reads the files included by filename.as into the include cache, without expanding it.
+ * Used before starting workers, so they all share the cached files. Errors are left to the expansion.
+ * @param filename The filename without extension
+ * @return False if the source file couldn't be read
+ */
+bool preload_includes(char *filename);
+
+#endif /* ASSEMBLER_PRE_ASSEMBLER_H */
@@ -5,18 +5,20 @@
 #include "helper.h"
 #include "string.h"
 
-int process_second_pass_operand(line_descriptor line, long *curr_ic, char *operand, machine_word **code_img,
-                                table *symbol_table);
+int process_second_pass_operand(line_descriptor line, long *curr_ic, operand_view *operand, machine_word **code_img,
+                                table *symbol_table, external_reference_log *external_references);
 
 /**
  * Processes a single line in the second pass
  * @param line The line string
  * @param ic  pointer to instruction counter
- * @param code_img Code image
+ * @param code_img Code image, NULL to only look the operand symbols up (--check)
  * @param symbol_table The symbol table
+ * @param external_references Log of the external symbol uses, appended to
  * @return Whether operation succeeded
  */
-bool process_line_second_pass(line_descriptor line, long *ic, machine_word **code_img, table *symbol_table) {
+bool process_line_second_pass(line_descriptor line, long *ic, machine_word **code_img, table *symbol_table,
+                              external_reference_log *external_references) {
 	char symbol[MAX_LABEL_LENGTH];
 	long i = 0;
 
@@ -66,27 +68,30 @@ bool process_line_second_pass(line_descriptor line, long *ic, machine_word **cod
 		}
 		return TRUE;
 	}
-	return add_symbol_to_machine_code(line, ic, code_img, symbol_table);
+	return add_symbol_to_machine_code(line, ic, code_img, symbol_table, external_references);
 }
 
 /***
   * populate the missing values in the code image
   * @param line Proceesed line
-  * @param ic pointer to ic counter
-  * @param code_img code image array
+  * @param ic pointer to ic counter, not moved without a code image
+  * @param code_img code image array, NULL to only look the operand symbols up (--check)
   * @param symbol_table symbol_table pointer
+  * @param external_references Log of the external symbol uses, appended to
   * @return
   */
-bool add_symbol_to_machine_code(line_descriptor line, long *ic, machine_word **code_img, table *symbol_table) {
+bool add_symbol_to_machine_code(line_descriptor line, long *ic, machine_word **code_img, table *symbol_table,
+                                external_reference_log *external_references) {
 	char temp[80];
-	char *operands[2];
+	operand_view operands[2];
 	int i = 0, operand_count;
 	bool isvalid = TRUE;
 	long curr_ic = (*ic)+1; /* we need to change the values we left null inside an already built array so we'll work temp counter */
-	/* Get the total word length of current code text line in code binary image */
-	int length = code_img[(*ic) - IC_INIT_VALUE]->length;
+	/* Get the total word length of current code text line in code binary image. Without it (--check) the caller
+	 * only passes lines that have operand words. */
+	int length = code_img != NULL ? code_img[(*ic) - IC_INIT_VALUE]->length : 0;
 	/* if the length is 1, then there's only the code word, no data. */
-	if (length > 1) {
+	if (code_img == NULL || length > 1) {
 		/* Now, we need to skip command, and get the operands themselves: */
 		SKIP_TO_NEXT_NON_WHITESPACE(line.content, i)
         find_and_validate_label(line, temp);
@@ -105,22 +110,15 @@ bool add_symbol_to_machine_code(line_descriptor line, long *ic, machine_word **c
         analyze_operands(line, i, operands, &operand_count);
 		/* Process operands, if needed. if failed return failure. otherwise continue */
 		if (operand_count--) {
-			isvalid = process_second_pass_operand(line, &curr_ic, operands[0], code_img, symbol_table);
-			free(operands[0]);
-			if (!isvalid) {
-                if(operand_count){
-                    free(operands[1]);
-                }
-                return FALSE;
-            }
+			isvalid = process_second_pass_operand(line, &curr_ic, &operands[0], code_img, symbol_table, external_references);
+			if (!isvalid) return FALSE;
 			if (operand_count) {
-				isvalid = process_second_pass_operand(line, &curr_ic, operands[1], code_img, symbol_table);
-				free(operands[1]);
+				isvalid = process_second_pass_operand(line, &curr_ic, &operands[1], code_img, symbol_table, external_references);
 				if (!isvalid) return FALSE;
 			}
 		}
 	}
-	/* Make the current pass IC as the next line ic */
+	/* Make the current pass IC as the next line ic, the caller knows it without an image */
 	(*ic) = (*ic) + length;
 	return TRUE;
 }
@@ -129,12 +127,14 @@ bool add_symbol_to_machine_code(line_descriptor line, long *ic, machine_word **c
 /**
  * Builds the additional data word for operand in the second pass, if needed.
  * @param curr_ic Current instruction pointer of source code line
- * @param operand The operand string
- * @param code_img The code image array
+ * @param operand The operand's view
+ * @param code_img The code image array, NULL to only look the symbol up
  * @param symbol_table The symbol table
+ * @param external_references Log of the external symbol uses, appended to
  * @return Whether succeeded
  */
-int process_second_pass_operand(line_descriptor line, long *curr_ic, char *operand, machine_word **code_img, table *symbol_table) {
+int process_second_pass_operand(line_descriptor line, long *curr_ic, operand_view *operand, machine_word **code_img, table *symbol_table,
+                                external_reference_log *external_references) {
     addressing_type addr = get_addressing_type(operand);
     machine_word *machine_base_word, *machine_offset_word;
     /* We already handled immediate addressing, we can keep going */
@@ -143,27 +143,24 @@ int process_second_pass_operand(line_descriptor line, long *curr_ic, char *opera
     }
 
     if (DIRECT_ADDR == addr || INDEX_ADDR == addr) {
-        char* search_operand = operand;
-        if(INDEX_ADDR == addr){
-            search_operand = extract_index_addressing_label(operand);
-        }
+        /* The label (without [rN]) was validated by the first pass, so it fits */
+        char search_operand[MAX_LABEL_LENGTH + 1];
         bool is_external = FALSE;
-        table_entry *entry = find_by_types(*symbol_table, search_operand, 3, DATA_SYMBOL, CODE_SYMBOL, EXTERNAL_SYMBOL);
-
-        if(INDEX_ADDR == addr){
-            free(search_operand);
-            search_operand =operand;
-        }
+        table_entry *entry;
+        memcpy(search_operand, operand->text, operand->label_length);
+        search_operand[operand->label_length] = '\0';
+        entry = find_by_types(*symbol_table, search_operand, 3, DATA_SYMBOL, CODE_SYMBOL, EXTERNAL_SYMBOL);
 
         if (entry == NULL) {
-            fprintf_error_specific(line, "[ERROR] Cant find symbol %s in second pass", search_operand);
+            fprintf_error_specific(line, "[ERROR] Cant find symbol %.*s in second pass", operand->length, operand->text);
             return FALSE;
 
         }
+        if (code_img == NULL) return TRUE;
 
         if (entry->type == EXTERNAL_SYMBOL) {
             is_external = TRUE;
-            add_table_item(symbol_table, operand, (*curr_ic) + 1, EXTERNAL_REFERENCE);
+            add_external_reference(external_references, entry, (*curr_ic) + 1);
         }
 
         machine_base_word = (machine_word *) better_malloc(sizeof(machine_word));
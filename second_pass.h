@@ -8,20 +8,24 @@
  * Processes a single line in the second pass
  * @param line The line string
  * @param ic  pointer to instruction counter
- * @param code_img Code image
+ * @param code_img Code image, NULL to only look the operand symbols up (--check)
  * @param symbol_table The symbol table
+ * @param external_references Log of the external symbol uses, appended to
  * @return Whether operation succeeded
  */
-bool process_line_second_pass(line_descriptor line, long *ic, machine_word **code_img, table *symbol_table);
+bool process_line_second_pass(line_descriptor line, long *ic, machine_word **code_img, table *symbol_table,
+                              external_reference_log *external_references);
 
 /***
   * populate the missing values in the code image
   * @param line Proceesed line
-  * @param ic pointer to ic counter
-  * @param code_img code image array
+  * @param ic pointer to ic counter, not moved without a code image
+  * @param code_img code image array, NULL to only look the operand symbols up (--check)
   * @param symbol_table symbol_table pointer
+  * @param external_references Log of the external symbol uses, appended to
   * @return
   */
-bool add_symbol_to_machine_code(line_descriptor line, long *ic, machine_word **code_img, table *symbol_table);
+bool add_symbol_to_machine_code(line_descriptor line, long *ic, machine_word **code_img, table *symbol_table,
+                                external_reference_log *external_references);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,198 @@
+/* String literal pooling - labeled .string literals share their copies in the data image */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "string_pool.h"
+#include "helper.h"
+#include "instruction_builder.h"
+
+/** The data of a single data label */
+typedef struct label_block {
+    table_entry *symbol;
+    /** Data image index of the label, and the index after its last word */
+    long start, end;
+    /** Whether the block is exactly a .string literal, with its terminator */
+    bool is_literal;
+    /** Where the block was copied in the compacted image, -1 if not yet */
+    long new_start;
+} label_block;
+
+/** A suffix of a literal in the suffix table */
+typedef struct literal_suffix {
+    /** The longest literal that ends with the suffix, -1 for an empty slot */
+    long block;
+    /** Where the suffix starts in that literal */
+    long start;
+    long length;
+    unsigned long hash;
+} literal_suffix;
+
+/**
+ * Marks the blocks that are exactly a .string literal
+ * @param unit The unit
+ * @param blocks The blocks of the data labels, in order
+ * @param block_count The amount of blocks
+ * @return False if the labeled data lines don't match the data labels, nothing is pooled then
+ */
+static bool find_literal_blocks(assembly_unit *unit, label_block *blocks, long block_count);
+
+/**
+ * Finds the slot of a suffix, or the empty slot where it belongs
+ * @param unit The unit
+ * @param blocks The blocks
+ * @param suffixes The suffix table
+ * @param capacity The table size, a power of 2
+ * @param words The suffix words
+ * @param length The suffix length
+ * @param hash The suffix hash
+ * @return Index of the slot
+ */
+static unsigned long find_suffix_slot(assembly_unit *unit, label_block *blocks, literal_suffix *suffixes,
+                                      unsigned long capacity, long *words, long length, unsigned long hash);
+
+long pool_string_literals(assembly_unit *unit) {
+    label_block *blocks;
+    literal_suffix *suffixes;
+    table_entry *entry;
+    long block_count = 0, literal_words = 0, length = 0, saved, i, k, *pooled;
+    unsigned long capacity = 16;
+
+    for (entry = unit->symbol_table; entry != NULL; entry = entry->next) {
+        if (entry->type == DATA_SYMBOL) block_count++;
+    }
+    if (block_count == 0) return 0;
+    blocks = (label_block *) better_malloc(block_count * sizeof(label_block));
+    /* The table is sorted by value, so are the blocks */
+    for (i = 0, entry = unit->symbol_table; entry != NULL; entry = entry->next) {
+        if (entry->type != DATA_SYMBOL) continue;
+        blocks[i].symbol = entry;
+        blocks[i].start = entry->value;
+        blocks[i].new_start = -1;
+        if (i > 0) blocks[i - 1].end = blocks[i].start;
+        i++;
+    }
+    blocks[block_count - 1].end = unit->dc;
+    if (!find_literal_blocks(unit, blocks, block_count)) {
+        free(blocks);
+        return 0;
+    }
+
+    /* Every suffix of every literal, with the longest literal that ends with it */
+    for (i = 0; i < block_count; i++) {
+        if (blocks[i].is_literal) literal_words += blocks[i].end - blocks[i].start;
+    }
+    while (capacity < 2 * (unsigned long) literal_words) capacity *= 2;
+    suffixes = (literal_suffix *) better_malloc(capacity * sizeof(literal_suffix));
+    for (i = 0; i < (long) capacity; i++) {
+        suffixes[i].block = -1;
+    }
+    for (i = 0; i < block_count; i++) {
+        long *words = unit->data_img + blocks[i].start, literal_length = blocks[i].end - blocks[i].start;
+        unsigned long hash = 0;
+        if (!blocks[i].is_literal) continue;
+        for (k = literal_length - 1; k >= 0; k--) {
+            literal_suffix *suffix;
+            hash = (hash * 31 + (unsigned long) words[k]) & 0xffffffffUL;
+            suffix = &suffixes[find_suffix_slot(unit, blocks, suffixes, capacity, words + k, literal_length - k,
+                                                hash)];
+            if (suffix->block == -1 ||
+                literal_length > blocks[suffix->block].end - blocks[suffix->block].start) {
+                suffix->block = i;
+                suffix->start = k;
+                suffix->length = literal_length - k;
+                suffix->hash = hash;
+            }
+        }
+    }
+
+    /* Compact into a new image, a literal is replaced by the place in its longest literal's copy */
+    pooled = (long *) better_malloc((unit->dc + 1) * sizeof(long));
+    free(unit->literal_splits);
+    unit->literal_splits = (long *) better_malloc(block_count * sizeof(long));
+    unit->literal_split_count = 0;
+    memcpy(pooled, unit->data_img, blocks[0].start * sizeof(long));
+    length = blocks[0].start;
+    for (i = 0; i < block_count; i++) {
+        long block_length = blocks[i].end - blocks[i].start, value;
+        if (blocks[i].is_literal) {
+            long *words = unit->data_img + blocks[i].start;
+            unsigned long hash = 0;
+            literal_suffix *suffix;
+            label_block *owner;
+            for (k = block_length - 1; k >= 0; k--) hash = (hash * 31 + (unsigned long) words[k]) & 0xffffffffUL;
+            suffix = &suffixes[find_suffix_slot(unit, blocks, suffixes, capacity, words, block_length, hash)];
+            owner = &blocks[suffix->block];
+            if (owner->new_start == -1) {
+                owner->new_start = length;
+                memcpy(pooled + length, unit->data_img + owner->start, (owner->end - owner->start) * sizeof(long));
+                length += owner->end - owner->start;
+            }
+            value = owner->new_start + suffix->start;
+            /* The longer literal's label now ends where this one starts */
+            if (suffix->start > 0) unit->literal_splits[unit->literal_split_count++] = value;
+        } else {
+            value = length;
+            memcpy(pooled + length, unit->data_img + blocks[i].start, block_length * sizeof(long));
+            length += block_length;
+        }
+        set_table_item_value(unit->symbol_table, blocks[i].symbol, value);
+    }
+    memcpy(unit->data_img, pooled, length * sizeof(long));
+    free(pooled);
+    free(suffixes);
+    free(blocks);
+    /* Labels of shared copies are out of order now */
+    sort_table_by_value(&unit->symbol_table);
+
+    saved = unit->dc - length;
+    unit->dc = length;
+    return saved;
+}
+
+static bool find_literal_blocks(assembly_unit *unit, label_block *blocks, long block_count) {
+    char symbol[MAX_LINE_LENGTH + 2];
+    diagnostic_log ignored;
+    long line_index, block = 0;
+
+    init_diagnostic_log(&ignored);
+    /* Data labels are defined in the order of the data, so the n-th labeled data line is the n-th block */
+    for (line_index = 0; line_index < unit->line_count; line_index++) {
+        line_descriptor line = get_unit_line(unit, line_index);
+        instruction instruction;
+        int i = 0;
+        line.diagnostics = &ignored;
+        SKIP_TO_NEXT_NON_WHITESPACE(line.content, i)
+        if (!line.content[i] || line.content[i] == '\n' || line.content[i] == EOF || line.content[i] == ';') continue;
+        if (find_and_validate_label(line, symbol) || symbol[0] == '\0') continue;
+        i = index_of_char(line.content, ':') + 1;
+        SKIP_TO_NEXT_NON_WHITESPACE(line.content, i)
+        instruction = parse_instruction_from_index(line, &i);
+        if (instruction != DATA_INST && instruction != STRING_INST) continue;
+        if (block == block_count) break;
+        blocks[block].is_literal = FALSE;
+        if (instruction == STRING_INST) {
+            long *words = unit->data_img + blocks[block].start, literal_length;
+            long block_length = blocks[block].end - blocks[block].start;
+            /* Data after the literal without a label of its own may be reached through the literal's label */
+            for (literal_length = 0; literal_length < block_length && words[literal_length] != '\0'; literal_length++);
+            blocks[block].is_literal = blocks[block].start + literal_length + 1 == blocks[block].end;
+        }
+        block++;
+    }
+    free_diagnostic_log(&ignored);
+    return block == block_count && line_index == unit->line_count;
+}
+
+static unsigned long find_suffix_slot(assembly_unit *unit, label_block *blocks, literal_suffix *suffixes,
+                                      unsigned long capacity, long *words, long length, unsigned long hash) {
+    unsigned long slot = hash & (capacity - 1);
+    /* Linear probing, the table is never full */
+    for (; suffixes[slot].block != -1; slot = (slot + 1) & (capacity - 1)) {
+        literal_suffix *suffix = &suffixes[slot];
+        if (suffix->hash == hash && suffix->length == length &&
+            memcmp(unit->data_img + blocks[suffix->block].start + suffix->start, words, length * sizeof(long)) == 0) {
+            break;
+        }
+    }
+    return slot;
+}
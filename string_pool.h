@@ -0,0 +1,17 @@
+/* String literal pooling - labeled .string literals share their copies in the data image */
+#ifndef _STRING_POOL_H
+#define _STRING_POOL_H
+#include "assembly_unit.h"
+
+/**
+ * Pools the string literals of a unit after a successful first pass, before the data symbols are moved after
+ * the code. A labeled .string whose label is the only one on its data is stored once for all the literals
+ * of the same text, and a literal that is a suffix of a longer one points into the longer one's copy.
+ * The data image is compacted and the data symbols get their new addresses. Where a literal was put inside
+ * a longer one's copy is recorded in the unit's literal splits.
+ * @param unit The unit
+ * @return The amount of data words saved
+ */
+long pool_string_literals(assembly_unit *unit);
+
+#endif
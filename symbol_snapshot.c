@@ -0,0 +1,166 @@
+/* Binary snapshot of the final symbol table (.sym), with a hash index for lookups without parsing */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "symbol_snapshot.h"
+#include "helper.h"
+#include "intern_pool.h"
+
+/** A distinct name of the table, while the snapshot is built */
+typedef struct snapshot_record {
+    intern_id name_id;
+    int kinds;
+    /** The code/data/external entry of the name, NULL if only seen as an entry so far */
+    table_entry *definition;
+} snapshot_record;
+
+/**
+ * Stores a 32 bit little endian field
+ * @param field Where to store
+ * @param value The value
+ */
+static void put_field(unsigned char *field, unsigned long value);
+
+/**
+ * Reads a 32 bit little endian field
+ * @param field The field
+ * @return The value
+ */
+static unsigned long get_field(unsigned char *field);
+
+bool write_symbol_snapshot(char *filename, table symbol_table) {
+    FILE *file_desc;
+    char *full_filename;
+    table_entry *entry;
+    snapshot_record *records;
+    unsigned long *buckets, bucket_count = 1, i;
+    long symbol_count = 0, entry_count = 0, strings_size = 0, size, string_offset;
+    unsigned char *snapshot, *field;
+    bool succeeded;
+
+    for (entry = symbol_table; entry != NULL; entry = entry->next) entry_count++;
+    /* Keep the load under a half */
+    while (bucket_count < 2 * (unsigned long) entry_count) bucket_count *= 2;
+    buckets = (unsigned long *) better_malloc(bucket_count * sizeof(unsigned long));
+    memset(buckets, 0, bucket_count * sizeof(unsigned long));
+    records = (snapshot_record *) better_malloc((entry_count + 1) * sizeof(snapshot_record));
+
+    /* A name that is both defined and an entry gets a single record */
+    for (entry = symbol_table; entry != NULL; entry = entry->next) {
+        unsigned long bucket = interned_hash(entry->key_id) & (bucket_count - 1);
+        for (; buckets[bucket] != 0 && records[buckets[bucket] - 1].name_id != entry->key_id;
+               bucket = (bucket + 1) & (bucket_count - 1));
+        if (buckets[bucket] == 0) {
+            records[symbol_count].name_id = entry->key_id;
+            records[symbol_count].kinds = 0;
+            records[symbol_count].definition = NULL;
+            strings_size += strlen(entry->key) + 1;
+            buckets[bucket] = ++symbol_count;
+        }
+        records[buckets[bucket] - 1].kinds |= SNAPSHOT_KIND(entry->type);
+        if (entry->type != ENTRY_SYMBOL) records[buckets[bucket] - 1].definition = entry;
+    }
+
+    size = SYMBOL_SNAPSHOT_HEADER_LENGTH + 4 * (long) bucket_count + 4 * SYMBOL_SNAPSHOT_RECORD_FIELDS * symbol_count +
+           strings_size;
+    snapshot = (unsigned char *) better_malloc(size);
+    memcpy(snapshot, SYMBOL_SNAPSHOT_MAGIC, 4);
+    put_field(snapshot + 4, SYMBOL_SNAPSHOT_VERSION);
+    put_field(snapshot + 8, symbol_count);
+    put_field(snapshot + 12, bucket_count);
+    put_field(snapshot + 16, strings_size);
+    for (i = 0, field = snapshot + SYMBOL_SNAPSHOT_HEADER_LENGTH; i < bucket_count; i++, field += 4) {
+        put_field(field, buckets[i]);
+    }
+    for (i = 0, string_offset = 0; i < (unsigned long) symbol_count; i++) {
+        snapshot_record *record = &records[i];
+        char *name = interned_string(record->name_id);
+        long name_length = strlen(name);
+        /* Entries always have a definition after a successful second pass */
+        long value = record->definition != NULL ? record->definition->value : 0;
+        put_field(field, interned_hash(record->name_id));
+        put_field(field + 4, string_offset);
+        put_field(field + 8, name_length);
+        put_field(field + 12, record->kinds);
+        put_field(field + 16, value);
+        put_field(field + 20, record->definition != NULL ? record->definition->base : 0);
+        put_field(field + 24, record->definition != NULL ? record->definition->offset : 0);
+        field += 4 * SYMBOL_SNAPSHOT_RECORD_FIELDS;
+        memcpy(snapshot + size - strings_size + string_offset, name, name_length + 1);
+        string_offset += name_length + 1;
+    }
+    free(buckets);
+    free(records);
+
+    /* concatenate filename & extension, and open the file for writing: */
+    full_filename = strcat_to_new(filename, SYMBOL_SNAPSHOT_SUFFIX);
+    file_desc = fopen(full_filename, "wb");
+    /* if failed, print error and exit */
+    if (file_desc == NULL) {
+        printf("Can't create or rewrite to file %s.", full_filename);
+        free(full_filename);
+        free(snapshot);
+        return FALSE;
+    }
+    free(full_filename);
+    succeeded = fwrite(snapshot, 1, size, file_desc) == (size_t) size;
+    fclose(file_desc);
+    free(snapshot);
+    return succeeded;
+}
+
+bool find_snapshot_symbol(unsigned char *snapshot, long size, char *name, snapshot_symbol *symbol) {
+    unsigned long symbol_count, bucket_count, strings_size, hash, bucket, probes;
+    unsigned char *buckets, *records, *strings;
+    long name_length = strlen(name);
+
+    if (size < SYMBOL_SNAPSHOT_HEADER_LENGTH || memcmp(snapshot, SYMBOL_SNAPSHOT_MAGIC, 4) != 0 ||
+        get_field(snapshot + 4) != SYMBOL_SNAPSHOT_VERSION) {
+        return FALSE;
+    }
+    symbol_count = get_field(snapshot + 8);
+    bucket_count = get_field(snapshot + 12);
+    strings_size = get_field(snapshot + 16);
+    /* The sizes must match the file, and the bucket count must be a power of 2 */
+    if (bucket_count == 0 || (bucket_count & (bucket_count - 1)) != 0 ||
+        (unsigned long) size != SYMBOL_SNAPSHOT_HEADER_LENGTH + 4 * bucket_count +
+                                4 * SYMBOL_SNAPSHOT_RECORD_FIELDS * symbol_count + strings_size) {
+        return FALSE;
+    }
+    buckets = snapshot + SYMBOL_SNAPSHOT_HEADER_LENGTH;
+    records = buckets + 4 * bucket_count;
+    strings = records + 4 * SYMBOL_SNAPSHOT_RECORD_FIELDS * symbol_count;
+
+    hash = intern_hash(name, (int) name_length);
+    for (bucket = hash & (bucket_count - 1), probes = 0; probes < bucket_count;
+         bucket = (bucket + 1) & (bucket_count - 1), probes++) {
+        unsigned long index = get_field(buckets + 4 * bucket), name_offset;
+        unsigned char *record;
+        if (index == 0 || index > symbol_count) return FALSE;
+        record = records + 4 * SYMBOL_SNAPSHOT_RECORD_FIELDS * (index - 1);
+        name_offset = get_field(record + 4);
+        if (get_field(record) != hash || get_field(record + 8) != (unsigned long) name_length ||
+            name_offset + name_length >= strings_size || memcmp(strings + name_offset, name, name_length) != 0) {
+            continue;
+        }
+        symbol->name = (char *) strings + name_offset;
+        symbol->kinds = (int) get_field(record + 12);
+        symbol->value = (long) get_field(record + 16);
+        symbol->base = (long) get_field(record + 20);
+        symbol->offset = (long) get_field(record + 24);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static void put_field(unsigned char *field, unsigned long value) {
+    field[0] = (unsigned char) (value & 0xff);
+    field[1] = (unsigned char) ((value >> 8) & 0xff);
+    field[2] = (unsigned char) ((value >> 16) & 0xff);
+    field[3] = (unsigned char) ((value >> 24) & 0xff);
+}
+
+static unsigned long get_field(unsigned char *field) {
+    return (unsigned long) field[0] | (unsigned long) field[1] << 8 | (unsigned long) field[2] << 16 |
+           (unsigned long) field[3] << 24;
+}
@@ -0,0 +1,62 @@
+/* Binary snapshot of the final symbol table (.sym), with a hash index for lookups without parsing */
+#ifndef _SYMBOL_SNAPSHOT_H
+#define _SYMBOL_SNAPSHOT_H
+#include "globals.h"
+#include "symbol_table.h"
+
+/*
+ * Layout, every field is a 32 bit little endian unsigned integer:
+ *   header:  magic "SYM1", version, symbol count, bucket count (a power of 2), strings size
+ *   buckets: bucket count fields, each the index + 1 of a record, 0 for an empty bucket.
+ *            A name's search starts at (hash & (bucket count - 1)) and goes on to the next bucket until empty.
+ *   records: symbol count records of hash, name offset, name length, kinds, value, base, offset.
+ *            hash is the 32 bit FNV-1a of the name, kinds are SNAPSHOT_KIND() bits of the symbol's types.
+ *   strings: the names, each null terminated, offsets are from the start of the strings.
+ * Values of entries are the values of their code/data symbols.
+ */
+
+#define SYMBOL_SNAPSHOT_SUFFIX ".sym"
+
+#define SYMBOL_SNAPSHOT_MAGIC "SYM1"
+
+#define SYMBOL_SNAPSHOT_VERSION 1
+
+/** Length of the header in bytes */
+#define SYMBOL_SNAPSHOT_HEADER_LENGTH 20
+
+/** Fields of a record */
+#define SYMBOL_SNAPSHOT_RECORD_FIELDS 7
+
+/** The kinds bit of a symbol type */
+#define SNAPSHOT_KIND(type) (1 << (type))
+
+/** A symbol found in a snapshot */
+typedef struct snapshot_symbol {
+    /** Points into the snapshot */
+    char *name;
+    /** SNAPSHOT_KIND() bits */
+    int kinds;
+    long value;
+    long base;
+    long offset;
+} snapshot_symbol;
+
+/**
+ * Writes the symbol table into filename.sym
+ * @param filename The filename without extension
+ * @param symbol_table The final symbol table
+ * @return Whether succeeded
+ */
+bool write_symbol_snapshot(char *filename, table symbol_table);
+
+/**
+ * Looks up a symbol in a snapshot, e.g. a mapped .sym file, in O(1) expected time
+ * @param snapshot The snapshot's content
+ * @param size The size of the snapshot in bytes
+ * @param name The symbol name
+ * @param symbol Filled with the symbol if found
+ * @return False if the symbol isn't in the snapshot or the snapshot isn't valid
+ */
+bool find_snapshot_symbol(unsigned char *snapshot, long size, char *name, snapshot_symbol *symbol);
+
+#endif
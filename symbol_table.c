@@ -6,45 +6,201 @@
 
 /* Table data structure based on sorted linked list */
 
+/** Maximum level of the skip list of stops */
+#define STOP_LEVELS 16
+
+/** A slot of the keys hash table */
+typedef struct key_slot {
+	/** NO_INTERN_ID for an empty slot */
+	intern_id key_id;
+	/** The entries of the key, linked by same_key */
+	table_entry *entries;
+} key_slot;
+
+/** A stop in the skip list: an entry after the head that isn't smaller than any entry before it */
+typedef struct stop_node {
+	table_entry *entry;
+	/** The entry before it in the table, a new entry is linked after it */
+	table_entry *previous;
+	/** Next stops, as many as the node's level (allocated past the end of the struct) */
+	struct stop_node *forward[1];
+} stop_node;
+
+struct symbol_index {
+	/** Open addressing hash table of the keys */
+	key_slot *slots;
+	/** Number of slots, a power of 2 */
+	unsigned long capacity;
+	long key_count;
+	/**
+	 * The stops, by their order in the table. Their values never decrease, and the first entry that insertion
+	 * doesn't pass (the first one after the head that isn't smaller than the value) is always a stop.
+	 */
+	stop_node *stops;
+	int stop_level;
+	/** Whether values changed or entries were removed since the stops were found */
+	bool is_stale;
+	/** The last entry of the table */
+	table_entry *last;
+	/** State of the levels' random generator */
+	unsigned long random;
+};
+
+/**
+ * Creates an empty index for a table that has a single entry
+ * @param head The entry
+ * @return The index
+ */
+static symbol_index *create_index(table_entry *head);
+
+/**
+ * Finds the slot of a key, or the empty slot where it belongs
+ * @param index The index, with slots
+ * @param key_id The key
+ * @return The slot
+ */
+static key_slot *find_key_slot(symbol_index *index, intern_id key_id);
+
+/**
+ * Adds an entry to the keys hash table
+ * @param index The index
+ * @param entry The entry
+ */
+static void add_entry_key(symbol_index *index, table_entry *entry);
+
+/**
+ * Finds the stops of a table again, and its last entry
+ * @param tab The table
+ */
+static void find_stops(table tab);
+
+/**
+ * Adds a stop after the given nodes
+ * @param index The index
+ * @param entry The stop entry
+ * @param previous The entry before it in the table
+ * @param update The node to add it after, at every level
+ */
+static void add_stop(symbol_index *index, table_entry *entry, table_entry *previous, stop_node **update);
+
+/**
+ * Deallocates the stops of an index
+ * @param index The index
+ */
+static void free_stops(symbol_index *index);
+
+/**
+ * Deallocates an index
+ * @param index The index, may be NULL
+ */
+static void free_index(symbol_index *index);
+
+/**
+ * Merge sorts a list of entries by value, entries of the same value keep their order
+ * @param tab ABSOLUTE pointer to the list
+ */
+static void sort_entries(table *tab);
+
 void add_table_item(table *tab, char *key, long value, symbol_type type) {
-	char *temp_key;
-	table prev_entry, curr_entry, new_entry;
+	table new_entry, old_head;
+	symbol_index *index;
+	stop_node *update[STOP_LEVELS], *stop;
+	int i;
     long offset = value % 16; /* Calc offset as explained in direct addressing */
 	/* allocate memory for new entry */
 	new_entry = (table) better_malloc(sizeof(table_entry));
-    /* +1 == '/0' */
-	temp_key = (char *) better_malloc(strlen(key) + 1);
-	strcpy(temp_key, key);
-	new_entry->key = temp_key;
+    /* The key isn't copied, every entry of the same name shares the pool's copy */
+	new_entry->key_id = intern_string(key);
+	new_entry->key = interned_string(new_entry->key_id);
 	new_entry->value = value;
 	new_entry->type = type;
     new_entry->base = value - offset;
     new_entry->offset = offset;
+	new_entry->index = NULL;
 	/* if the table's null, set the new entry as the head. */
-	if ((*tab) == NULL || (*tab)->value > value) {
-		new_entry->next = (*tab);
+	if ((*tab) == NULL) {
+		new_entry->next = NULL;
+		new_entry->index = create_index(new_entry);
+		add_entry_key(new_entry->index, new_entry);
 		(*tab) = new_entry;
 		return;
 	}
+	index = (*tab)->index;
+	if (index->is_stale) find_stops(*tab);
+	add_entry_key(index, new_entry);
 
-	/* Insert the new table entry, keeping it sorted */
-	curr_entry = (*tab)->next;
-	prev_entry = *tab;
-	while (curr_entry != NULL && curr_entry->value < value) {
-		prev_entry = curr_entry;
-		curr_entry = curr_entry->next;
+	if ((*tab)->value > value) {
+		/* The old head is the first stop now, the stops smaller than it aren't stops anymore */
+		old_head = (*tab);
+		new_entry->next = old_head;
+		new_entry->index = index;
+		old_head->index = NULL;
+		(*tab) = new_entry;
+		while ((stop = index->stops->forward[0]) != NULL && stop->entry->value < old_head->value) {
+			for (i = 0; i < index->stop_level && index->stops->forward[i] == stop; i++) {
+				index->stops->forward[i] = stop->forward[i];
+			}
+			free(stop);
+		}
+		for (i = 0; i < STOP_LEVELS; i++) update[i] = index->stops;
+		add_stop(index, old_head, new_entry, update);
+		return;
 	}
 
-	new_entry->next = curr_entry;
-	prev_entry->next = new_entry;
+	/* Insert the new table entry, keeping it sorted: before the first stop that isn't smaller */
+	stop = index->stops;
+	for (i = index->stop_level - 1; i >= 0; i--) {
+		while (stop->forward[i] != NULL && stop->forward[i]->entry->value < value) stop = stop->forward[i];
+		update[i] = stop;
+	}
+	stop = stop->forward[0];
+	if (stop == NULL) {
+		new_entry->next = NULL;
+		index->last->next = new_entry;
+		add_stop(index, new_entry, index->last, update);
+		index->last = new_entry;
+	} else {
+		new_entry->next = stop->entry;
+		stop->previous->next = new_entry;
+		add_stop(index, new_entry, stop->previous, update);
+		stop->previous = new_entry;
+	}
+}
+
+void remove_table_item(table *tab, table *link) {
+	table_entry *entry = *link, **same_key;
+	symbol_index *index = (*tab)->index;
+	*link = entry->next;
+	if (entry->index != NULL) {
+		entry->index = NULL;
+		if ((*tab) == NULL) {
+			free_index(index);
+			free(entry);
+			return;
+		}
+		(*tab)->index = index;
+	}
+	for (same_key = &find_key_slot(index, entry->key_id)->entries; *same_key != entry;
+	     same_key = &(*same_key)->same_key);
+	*same_key = entry->same_key;
+	/* A removed stop may make the entries after it stops */
+	index->is_stale = TRUE;
+	free(entry);
+}
+
+void set_table_item_value(table tab, table_entry *entry, long value) {
+	entry->value = value;
+	entry->offset = value % 16;
+	entry->base = value - entry->offset;
+	if (tab != NULL) tab->index->is_stale = TRUE;
 }
 
 void free_table(table tab) {
 	table prev_entry, curr_entry = tab;
+	if (tab != NULL) free_index(tab->index);
 	while (curr_entry != NULL) {
 		prev_entry = curr_entry;
 		curr_entry = curr_entry->next;
-		free(prev_entry->key); /* Didn't forget you!ssss */
 		free(prev_entry);
 	}
 }
@@ -64,44 +220,217 @@ void update_symbol_table_value(table tab, long to_add, symbol_type type) {
 
 		}
 	}
+	if (tab != NULL) tab->index->is_stale = TRUE;
 }
 
-table filter_table_by_type(table tab, symbol_type type) {
-	table new_table = NULL;
-	/* Insert to the new table entries with the corresponding type */
-	do {
-		if (tab->type == type) {
-			add_table_item(&new_table, tab->key, tab->value, tab->type);
-		}
-	} while ((tab = tab->next) != NULL);
-	return new_table; /* It holds a pointer to the first entry, dynamically-allocated, so it's fine (not in stack) */
+void sort_table_by_value(table *tab) {
+	symbol_index *index;
+	if ((*tab) == NULL) return;
+	/* The index moves to the new head */
+	index = (*tab)->index;
+	(*tab)->index = NULL;
+	sort_entries(tab);
+	(*tab)->index = index;
+	index->is_stale = TRUE;
+}
+
+table_entry *next_entry_of_type(table tab, symbol_type type) {
+	/* Skip entries of other types, the table itself is the view */
+	for (; tab != NULL && tab->type != type; tab = tab->next);
+	return tab;
 }
 
 table_entry *find_by_types(table table_entry, char *key, int symbol_count, ...) {
 	int i;
-    /* table null => return */
-    if (table_entry == NULL) {
+	unsigned int valid_symbol_types = 0;
+	va_list arg_list;
+	/* A name that was never interned isn't in any table */
+	intern_id key_id = find_interned(key, (int) strlen(key));
+    if (key_id == NO_INTERN_ID) {
         return NULL;
     }
-	symbol_type *valid_symbol_types = better_malloc((symbol_count) * sizeof(int));
-	/* Build a list of the valid types */
-	va_list arg_list;
+	/* Build a mask of the valid types */
 	va_start(arg_list, symbol_count);
 	for (i = 0; i < symbol_count; i++) {
-		valid_symbol_types[i] = va_arg(arg_list, symbol_type);
+		valid_symbol_types |= 1u << va_arg(arg_list, symbol_type);
 	}
 	va_end(arg_list);
 
-	/* Iterate over the table and return the table_entry if found */
-	do {
-		for (i = 0; i < symbol_count; i++) {
-			if (valid_symbol_types[i] == table_entry->type && strcmp(key, table_entry->key) == 0) {
-				free(valid_symbol_types);
-				return table_entry;
+	/* A key of a single entry of the types needs no scan, with more the first one in the table is needed */
+	if (table_entry != NULL && table_entry->index != NULL) {
+		struct entry *found = NULL, *same_key;
+		int found_count = 0;
+		if (table_entry->index->capacity == 0) return NULL;
+		for (same_key = find_key_slot(table_entry->index, key_id)->entries; same_key != NULL;
+		     same_key = same_key->same_key) {
+			if (valid_symbol_types & (1u << same_key->type)) {
+				found = same_key;
+				found_count++;
 			}
 		}
-	} while ((table_entry = table_entry->next) != NULL);
+		if (found_count < 2) return found;
+	}
+
+	/* Iterate over the table and return the table_entry if found, ids instead of strcmp */
+	for (; table_entry != NULL; table_entry = table_entry->next) {
+		if (table_entry->key_id == key_id && (valid_symbol_types & (1u << table_entry->type))) {
+			return table_entry;
+		}
+	}
 	/* not found, return NULL */
-	free(valid_symbol_types);
 	return NULL;
-}
\ No newline at end of file
+}
+
+void init_external_reference_log(external_reference_log *log) {
+	log->references = NULL;
+	log->count = log->capacity = 0;
+}
+
+void add_external_reference(external_reference_log *log, table_entry *symbol, long address) {
+	if (log->count == log->capacity) {
+		/* Double the capacity, so appending is amortized O(1) */
+		external_reference *grown;
+		log->capacity = log->capacity ? log->capacity * 2 : 16;
+		grown = (external_reference *) better_malloc(log->capacity * sizeof(external_reference));
+		if (log->count) memcpy(grown, log->references, log->count * sizeof(external_reference));
+		free(log->references);
+		log->references = grown;
+	}
+	log->references[log->count].symbol = symbol;
+	log->references[log->count].address = address;
+	log->count++;
+}
+
+void free_external_reference_log(external_reference_log *log) {
+	free(log->references);
+	init_external_reference_log(log);
+}
+
+static symbol_index *create_index(table_entry *head) {
+	symbol_index *index = (symbol_index *) better_malloc(sizeof(symbol_index));
+	index->slots = NULL;
+	index->capacity = 0;
+	index->key_count = 0;
+	index->stops = (stop_node *) better_malloc(sizeof(stop_node) + (STOP_LEVELS - 1) * sizeof(stop_node *));
+	memset(index->stops->forward, 0, STOP_LEVELS * sizeof(stop_node *));
+	index->stop_level = 1;
+	index->is_stale = FALSE;
+	index->last = head;
+	index->random = 1;
+	return index;
+}
+
+static key_slot *find_key_slot(symbol_index *index, intern_id key_id) {
+	unsigned long slot = ((unsigned long) key_id * 2654435761UL) & (index->capacity - 1);
+	while (index->slots[slot].key_id != NO_INTERN_ID && index->slots[slot].key_id != key_id) {
+		slot = (slot + 1) & (index->capacity - 1);
+	}
+	return &index->slots[slot];
+}
+
+static void add_entry_key(symbol_index *index, table_entry *entry) {
+	key_slot *slot;
+	if ((unsigned long) (index->key_count + 1) * 2 > index->capacity) {
+		/* Double the slots, so the table is at most half full */
+		key_slot *old_slots = index->slots;
+		unsigned long old_capacity = index->capacity, i;
+		index->capacity = old_capacity ? old_capacity * 2 : 16;
+		index->slots = (key_slot *) better_malloc(index->capacity * sizeof(key_slot));
+		for (i = 0; i < index->capacity; i++) {
+			index->slots[i].key_id = NO_INTERN_ID;
+			index->slots[i].entries = NULL;
+		}
+		for (i = 0; i < old_capacity; i++) {
+			if (old_slots[i].key_id != NO_INTERN_ID) *find_key_slot(index, old_slots[i].key_id) = old_slots[i];
+		}
+		free(old_slots);
+	}
+	slot = find_key_slot(index, entry->key_id);
+	if (slot->key_id == NO_INTERN_ID) {
+		slot->key_id = entry->key_id;
+		index->key_count++;
+	}
+	entry->same_key = slot->entries;
+	slot->entries = entry;
+}
+
+static void find_stops(table tab) {
+	symbol_index *index = tab->index;
+	stop_node *update[STOP_LEVELS];
+	table_entry *entry;
+	int i;
+	free_stops(index);
+	for (i = 0; i < STOP_LEVELS; i++) update[i] = index->stops;
+	for (entry = tab; entry->next != NULL; entry = entry->next) {
+		/* The stops' values never decrease, so the last one is the largest value so far */
+		if (update[0] == index->stops || entry->next->value >= update[0]->entry->value) {
+			add_stop(index, entry->next, entry, update);
+			for (i = 0; i < index->stop_level && update[i]->forward[i] != NULL; i++) update[i] = update[i]->forward[i];
+		}
+	}
+	index->last = entry;
+	index->is_stale = FALSE;
+}
+
+static void add_stop(symbol_index *index, table_entry *entry, table_entry *previous, stop_node **update) {
+	stop_node *stop;
+	int level = 1, i;
+	/* A level up for a quarter of the stops, from a linear congruential generator */
+	for (;;) {
+		index->random = (index->random * 1103515245UL + 12345UL) & 0xffffffffUL;
+		if (level == STOP_LEVELS || ((index->random >> 16) & 3) != 0) break;
+		level++;
+	}
+	stop = (stop_node *) better_malloc(sizeof(stop_node) + (level - 1) * sizeof(stop_node *));
+	stop->entry = entry;
+	stop->previous = previous;
+	for (; index->stop_level < level; index->stop_level++) update[index->stop_level] = index->stops;
+	for (i = 0; i < level; i++) {
+		stop->forward[i] = update[i]->forward[i];
+		update[i]->forward[i] = stop;
+	}
+}
+
+static void free_stops(symbol_index *index) {
+	stop_node *stop = index->stops->forward[0], *next;
+	for (; stop != NULL; stop = next) {
+		next = stop->forward[0];
+		free(stop);
+	}
+	memset(index->stops->forward, 0, STOP_LEVELS * sizeof(stop_node *));
+	index->stop_level = 1;
+}
+
+static void free_index(symbol_index *index) {
+	if (index == NULL) return;
+	free_stops(index);
+	free(index->stops);
+	free(index->slots);
+	free(index);
+}
+
+static void sort_entries(table *tab) {
+	table first, second, *tail;
+	long half, i;
+	/* Merge sort of the list, halves are split by counting */
+	for (half = 0, first = *tab; first != NULL; first = first->next) half++;
+	if (half < 2) return;
+	half /= 2;
+	for (i = 1, first = *tab; i < half; i++) first = first->next;
+	second = first->next;
+	first->next = NULL;
+	first = *tab;
+	sort_entries(&first);
+	sort_entries(&second);
+	for (tail = tab; first != NULL && second != NULL; tail = &(*tail)->next) {
+		/* Taking the first half on ties keeps the order */
+		if (second->value < first->value) {
+			*tail = second;
+			second = second->next;
+		} else {
+			*tail = first;
+			first = first->next;
+		}
+	}
+	*tail = first != NULL ? first : second;
+}
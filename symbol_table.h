@@ -1,6 +1,7 @@
 
 #ifndef _SYMBOL_TABLE_H
 #define _SYMBOL_TABLE_H
+#include "intern_pool.h"
 
 /* Implements a dynamically-allocated symbol table */
 
@@ -9,20 +10,23 @@ typedef enum symbol_type {
 	CODE_SYMBOL,
 	DATA_SYMBOL,
 	EXTERNAL_SYMBOL,
-	/** Address that contains a reference to (a usage of) external symbol */
-	EXTERNAL_REFERENCE,
 	ENTRY_SYMBOL
 } symbol_type;
 
 /** pointer to table entry is just a table. */
 typedef struct entry* table;
 
+/** Index of a table's keys and insertion points, held by its head entry */
+typedef struct symbol_index symbol_index;
+
 /** ABSOLUTE single table entry */
 typedef struct entry {
 	/** Next entry in table */
 	table next;
-    /** Key (symbol name) is a string (aka char*) */
+    /** Key (symbol name) is a string (aka char*), the interning pool's copy */
     char *key;
+    /** Interned id of the key, entries are compared by it */
+    intern_id key_id;
 	/** Address of the symbol */
 	long value;
     /** Base part of the address of the symbol */
@@ -31,8 +35,47 @@ typedef struct entry {
     long offset;
 	/** Symbol type */
 	symbol_type type;
+    /** Next entry of the same key, in the index */
+    struct entry *same_key;
+    /** The table's index if this is the head entry, NULL otherwise */
+    symbol_index *index;
 } table_entry;
 
+/** A single use of an external symbol by an operand */
+typedef struct external_reference {
+	/** The EXTERNAL_SYMBOL entry that is used */
+	table_entry *symbol;
+	/** Address of the operand's base word, the offset word follows it */
+	long address;
+} external_reference;
+
+/** Append-only log of external symbol uses, kept out of the symbol table so lookups don't walk them */
+typedef struct external_reference_log {
+	external_reference *references;
+	long count;
+	long capacity;
+} external_reference_log;
+
+/**
+ * Initializes an empty external references log
+ * @param log The log to initialize
+ */
+void init_external_reference_log(external_reference_log *log);
+
+/**
+ * Appends a use of an external symbol to the log
+ * @param log The log
+ * @param symbol The used EXTERNAL_SYMBOL entry
+ * @param address Address of the operand's base word
+ */
+void add_external_reference(external_reference_log *log, table_entry *symbol, long address);
+
+/**
+ * Deallocates the memory of the log (not the symbols it points to)
+ * @param log The log to deallocate
+ */
+void free_external_reference_log(external_reference_log *log);
+
 /**
  * Adds an item to the table, keeping it sorted.
  * @param tab ABSOLUTE pointer to the table
@@ -42,6 +85,21 @@ typedef struct entry {
  */
 void add_table_item(table *tab, char *key, long value, symbol_type type);
 
+/**
+ * Removes an entry from the table and deallocates it
+ * @param tab ABSOLUTE pointer to the table
+ * @param link Pointer to the entry, the table's head or the next of the entry before it
+ */
+void remove_table_item(table *tab, table *link);
+
+/**
+ * Sets the value of an entry, and its base and offset parts
+ * @param tab The table, containing the entry
+ * @param entry The entry
+ * @param value The new value
+ */
+void set_table_item_value(table tab, table_entry *entry, long value);
+
 /**
  * Deallocates all the memory required by the table.
  * @param tab The table to deallocate
@@ -57,12 +115,19 @@ void free_table(table tab);
 void update_symbol_table_value(table tab, long to_add, symbol_type type);
 
 /**
- * Returns all the entries by their type in a new table
- * @param tab The table
+ * Sorts the table by value again, after values were changed. Entries of the same value keep their order.
+ * @param tab ABSOLUTE pointer to the table
+ */
+void sort_table_by_value(table *tab);
+
+/**
+ * Finds the first entry of a type, without copying. Iterate all the entries of a type by
+ * for (e = next_entry_of_type(tab, type); e != NULL; e = next_entry_of_type(e->next, type))
+ * @param tab The table (or the rest of it) to search from
  * @param type The type to look for
- * @return ABSOLUTE new table, which contains the entries
+ * @return The first entry of the type, NULL if there's none
  */
-table filter_table_by_type(table tab, symbol_type type);
+table_entry *next_entry_of_type(table tab, symbol_type type);
 
 /**
  * Find entry from the only specified types
@@ -6,11 +6,11 @@ mov r3,K
 sub r1,r4
 bne END
 cmp K, #-6
-bne &END
+bne END
 dec W
 ;Comment0
 .entry MAIN
-jmp &LOOP
+jmp LOOP
 add L3,L3
 END: stop
 STR: .string "abcd"
@@ -66,7 +66,7 @@ dec fasdiu3245dghfgshdsf78dhkj12345
 
 ; jmp 12
 C0: jmp label0
-jmp &C0
+jmp C0
 
 ; Put some data here:
 
@@ -75,11 +75,11 @@ ALPHABETAGAMA123: .string "ALPHABETAGAMA123"
 
 ; bne 12
 CCC1: bne X
-bne &CCC1
+bne CCC1
 
 ; jsr 12
 C5: jsr X
-jsr &C5
+jsr C5
 
 ; red 13
 red r4
@@ -0,0 +1,601 @@
+/* Microbenchmarks of the hot helper functions - ns per operation on token mixes like those of real sources, with
+ * warmup, repeated samples, a statistical summary and a baseline file to compare an optimization against.
+ * usage: helper_bench [--filter TEXT] [--baseline FILE] [--save FILE] */
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "../globals.h"
+#include "../helper.h"
+#include "../opcode_builder.h"
+#include "../instruction_builder.h"
+#include "../symbol_table.h"
+#include "../output_module.h"
+#include "../assembly_unit.h"
+
+/** Shortest sample, the passes of a sample are doubled until it takes this long */
+#define BENCH_SAMPLE_MS 5.0
+
+/** Samples that run before the measured ones, to warm the caches and the branch predictors */
+#define BENCH_WARMUP_SAMPLES 3
+
+/** Measured samples of every benchmark */
+#define BENCH_SAMPLES 15
+
+/** Maximum benchmarks in a baseline file */
+#define BENCH_MAX_BASELINE 64
+
+/** Maximum length of a benchmark name, with its size */
+#define BENCH_NAME_LENGTH 48
+
+/** Blocks of the program that the .ob formatting benchmark writes, 49 words each */
+#define BENCH_PROGRAM_BLOCKS 100
+
+/** A single benchmark */
+typedef struct benchmark {
+    char *name;
+    /** Size of the input, like the symbol count of a table. 0 if it has none. */
+    long size;
+    /** Prepares the inputs, NULL if there's nothing to prepare */
+    void (*setup)(long size);
+    /** Runs a single pass over the inputs, returns the number of operations it did */
+    long (*run)(long size);
+    /** Frees the inputs, NULL if there's nothing to free */
+    void (*teardown)(void);
+} benchmark;
+
+/** The statistical summary of the samples of a benchmark, in ns per operation */
+typedef struct bench_summary {
+    double min;
+    double median;
+    double mean;
+    double stddev;
+} bench_summary;
+
+/** Median of a benchmark in the baseline file */
+typedef struct baseline_entry {
+    char name[BENCH_NAME_LENGTH];
+    double median;
+} baseline_entry;
+
+/** Results are added here, so the compiler can't drop the calls as unused */
+static volatile long bench_sink;
+
+/** Operands, registers and labels are the most common, like in the sample programs */
+static char *operand_texts[] = {
+        "r3\n", "LIST\n", "#48\n", "r6\n", "W\n", "r1\n", "r4\n", "END\n", "val1\n", "#-6\n", "END[r15]\n", "K\n",
+        "LOOP[r10]\n", "r14\n", "STR\n", "#1024\n", "r0\n", "counter\n", "MAIN\n", "r7\n"
+};
+
+/** Label definitions and uses, some are reserved words or malformed */
+static char *label_names[] = {
+        "MAIN", "LOOP", "END", "STR", "LIST", "K", "val1", "W", "PrintChars", "CharLoop", "EndCharLoop", "char0",
+        "startChar", "endChar", "r3", "mov", "1abc", "x", "thisIsALongLabelOfThirtyOneChr", "counter"
+};
+
+/** Command names, weighted by how often they appear */
+static char *command_names[] = {
+        "mov", "mov", "mov", "cmp", "cmp", "add", "sub", "lea", "clr", "not", "inc", "inc", "dec", "jmp", "bne",
+        "bne", "jsr", "red", "prn", "prn", "rts", "stop"
+};
+
+/** Operand parts of code lines, after the command */
+static char *operand_lines[] = {
+        " r3, LIST\n", " #48\n", " STR, r6\n", " r6\n", " r3, W\n", " r1, r4\n", " END\n", " val1, #-6\n",
+        " END[r15]\n", " K\n", " LOOP[r10] ,r14\n", "\n", " #-1, counter\n", " r0\n"
+};
+
+/** Values of .data instructions, after the instruction name */
+static char *data_lines[] = {
+        " 6, -9\n", " 31\n", " -100\n", " 7, -57, +17, 9\n", " 1, 2, 3, 4, 5, 6, 7, 8\n", " 0\n", " +1024, -1024\n"
+};
+
+/** Lines of a block of the .ob formatting program, %d is the block */
+static char *program_block[] = {
+        "MAIN%d: add r3, LIST%d\n", "LOOP%d: prn #48\n", "lea STR%d, r6\n", "inc r6\n", "mov r3, W\n",
+        "sub r1, r4\n", "bne END%d\n", "cmp val1, #-6\n", "bne END%d[r15]\n", "dec K%d\n", "sub LOOP%d[r10] ,r14\n",
+        "END%d: stop\n", "STR%d: .string \"abcd\"\n", "LIST%d: .data 6, -9\n", "K%d: .data 31\n"
+};
+
+#define COUNT_OF(array) ((long) (sizeof(array) / sizeof((array)[0])))
+
+/** Views of operand_texts, for get_addressing_type */
+static operand_view operand_views[COUNT_OF(operand_texts)];
+
+/** Keys of the symbol table benchmarks, the last quarter of them is never added */
+static char **table_keys = NULL;
+
+/** Order of the lookups, a permutation of the keys */
+static long *lookup_order = NULL;
+
+/** Symbol count of the keys' table */
+static long table_size = 0;
+
+/** The table of the lookup benchmark */
+static table lookup_table = NULL;
+
+/** The assembled program of the .ob formatting benchmark */
+static assembly_unit *program = NULL;
+
+/**
+ * Builds a line descriptor of a benchmark input
+ * @param content The line
+ * @return The line descriptor
+ */
+static line_descriptor bench_line(char *content);
+
+/**
+ * Splits operand_texts into operand_views
+ * @param size Unused
+ */
+static void setup_operand_views(long size);
+
+/**
+ * Finds the addressing type of every operand view
+ * @param size Unused
+ * @return The operand count
+ */
+static long run_get_addressing_type(long size);
+
+/**
+ * Validates every label name
+ * @param size Unused
+ * @return The name count
+ */
+static long run_is_valid_label_name(long size);
+
+/**
+ * Looks every command name up
+ * @param size Unused
+ * @return The name count
+ */
+static long run_get_opcode_func(long size);
+
+/**
+ * Splits the operands of every code line
+ * @param size Unused
+ * @return The line count
+ */
+static long run_analyze_operands(long size);
+
+/**
+ * Parses the values of every .data line
+ * @param size Unused
+ * @return The line count
+ */
+static long run_process_data_instruction(long size);
+
+/**
+ * Generates the keys, addresses interleave code and data symbols like the first pass adds them
+ * @param size The symbol count of the table
+ */
+static void setup_table_keys(long size);
+
+/**
+ * Frees the keys and the lookup order
+ */
+static void free_table_keys(void);
+
+/**
+ * Adds the first size keys to a new table
+ * @param size The symbol count
+ * @return The table
+ */
+static table build_table(long size);
+
+/**
+ * Builds a table of size symbols, and frees it. An operation is a single add.
+ * @param size The symbol count
+ * @return The symbol count
+ */
+static long run_add_table_item(long size);
+
+/**
+ * Generates the keys, and builds the table of the lookups
+ * @param size The symbol count
+ */
+static void setup_lookup_table(long size);
+
+/**
+ * Looks up every key of a table of size symbols, a quarter of them misses like the duplicate checks of new labels
+ * @param size The symbol count
+ * @return The lookup count
+ */
+static long run_find_by_types(long size);
+
+/**
+ * Frees the table of the lookups and its keys
+ */
+static void free_lookup_table(void);
+
+/**
+ * Assembles a program of BENCH_PROGRAM_BLOCKS blocks of code, data and external references
+ * @param size Unused
+ */
+static void setup_program(long size);
+
+/**
+ * Formats the whole image of the program into /dev/null. An operation is a single word.
+ * @param size Unused
+ * @return The word count
+ */
+static long run_write_ob(long size);
+
+/**
+ * Frees the program
+ */
+static void free_program(void);
+
+/**
+ * Runs a benchmark: doubles the passes until a sample takes BENCH_SAMPLE_MS, runs the warmup samples, then the
+ * measured ones
+ * @param bench The benchmark
+ * @param summary Output, the summary of the samples
+ */
+static void measure(benchmark *bench, bench_summary *summary);
+
+/**
+ * Runs passes of a benchmark
+ * @param bench The benchmark
+ * @param passes The number of passes
+ * @param operations Output, the number of operations
+ * @return The time it took, in ns
+ */
+static double run_passes(benchmark *bench, long passes, long *operations);
+
+/**
+ * Sorts the samples and summarizes them
+ * @param samples The ns per operation of every sample
+ * @param count The sample count
+ * @param summary Output, the summary
+ */
+static void summarize(double *samples, int count, bench_summary *summary);
+
+/**
+ * Reads a baseline file, lines of a name and its median
+ * @param path The file
+ * @param entries Output, the entries
+ * @return The entry count, -1 if the file can't be read
+ */
+static int read_baseline(char *path, baseline_entry *entries);
+
+/**
+ * Returns the monotonic clock in ns
+ */
+static double now_ns(void);
+
+/**
+ * qsort comparison of doubles, ascending
+ */
+static int compare_doubles(const void *a, const void *b);
+
+static benchmark benchmarks[] = {
+        {"get_addressing_type",      0,    setup_operand_views, run_get_addressing_type,      NULL},
+        {"is_valid_label_name",      0,    NULL,                run_is_valid_label_name,      NULL},
+        {"get_opcode_func",          0,    NULL,                run_get_opcode_func,          NULL},
+        {"analyze_operands",         0,    NULL,                run_analyze_operands,         NULL},
+        {"process_data_instruction", 0,    NULL,                run_process_data_instruction, NULL},
+        {"add_table_item",           16,   setup_table_keys,    run_add_table_item,           free_table_keys},
+        {"add_table_item",           256,  setup_table_keys,    run_add_table_item,           free_table_keys},
+        {"add_table_item",           4096, setup_table_keys,    run_add_table_item,           free_table_keys},
+        {"find_by_types",            16,   setup_lookup_table,  run_find_by_types,            free_lookup_table},
+        {"find_by_types",            256,  setup_lookup_table,  run_find_by_types,            free_lookup_table},
+        {"find_by_types",            4096, setup_lookup_table,  run_find_by_types,            free_lookup_table},
+        {"write_ob",                 0,    setup_program,       run_write_ob,                 free_program}
+};
+
+int main(int argc, char *argv[]) {
+    char *filter = NULL, *baseline_path = NULL, *save_path = NULL;
+    baseline_entry baseline[BENCH_MAX_BASELINE];
+    int i, k, baseline_count = 0;
+    FILE *save_file = NULL;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) filter = argv[++i];
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) baseline_path = argv[++i];
+        else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) save_path = argv[++i];
+        else {
+            printf("usage: %s [--filter TEXT] [--baseline FILE] [--save FILE]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (baseline_path != NULL && (baseline_count = read_baseline(baseline_path, baseline)) < 0) {
+        printf("Can't read baseline file %s.\n", baseline_path);
+        return 1;
+    }
+    if (save_path != NULL && (save_file = fopen(save_path, "w")) == NULL) {
+        printf("Can't create or rewrite to file %s.\n", save_path);
+        return 1;
+    }
+
+    printf("%-30s %10s %10s %10s %8s%s\n", "benchmark", "median ns", "min ns", "mean ns", "stddev",
+           baseline_count > 0 ? "  vs baseline" : "");
+    for (i = 0; i < COUNT_OF(benchmarks); i++) {
+        benchmark *bench = &benchmarks[i];
+        bench_summary summary;
+        char name[BENCH_NAME_LENGTH];
+        if (bench->size > 0) sprintf(name, "%.24s/%ld", bench->name, bench->size);
+        else sprintf(name, "%.30s", bench->name);
+        if (filter != NULL && strstr(name, filter) == NULL) continue;
+
+        if (bench->setup != NULL) bench->setup(bench->size);
+        measure(bench, &summary);
+        if (bench->teardown != NULL) bench->teardown();
+
+        printf("%-30s %10.2f %10.2f %10.2f %7.1f%%", name, summary.median, summary.min, summary.mean,
+               summary.mean > 0 ? summary.stddev * 100 / summary.mean : 0);
+        for (k = 0; k < baseline_count; k++) {
+            if (strcmp(baseline[k].name, name) == 0 && baseline[k].median > 0) {
+                printf("  %+10.1f%%", (summary.median - baseline[k].median) * 100 / baseline[k].median);
+                break;
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+        if (save_file != NULL) fprintf(save_file, "%s %.3f\n", name, summary.median);
+    }
+    if (save_file != NULL) fclose(save_file);
+    return 0;
+}
+
+static line_descriptor bench_line(char *content) {
+    line_descriptor line;
+    line.line_number = 1;
+    line.full_file_name = "helper_bench";
+    line.content = content;
+    line.diagnostics = NULL;
+    return line;
+}
+
+static void setup_operand_views(long size) {
+    long i;
+    int count;
+    (void) size;
+    for (i = 0; i < COUNT_OF(operand_texts); i++) {
+        analyze_operands(bench_line(operand_texts[i]), 0, &operand_views[i], &count);
+    }
+}
+
+static long run_get_addressing_type(long size) {
+    long i, sum = 0;
+    (void) size;
+    for (i = 0; i < COUNT_OF(operand_views); i++) {
+        sum += get_addressing_type(&operand_views[i]);
+    }
+    bench_sink += sum;
+    return COUNT_OF(operand_views);
+}
+
+static long run_is_valid_label_name(long size) {
+    long i, sum = 0;
+    (void) size;
+    for (i = 0; i < COUNT_OF(label_names); i++) {
+        sum += is_valid_label_name(label_names[i]);
+    }
+    bench_sink += sum;
+    return COUNT_OF(label_names);
+}
+
+static long run_get_opcode_func(long size) {
+    long i, sum = 0;
+    opcode op;
+    funct fun;
+    (void) size;
+    for (i = 0; i < COUNT_OF(command_names); i++) {
+        get_opcode_func(command_names[i], &op, &fun);
+        sum += op + fun;
+    }
+    bench_sink += sum;
+    return COUNT_OF(command_names);
+}
+
+static long run_analyze_operands(long size) {
+    long i, sum = 0;
+    int count;
+    operand_view operands[2];
+    (void) size;
+    for (i = 0; i < COUNT_OF(operand_lines); i++) {
+        analyze_operands(bench_line(operand_lines[i]), 0, operands, &count);
+        sum += count;
+    }
+    bench_sink += sum;
+    return COUNT_OF(operand_lines);
+}
+
+static long run_process_data_instruction(long size) {
+    long i, dc = 0, data_img[16];
+    (void) size;
+    for (i = 0; i < COUNT_OF(data_lines); i++) {
+        dc = 0;
+        process_data_instruction(bench_line(data_lines[i]), 0, data_img, &dc);
+        bench_sink += data_img[dc - 1];
+    }
+    return COUNT_OF(data_lines);
+}
+
+static void setup_table_keys(long size) {
+    long i, total = size + size / 3;
+    unsigned long random = 12345;
+    char key[MAX_LABEL_LENGTH + 1];
+    table_keys = (char **) better_malloc(total * sizeof(char *));
+    lookup_order = (long *) better_malloc(total * sizeof(long));
+    for (i = 0; i < total; i++) {
+        sprintf(key, "%s%ld", label_names[i % 14], i);
+        table_keys[i] = strcat_to_new(key, "");
+        lookup_order[i] = i;
+    }
+    /* The second pass looks the symbols up in the order of their uses, not of their definitions */
+    for (i = total - 1; i > 0; i--) {
+        long j, temp;
+        random = random * 1103515245 + 12345;
+        j = (long) ((random >> 16) % (unsigned long) (i + 1));
+        temp = lookup_order[i];
+        lookup_order[i] = lookup_order[j];
+        lookup_order[j] = temp;
+    }
+    table_size = size;
+}
+
+static void free_table_keys(void) {
+    long i;
+    for (i = 0; i < table_size + table_size / 3; i++) {
+        free(table_keys[i]);
+    }
+    free(table_keys);
+    free(lookup_order);
+    table_keys = NULL;
+    lookup_order = NULL;
+}
+
+static table build_table(long size) {
+    long i, ic = IC_INIT_VALUE, dc = 0;
+    table tab = NULL;
+    for (i = 0; i < size; i++) {
+        /* Every third symbol is data, code and data addresses each grow */
+        if (i % 3 == 2) {
+            add_table_item(&tab, table_keys[i], dc, DATA_SYMBOL);
+            dc += 2;
+        } else {
+            add_table_item(&tab, table_keys[i], ic, CODE_SYMBOL);
+            ic += 3;
+        }
+    }
+    return tab;
+}
+
+static long run_add_table_item(long size) {
+    table tab = build_table(size);
+    bench_sink += tab->value;
+    free_table(tab);
+    return size;
+}
+
+static void setup_lookup_table(long size) {
+    setup_table_keys(size);
+    lookup_table = build_table(size);
+}
+
+static long run_find_by_types(long size) {
+    long i, found = 0, total = size + size / 3;
+    for (i = 0; i < total; i++) {
+        if (find_by_types(lookup_table, table_keys[lookup_order[i]], 3, EXTERNAL_SYMBOL, DATA_SYMBOL,
+                          CODE_SYMBOL) != NULL) {
+            found++;
+        }
+    }
+    bench_sink += found;
+    return total;
+}
+
+static void free_lookup_table(void) {
+    free_table(lookup_table);
+    lookup_table = NULL;
+    free_table_keys();
+}
+
+static void setup_program(long size) {
+    char line[MAX_LINE_LENGTH + 2];
+    long i, block;
+    (void) size;
+    program = create_assembly_unit("helper_bench");
+    add_source_line(program, ".extern W\n", FALSE);
+    add_source_line(program, ".extern val1\n", FALSE);
+    for (block = 0; block < BENCH_PROGRAM_BLOCKS; block++) {
+        for (i = 0; i < COUNT_OF(program_block); i++) {
+            /* The unused arguments are ignored, lines have up to 2 labels */
+            sprintf(line, program_block[i], (int) block, (int) block);
+            add_source_line(program, line, FALSE);
+        }
+    }
+    for (i = 0; i < program->line_count; i++) {
+        first_pass_line(program, i);
+    }
+    finish_first_pass(program);
+    for (i = 0; program->success && i < program->line_count; i++) {
+        second_pass_line(program, i);
+    }
+    if (!program->success) printf("[ERROR] The program of write_ob didn't assemble\n");
+}
+
+static long run_write_ob(long size) {
+    ob_writer writer;
+    (void) size;
+    if (!program->success || !open_ob_writer(&writer, "/dev/null", program->icf, program->dcf)) return 0;
+    write_ob_code_words(&writer, program->code_img, 0, program->icf - IC_INIT_VALUE);
+    write_ob_data_words(&writer, program->data_img, program->dcf);
+    close_ob_writer(&writer);
+    return program->icf - IC_INIT_VALUE + program->dcf;
+}
+
+static void free_program(void) {
+    free_assembly_unit(program);
+    program = NULL;
+}
+
+static void measure(benchmark *bench, bench_summary *summary) {
+    double samples[BENCH_SAMPLES];
+    long passes = 1, operations;
+    int i;
+    /* Calibrating warms up too */
+    while (run_passes(bench, passes, &operations) < BENCH_SAMPLE_MS * 1000000 && operations > 0) {
+        passes *= 2;
+    }
+    for (i = 0; i < BENCH_WARMUP_SAMPLES; i++) {
+        run_passes(bench, passes, &operations);
+    }
+    for (i = 0; i < BENCH_SAMPLES; i++) {
+        double ns = run_passes(bench, passes, &operations);
+        samples[i] = operations > 0 ? ns / operations : 0;
+    }
+    summarize(samples, BENCH_SAMPLES, summary);
+}
+
+static double run_passes(benchmark *bench, long passes, long *operations) {
+    double start = now_ns();
+    long i;
+    *operations = 0;
+    for (i = 0; i < passes; i++) {
+        *operations += bench->run(bench->size);
+    }
+    return now_ns() - start;
+}
+
+static void summarize(double *samples, int count, bench_summary *summary) {
+    double variance = 0;
+    int i;
+    qsort(samples, count, sizeof(double), compare_doubles);
+    summary->min = samples[0];
+    summary->median = count % 2 ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2;
+    summary->mean = 0;
+    for (i = 0; i < count; i++) {
+        summary->mean += samples[i] / count;
+    }
+    for (i = 0; i < count; i++) {
+        variance += (samples[i] - summary->mean) * (samples[i] - summary->mean) / (count > 1 ? count - 1 : 1);
+    }
+    summary->stddev = sqrt(variance);
+}
+
+static int read_baseline(char *path, baseline_entry *entries) {
+    FILE *file_desc = fopen(path, "r");
+    int count = 0;
+    if (file_desc == NULL) return -1;
+    while (count < BENCH_MAX_BASELINE &&
+           fscanf(file_desc, "%47s %lf", entries[count].name, &entries[count].median) == 2) {
+        count++;
+    }
+    fclose(file_desc);
+    return count;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000.0 + ts.tv_nsec;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double first = *(const double *) a, second = *(const double *) b;
+    return first < second ? -1 : first > second;
+}
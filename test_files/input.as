@@ -10,10 +10,10 @@ LOOP:	prn #48
 		sub r1,r4
 		bne END
 		cmp K,#-6
-		bne &END
+		bne END
 		dec W
 .entry MAIN
-		jmp &LOOP
+		jmp LOOP
 		add L3, L3
 END:	stop
 
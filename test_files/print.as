@@ -9,7 +9,7 @@ MAIN: 			red r5
 				add r5, endChar
 				.extern startChar
 endChar:		.data 1, -78
-				jsr &PrintChars
+				jsr PrintChars
 				
 				clr startChar
 				clr endChar
@@ -23,7 +23,7 @@ CharLoop:		prn r0
 				inc r0
 				cmp r0, endChar
 				bne EndCharLoop
-				jmp &CharLoop
+				jmp CharLoop
 EndCharLoop:	rts
 .entry PrintChars
 
@@ -0,0 +1,358 @@
+/* Regression tests - behaviours that were fixed or deliberately changed, checked through the public functions of the
+ * assembler. Errors the cases expect are printed as usual, only the [FAIL] lines count.
+ * usage: regression_test */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../globals.h"
+#include "../helper.h"
+#include "../symbol_table.h"
+#include "../first_pass.h"
+#include "../assembly_unit.h"
+#include "../output_module.h"
+#include "../symbol_snapshot.h"
+#include "../dead_data.h"
+#include "../incremental_unit.h"
+
+/** A single test case */
+typedef struct regression_case {
+    char *name;
+    /** Runs the case, returns whether it passed */
+    bool (*run)(void);
+} regression_case;
+
+/**
+ * Builds a line descriptor of a test input
+ * @param content The line
+ * @return The line descriptor
+ */
+static line_descriptor test_line(char *content);
+
+/**
+ * Runs the first pass on a single code line, without a code image
+ * @param content The line
+ * @return Whether the first pass accepted the line
+ */
+static bool first_pass_accepts(char *content);
+
+/**
+ * Operands of no known addressing (like &LABEL) are rejected by every instruction. The addressing validation read an
+ * uninitialized flag before, and accepted them depending on the stack contents.
+ */
+static bool test_unknown_addressing_rejected(void);
+
+/**
+ * A unit whose code image is almost full is freed without going past the image. The word count was taken as the
+ * final address, 100 more, and the fields after the image were freed as words.
+ */
+static bool test_full_code_image_freed(void);
+
+/**
+ * A .ob write that fails (here on /dev/full, no space left) fails the file. The fwrite and fclose results were
+ * ignored before, and the file was reported as written.
+ */
+static bool test_failed_ob_write_reported(void);
+
+/**
+ * Assembles the lines of a program into a unit, through both passes
+ * @param unit A new unit, with its options set
+ * @param lines The lines, NULL terminated
+ */
+static void assemble_lines(assembly_unit *unit, char **lines);
+
+/**
+ * Reads a whole file
+ * @param path The file path
+ * @param size Set to the file size
+ * @return The content, NULL if the file can't be read
+ */
+static unsigned char *read_whole_file(char *path, long *size);
+
+/**
+ * Every symbol of a written .sym is found with its kinds and address, and a name that isn't in it is not found
+ */
+static bool test_symbol_snapshot_round_trip(void);
+
+/**
+ * Assembles a program and strips its unreferenced data
+ * @param lines The lines, NULL terminated
+ * @param pool_strings Whether string literals are pooled first
+ * @return The amount of removed data words, -1 if the program didn't assemble
+ */
+static long stripped_data_words(char **lines, bool pool_strings);
+
+/**
+ * With pooled strings, only a literal that pooling put inside a kept literal is kept with it. Before, any block
+ * after a kept block that didn't end in a terminator was kept, .data blocks included.
+ */
+static bool test_pooled_strip_keeps_only_split_literals(void);
+
+/**
+ * A line that fails in the second pass doesn't leave the counter behind, every next line goes on from its own
+ * words. The next lines were processed against the failed line's words before, and wrote into them.
+ */
+static bool test_failed_second_pass_line_realigned(void);
+
+/**
+ * Writes the lines of a program to a source file
+ * @param path The file path
+ * @param lines The lines, NULL terminated
+ * @return Whether succeeded
+ */
+static bool write_source_file(char *path, char **lines);
+
+/**
+ * @return Whether two files have the same content, or both can't be read
+ */
+static bool is_same_file(char *first_path, char *second_path);
+
+/**
+ * An update of a kept unit writes the same outputs as a full assembly of the edited source, after an edit that
+ * moves the code and data addresses and changes what a label resolves to. The lines around the edit are kept.
+ */
+static bool test_incremental_update_matches_full_assembly(void);
+
+static regression_case cases[] = {
+        {"unknown_addressing_rejected", test_unknown_addressing_rejected},
+        {"full_code_image_freed",       test_full_code_image_freed},
+        {"failed_ob_write_reported",    test_failed_ob_write_reported},
+        {"symbol_snapshot_round_trip",  test_symbol_snapshot_round_trip},
+        {"pooled_strip_keeps_only_split_literals", test_pooled_strip_keeps_only_split_literals},
+        {"failed_second_pass_line_realigned", test_failed_second_pass_line_realigned},
+        {"incremental_update_matches_full_assembly", test_incremental_update_matches_full_assembly}
+};
+
+int main(void) {
+    int i, failures = 0;
+    for (i = 0; i < (int) (sizeof(cases) / sizeof(cases[0])); i++) {
+        if (!cases[i].run()) {
+            printf("[FAIL] %s\n", cases[i].name);
+            failures++;
+        }
+    }
+    printf("%d of %d regression tests passed\n", (int) (sizeof(cases) / sizeof(cases[0])) - failures,
+           (int) (sizeof(cases) / sizeof(cases[0])));
+    return failures > 0;
+}
+
+static line_descriptor test_line(char *content) {
+    line_descriptor line;
+    line.line_number = 1;
+    line.full_file_name = "regression_test";
+    line.content = content;
+    line.diagnostics = NULL;
+    return line;
+}
+
+static bool first_pass_accepts(char *content) {
+    long ic = IC_INIT_VALUE, dc = 0, data_img[8];
+    table symbol_table = NULL;
+    bool accepted = process_line_first_pass(test_line(content), &ic, &dc, NULL, data_img, &symbol_table);
+    free_table(symbol_table);
+    return accepted;
+}
+
+static bool test_unknown_addressing_rejected(void) {
+    int i;
+    /* Repeated, the old result changed with whatever the stack held */
+    for (i = 0; i < 3; i++) {
+        if (first_pass_accepts("mov &LABEL, r1\n") || first_pass_accepts("mov r1, &LABEL\n") ||
+            first_pass_accepts("prn &LABEL\n") || first_pass_accepts("jmp &LABEL\n")) {
+            return FALSE;
+        }
+    }
+    return first_pass_accepts("mov LABEL, r1\n") && first_pass_accepts("jmp LABEL\n");
+}
+
+static bool test_full_code_image_freed(void) {
+    long i;
+    bool succeeded;
+    assembly_unit *unit = create_assembly_unit("regression_test");
+    for (i = 0; i < CODE_ARR_IMG_LENGTH - 42; i++) {
+        add_source_line(unit, "stop\n", FALSE);
+        first_pass_line(unit, i);
+    }
+    finish_first_pass(unit);
+    for (i = 0; unit->success && i < unit->line_count; i++) {
+        second_pass_line(unit, i);
+    }
+    succeeded = unit->success && unit->icf == IC_INIT_VALUE + CODE_ARR_IMG_LENGTH - 42;
+    free_assembly_unit(unit);
+    return succeeded;
+}
+
+static bool test_failed_ob_write_reported(void) {
+    ob_writer writer;
+    long data_img[] = {1, 2, 3};
+    if (!open_ob_writer(&writer, "/dev/full", IC_INIT_VALUE, 3)) return TRUE; /* No /dev/full here */
+    write_ob_data_words(&writer, data_img, 3);
+    return !close_ob_writer(&writer);
+}
+
+static void assemble_lines(assembly_unit *unit, char **lines) {
+    long i;
+    for (i = 0; lines[i] != NULL; i++) {
+        add_source_line(unit, lines[i], FALSE);
+        first_pass_line(unit, i);
+    }
+    finish_first_pass(unit);
+    for (i = 0; unit->success && i < unit->line_count; i++) {
+        second_pass_line(unit, i);
+    }
+}
+
+static unsigned char *read_whole_file(char *path, long *size) {
+    unsigned char *content;
+    FILE *file_desc = fopen(path, "rb");
+    if (file_desc == NULL) return NULL;
+    fseek(file_desc, 0, SEEK_END);
+    *size = ftell(file_desc);
+    rewind(file_desc);
+    content = (unsigned char *) better_malloc(*size > 0 ? *size : 1);
+    if ((long) fread(content, 1, *size, file_desc) != *size) {
+        free(content);
+        content = NULL;
+    }
+    fclose(file_desc);
+    return content;
+}
+
+static bool test_symbol_snapshot_round_trip(void) {
+    static char *lines[] = {".extern EXT\n", ".entry MAIN\n", ".entry LIST\n", "MAIN: mov LIST, r1\n",
+                            "LOOP: jmp EXT\n", "prn #-5\n", "stop\n", "LIST: .data 4, -7\n",
+                            "STR: .string \"ab\"\n", NULL};
+    assembly_unit *unit = create_assembly_unit("regression_test");
+    table_entry *entry;
+    snapshot_symbol symbol;
+    unsigned char *snapshot = NULL;
+    long size, defined_count = 0;
+    bool succeeded;
+    assemble_lines(unit, lines);
+    succeeded = unit->success && write_symbol_snapshot("regression_test", unit->symbol_table) &&
+                     (snapshot = read_whole_file("regression_test" SYMBOL_SNAPSHOT_SUFFIX, &size)) != NULL;
+    for (entry = unit->symbol_table; succeeded && entry != NULL; entry = entry->next) {
+        succeeded = find_snapshot_symbol(snapshot, size, entry->key, &symbol) && strcmp(symbol.name, entry->key) == 0 &&
+                    (symbol.kinds & SNAPSHOT_KIND(entry->type)) != 0;
+        /* An entry's address is the address of its definition */
+        if (succeeded && entry->type != ENTRY_SYMBOL) {
+            succeeded = symbol.value == entry->value && symbol.base == entry->base && symbol.offset == entry->offset;
+            defined_count++;
+        }
+    }
+    /* MAIN and LIST are both defined and entries */
+    succeeded = succeeded && defined_count == 5 && find_snapshot_symbol(snapshot, size, "MAIN", &symbol) &&
+                symbol.kinds == (SNAPSHOT_KIND(CODE_SYMBOL) | SNAPSHOT_KIND(ENTRY_SYMBOL)) &&
+                !find_snapshot_symbol(snapshot, size, "MISSING", &symbol) &&
+                !find_snapshot_symbol(snapshot, size, "MAI", &symbol);
+    free(snapshot);
+    remove("regression_test" SYMBOL_SNAPSHOT_SUFFIX);
+    free_assembly_unit(unit);
+    return succeeded;
+}
+
+static long stripped_data_words(char **lines, bool pool_strings) {
+    long removed = -1;
+    assembly_unit *unit = create_assembly_unit("regression_test");
+    unit->options.pool_strings = pool_strings;
+    assemble_lines(unit, lines);
+    if (unit->success) removed = strip_unreferenced_data(unit);
+    free_assembly_unit(unit);
+    return removed;
+}
+
+static bool test_pooled_strip_keeps_only_split_literals(void) {
+    static char *data_then_string[] = {"mov D1, r1\n", "stop\n", "D1: .data 1, 2, 3\n", "UN: .string \"zzz\"\n",
+                                       NULL};
+    /* SHORT is pooled into the end of LONG, so the kept LONG needs it */
+    static char *split_literal[] = {"mov LONG, r1\n", "stop\n", "LONG: .string \"xabc\"\n",
+                                    "SHORT: .string \"abc\"\n", "UN: .string \"zzz\"\n", NULL};
+    return stripped_data_words(data_then_string, FALSE) == 4 && stripped_data_words(data_then_string, TRUE) == 4 &&
+           stripped_data_words(split_literal, FALSE) == 8 && stripped_data_words(split_literal, TRUE) == 4;
+}
+
+static bool test_failed_second_pass_line_realigned(void) {
+    long i;
+    bool succeeded = TRUE;
+    assembly_unit *unit = create_assembly_unit("regression_test");
+    static char *lines[] = {"cmp U1, V1\n", "jmp U2\n", "prn #1\n", "stop\n", "mov r1, U3\n", "stop\n"};
+    for (i = 0; i < (long) (sizeof(lines) / sizeof(lines[0])); i++) {
+        add_source_line(unit, lines[i], FALSE);
+        first_pass_line(unit, i);
+    }
+    finish_first_pass(unit);
+    for (i = 0; i < unit->line_count; i++) {
+        second_pass_line(unit, i);
+        succeeded = succeeded && unit->ic == (i + 1 < unit->line_count ? unit->lines[i + 1].ic : unit->icf);
+    }
+    succeeded = succeeded && !unit->success;
+    free_assembly_unit(unit);
+    return succeeded;
+}
+
+static bool write_source_file(char *path, char **lines) {
+    long i;
+    bool succeeded;
+    FILE *file_desc = fopen(path, "w");
+    if (file_desc == NULL) return FALSE;
+    for (i = 0; lines[i] != NULL; i++) {
+        fputs(lines[i], file_desc);
+    }
+    succeeded = !ferror(file_desc);
+    return fclose(file_desc) == 0 && succeeded;
+}
+
+static bool is_same_file(char *first_path, char *second_path) {
+    long first_size = 0, second_size = 0;
+    unsigned char *first = read_whole_file(first_path, &first_size), *second = read_whole_file(second_path, &second_size);
+    bool is_same = first_size == second_size && (first == NULL) == (second == NULL) &&
+                   (first == NULL || memcmp(first, second, first_size) == 0);
+    free(first);
+    free(second);
+    return is_same;
+}
+
+static bool test_incremental_update_matches_full_assembly(void) {
+    static char *before[] = {".extern EXT\n", ".entry MAIN\n", "MAIN: mov LIST, r1\n", "jmp EXT\n", "stop\n",
+                             "LIST: .data 4, -7\n", "STR: .string \"ab\"\n", NULL};
+    /* The lines added before MAIN move the kept lines after them, and the data after the code */
+    static char *after[] = {".extern EXT\n", ".entry MAIN\n", "prn #3\n", "cmp STR, EXT\n", ".entry STR\n",
+                            "MAIN: mov LIST, r1\n", "jmp EXT\n", "stop\n", "LIST: .data 4, -7\n",
+                            "STR: .string \"ab\"\n", NULL};
+    static char *outputs[] = {".ob", ".ext", ".ent"};
+    incremental_unit kept;
+    include_log includes;
+    assembly_unit *unit = create_assembly_unit("regression_full");
+    char *first_line, *moved_line;
+    bool succeeded;
+    int i;
+
+    init_incremental_unit(&kept, "regression_test");
+    init_include_log(&includes);
+    succeeded = write_source_file("regression_test" PRE_MARCO_SUFFIX, before) &&
+                update_incremental_unit(&kept, &unit->options, 1, &includes);
+    first_line = succeeded ? kept.unit->lines[0].content : NULL;
+    moved_line = succeeded ? kept.unit->lines[2].content : NULL;
+    succeeded = succeeded && write_source_file("regression_test" PRE_MARCO_SUFFIX, after) &&
+                update_incremental_unit(&kept, &unit->options, 1, &includes) &&
+                kept.unit->lines[0].content == first_line && kept.unit->lines[5].content == moved_line;
+
+    assemble_lines(unit, after);
+    succeeded = succeeded && unit->success &&
+                write_output_files(unit->code_img, unit->data_img, unit->icf, unit->dcf, "regression_full",
+                                   unit->symbol_table, &unit->external_references, 1);
+    for (i = 0; i < (int) (sizeof(outputs) / sizeof(outputs[0])); i++) {
+        char *kept_path = strcat_to_new("regression_test", outputs[i]);
+        char *full_path = strcat_to_new("regression_full", outputs[i]);
+        succeeded = succeeded && is_same_file(kept_path, full_path);
+        remove(kept_path);
+        remove(full_path);
+        free(kept_path);
+        free(full_path);
+    }
+    remove("regression_test" PRE_MARCO_SUFFIX);
+    remove("regression_test" POST_MARCO_SUFFIX);
+    free_include_log(&includes);
+    free_incremental_unit(&kept);
+    free_assembly_unit(unit);
+    return succeeded;
+}
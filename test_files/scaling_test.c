@@ -0,0 +1,296 @@
+/* Complexity regression test - assembles generated files of doubling sizes, and fails if the time or the peak
+ * memory grows faster than near-linear in the size.
+ * usage: scaling_test <assembler> [work directory] */
+/* wait4() isn't part of POSIX */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/** Sizes of every dimension, each twice the previous one. The images hold 8192 words, so the largest files have
+ * more lines than words. */
+#define SCALING_SIZES 5
+#define SCALING_FIRST_SIZE 1024
+
+/** Every size is assembled this many times, the cheapest run counts */
+#define SCALING_REPEATS 9
+
+/** Smallest growth over an empty file that is measured, less is noise. The CPU time of a run moves by tenths of
+ * a millisecond, and the peak memory by whole pages (and allocator arenas), tens of KB. */
+#define TIME_FLOOR_MS 0.5
+#define MEMORY_FLOOR_KB 256
+
+/** Highest allowed exponents of the growth, a bit above linear to allow n log n and noise */
+#define TIME_EXPONENT_LIMIT 1.35
+#define MEMORY_EXPONENT_LIMIT 1.3
+
+/** Maximum length of a generated file's path */
+#define SCALING_PATH_LENGTH 512
+
+/** Writes an assembly source of a size */
+typedef void (*source_generator)(FILE *file_desc, long size);
+
+/** A dimension of the input that is scaled */
+typedef struct scaling_dimension {
+    char *name;
+    source_generator generate;
+} scaling_dimension;
+
+/** What assembling a file took */
+typedef struct run_cost {
+    /** CPU time of the assembler, user and system */
+    double ms;
+    /** Peak resident memory of the assembler */
+    long kilobytes;
+} run_cost;
+
+/**
+ * An empty file, the cost every size has
+ * @param file_desc The source file
+ * @param size The size
+ */
+static void generate_empty(FILE *file_desc, long size);
+
+/**
+ * Comments, empty lines and instructions, 3 lines per size unit and a code word per 4
+ * @param file_desc The source file
+ * @param size The size
+ */
+static void generate_lines(FILE *file_desc, long size);
+
+/**
+ * Code and data labels that are interleaved by address, and an .entry of each, a label per 2 size units
+ * @param file_desc The source file
+ * @param size The size
+ */
+static void generate_labels(FILE *file_desc, long size);
+
+/**
+ * Data labels that are used as operands in a scattered order, so every operand is a symbol lookup, a label per
+ * 8 size units and an operand per label
+ * @param file_desc The source file
+ * @param size The size
+ */
+static void generate_references(FILE *file_desc, long size);
+
+/**
+ * Macros that are all defined first and used after, a code word per 4
+ * @param file_desc The source file
+ * @param size The size
+ */
+static void generate_macros(FILE *file_desc, long size);
+
+/**
+ * External symbols, every 16th of them used
+ * @param file_desc The source file
+ * @param size The size
+ */
+static void generate_externs(FILE *file_desc, long size);
+
+/**
+ * Generates a file and assembles it SCALING_REPEATS times
+ * @param assembler Path of the assembler
+ * @param directory The work directory
+ * @param dimension The dimension
+ * @param size The size
+ * @param cost Output, the cheapest time and memory of the runs
+ * @return Whether every run succeeded
+ */
+static int measure(char *assembler, char *directory, scaling_dimension *dimension, long size, run_cost *cost);
+
+/**
+ * Runs the assembler on a file once
+ * @param assembler Path of the assembler
+ * @param filename The extensionless source name
+ * @param cost Output, the time and memory of the run
+ * @return Whether the assembler exited normally and wrote the object file
+ */
+static int run_assembler(char *assembler, char *filename, run_cost *cost);
+
+/**
+ * Returns the least squares slope of log(values) by log(sizes), the exponent of the growth
+ * @param sizes The sizes
+ * @param values The growth of each size over the empty file
+ * @param count The amount of sizes
+ * @param floor The smallest value that isn't noise
+ */
+static double growth_exponent(long *sizes, double *values, int count, double floor);
+
+static scaling_dimension empty_file = {"empty", generate_empty};
+
+static scaling_dimension dimensions[] = {
+        {"lines",      generate_lines},
+        {"labels",     generate_labels},
+        {"references", generate_references},
+        {"macros",     generate_macros},
+        {"externs",    generate_externs}
+};
+
+int main(int argc, char *argv[]) {
+    int d, i, failures = 0;
+    char *directory = argc > 2 ? argv[2] : ".";
+    run_cost empty;
+    if (argc < 2) {
+        printf("usage: %s <assembler> [work directory]\n", argv[0]);
+        return 2;
+    }
+    /* Starting the process costs the same at every size, only what grows is compared */
+    if (!measure(argv[1], directory, &empty_file, 0, &empty)) {
+        printf("assembling an empty file failed\n");
+        return 1;
+    }
+    printf("%-10s %6d %10.3f ms %8ld KB\n", empty_file.name, 0, empty.ms, empty.kilobytes);
+    for (d = 0; d < (int) (sizeof(dimensions) / sizeof(dimensions[0])); d++) {
+        long sizes[SCALING_SIZES];
+        double times[SCALING_SIZES], memory[SCALING_SIZES], time_exponent, memory_exponent;
+        for (i = 0; i < SCALING_SIZES; i++) {
+            run_cost cost;
+            sizes[i] = (long) SCALING_FIRST_SIZE << i;
+            if (!measure(argv[1], directory, &dimensions[d], sizes[i], &cost)) {
+                printf("%s: assembling size %ld failed\n", dimensions[d].name, sizes[i]);
+                return 1;
+            }
+            times[i] = cost.ms - empty.ms;
+            memory[i] = (double) (cost.kilobytes - empty.kilobytes);
+            printf("%-10s %6ld %10.3f ms %8ld KB\n", dimensions[d].name, sizes[i], cost.ms, cost.kilobytes);
+        }
+        time_exponent = growth_exponent(sizes, times, SCALING_SIZES, TIME_FLOOR_MS);
+        memory_exponent = growth_exponent(sizes, memory, SCALING_SIZES, MEMORY_FLOOR_KB);
+        printf("%-10s time ~ n^%.2f, memory ~ n^%.2f\n", dimensions[d].name, time_exponent, memory_exponent);
+        if (time_exponent > TIME_EXPONENT_LIMIT) {
+            printf("[FAIL] %s: time grows as n^%.2f, over n^%.2f\n", dimensions[d].name, time_exponent,
+                   TIME_EXPONENT_LIMIT);
+            failures++;
+        }
+        if (memory_exponent > MEMORY_EXPONENT_LIMIT) {
+            printf("[FAIL] %s: memory grows as n^%.2f, over n^%.2f\n", dimensions[d].name, memory_exponent,
+                   MEMORY_EXPONENT_LIMIT);
+            failures++;
+        }
+    }
+    return failures > 0;
+}
+
+static void generate_empty(FILE *file_desc, long size) {
+    /* Nothing, the file is created empty */
+    (void) file_desc;
+    (void) size;
+}
+
+static void generate_lines(FILE *file_desc, long size) {
+    long i;
+    for (i = 0; i < size; i++) {
+        fprintf(file_desc, "; line %ld\n\n%s\n", i, i % 4 ? "; no code" : "\tstop");
+    }
+}
+
+static void generate_labels(FILE *file_desc, long size) {
+    long i;
+    /* Code labels are at 100 and up, data labels at 0 and up, so they are inserted between each other */
+    for (i = 0; i < size; i += 4) {
+        fprintf(file_desc, "C%ld:\tstop\nD%ld:\t.data %ld\n", i, i, i);
+    }
+    for (i = 0; i < size; i += 4) {
+        fprintf(file_desc, ".entry C%ld\n.entry D%ld\n", i, i);
+    }
+}
+
+static void generate_references(FILE *file_desc, long size) {
+    long i, count = size / 8;
+    /* 7 is odd and the count a power of 2, so the second operands visit the labels out of order */
+    for (i = 0; i < count / 2; i++) {
+        fprintf(file_desc, "\tcmp ReferencedDataLabel%ld, ReferencedDataLabel%ld\n", i, (i * 7 + 3) % count);
+    }
+    fprintf(file_desc, "\tstop\n");
+    for (i = 0; i < count; i++) {
+        fprintf(file_desc, "ReferencedDataLabel%ld:\t.data %ld\n", i, i);
+    }
+}
+
+static void generate_macros(FILE *file_desc, long size) {
+    long i;
+    for (i = 0; i < size; i++) {
+        fprintf(file_desc, "macro mac%ld\n%s\nendm\n", i, i % 4 ? "; no code" : "\tstop");
+    }
+    for (i = 0; i < size; i++) {
+        fprintf(file_desc, "mac%ld\n", i);
+    }
+}
+
+static void generate_externs(FILE *file_desc, long size) {
+    long i;
+    for (i = 0; i < size; i++) {
+        fprintf(file_desc, ".extern X%ld\n", i);
+    }
+    for (i = 0; i < size; i += 16) {
+        fprintf(file_desc, "\tjmp X%ld\n", i);
+    }
+}
+
+static int measure(char *assembler, char *directory, scaling_dimension *dimension, long size, run_cost *cost) {
+    char filename[SCALING_PATH_LENGTH], path[SCALING_PATH_LENGTH + 8];
+    FILE *file_desc;
+    int i;
+    cost->ms = 0;
+    cost->kilobytes = 0;
+    sprintf(filename, "%.400s/scale_%s_%ld", directory, dimension->name, size);
+    sprintf(path, "%s.as", filename);
+    if ((file_desc = fopen(path, "w")) == NULL) {
+        printf("Can't create or rewrite to file %s.\n", path);
+        return 0;
+    }
+    dimension->generate(file_desc, size);
+    fclose(file_desc);
+
+    for (i = 0; i < SCALING_REPEATS; i++) {
+        run_cost run;
+        if (!run_assembler(assembler, filename, &run)) return 0;
+        if (i == 0 || run.ms < cost->ms) cost->ms = run.ms;
+        if (i == 0 || run.kilobytes < cost->kilobytes) cost->kilobytes = run.kilobytes;
+    }
+    return 1;
+}
+
+static int run_assembler(char *assembler, char *filename, run_cost *cost) {
+    char object_path[SCALING_PATH_LENGTH + 8];
+    struct rusage usage;
+    int status;
+    pid_t pid;
+    sprintf(object_path, "%s.ob", filename);
+    remove(object_path);
+
+    fflush(stdout);
+    if ((pid = fork()) < 0) return 0;
+    if (pid == 0) {
+        /* The assembler's messages aren't interesting, only its cost */
+        if (freopen("/dev/null", "w", stdout) == NULL) _exit(127);
+        execl(assembler, assembler, filename, (char *) NULL);
+        _exit(127);
+    }
+    if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return 0;
+    cost->ms = usage.ru_utime.tv_sec * 1000.0 + usage.ru_utime.tv_usec / 1000.0 +
+               usage.ru_stime.tv_sec * 1000.0 + usage.ru_stime.tv_usec / 1000.0;
+    cost->kilobytes = usage.ru_maxrss;
+    return access(object_path, F_OK) == 0;
+}
+
+static double growth_exponent(long *sizes, double *values, int count, double floor) {
+    double mean_x = 0, mean_y = 0, covariance = 0, variance = 0;
+    int i;
+    for (i = 0; i < count; i++) {
+        mean_x += log((double) sizes[i]) / count;
+        mean_y += log(values[i] > floor ? values[i] : floor) / count;
+    }
+    for (i = 0; i < count; i++) {
+        double x = log((double) sizes[i]) - mean_x;
+        covariance += x * (log(values[i] > floor ? values[i] : floor) - mean_y);
+        variance += x * x;
+    }
+    return covariance / variance;
+}
@@ -0,0 +1,259 @@
+/* Timeline trace (--trace) - spans and counters of every thread and worker, exported as Chrome trace events */
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "trace.h"
+#include "helper.h"
+
+/** Event kinds, by their Chrome trace phase */
+#define TRACE_SPAN 'X'
+#define TRACE_COUNTER 'C'
+
+/** A single recorded event */
+typedef struct trace_event {
+    /** Microseconds since the trace started */
+    double start;
+    double duration;
+    /** The counter's value */
+    long value;
+    char kind;
+    char name[TRACE_NAME_LENGTH];
+    char detail[TRACE_DETAIL_LENGTH];
+} trace_event;
+
+/** Ring buffer of the events of a single thread, only the owning thread writes it */
+typedef struct trace_buffer {
+    /** Process id of the owning thread, minus it when the thread exited and another one of the process can take it */
+    long owner;
+    /** Process of the events */
+    long pid;
+    /** Events written so far, the last TRACE_BUFFER_EVENTS are kept */
+    long count;
+    trace_event events[TRACE_BUFFER_EVENTS];
+} trace_buffer;
+
+/** The recording, in memory shared by the workers */
+typedef struct trace_region {
+    /** Time of start_trace, all the processes use the same monotonic clock */
+    double start;
+    /** Buffers taken so far */
+    long claimed;
+    trace_buffer buffers[TRACE_BUFFERS];
+} trace_region;
+
+/** The recording, NULL if not recording */
+static trace_region *region = NULL;
+
+/** The trace file */
+static char *trace_path = NULL;
+
+/** Process that started recording */
+static long recorder_pid;
+
+/** The calling thread's buffer */
+static pthread_key_t buffer_key;
+
+/**
+ * Finds the calling thread's buffer, or takes one
+ * @return The buffer, NULL if all were taken
+ */
+static trace_buffer *get_thread_buffer(void);
+
+/**
+ * Thread exit - lets another thread of the process take the buffer
+ * @param buffer The trace_buffer
+ */
+static void release_thread_buffer(void *buffer);
+
+/**
+ * Adds an event to the calling thread's buffer
+ * @param kind TRACE_SPAN or TRACE_COUNTER
+ * @param name The name
+ * @param detail The file name, NULL if none
+ * @return The event to fill the times and value of, NULL if it can't be recorded
+ */
+static trace_event *add_event(char kind, char *name, char *detail);
+
+/**
+ * Writes a string as a JSON string
+ * @param file_desc The file
+ * @param text The string
+ */
+static void write_json_string(FILE *file_desc, char *text);
+
+/**
+ * Returns the monotonic clock in microseconds
+ */
+static double monotonic_us(void);
+
+bool start_trace(char *path) {
+    int zero_fd;
+    void *memory;
+    if (region != NULL) return TRUE;
+    /* A shared mapping of /dev/zero is shared anonymous memory, which forked workers write into */
+    if ((zero_fd = open("/dev/zero", O_RDWR)) < 0) return FALSE;
+    memory = mmap(NULL, sizeof(trace_region), PROT_READ | PROT_WRITE, MAP_SHARED, zero_fd, 0);
+    close(zero_fd);
+    if (memory == MAP_FAILED || pthread_key_create(&buffer_key, release_thread_buffer) != 0) {
+        if (memory != MAP_FAILED) munmap(memory, sizeof(trace_region));
+        return FALSE;
+    }
+    region = (trace_region *) memory;
+    region->start = monotonic_us();
+    region->claimed = 0;
+    trace_path = path;
+    recorder_pid = (long) getpid();
+    return TRUE;
+}
+
+bool is_tracing(void) {
+    return region != NULL;
+}
+
+double trace_now(void) {
+    if (region == NULL) return 0;
+    /* The thread holds a buffer from its first span's start, so threads that overlap never share one */
+    get_thread_buffer();
+    return monotonic_us() - region->start;
+}
+
+void trace_span(char *name, char *detail, double start) {
+    trace_event *event;
+    if (region == NULL || (event = add_event(TRACE_SPAN, name, detail)) == NULL) return;
+    event->start = start;
+    event->duration = trace_now() - start;
+}
+
+void trace_counter(char *name, long value) {
+    trace_event *event;
+    if (region == NULL || (event = add_event(TRACE_COUNTER, name, NULL)) == NULL) return;
+    event->start = trace_now();
+    event->value = value;
+}
+
+bool finish_trace(void) {
+    FILE *file_desc;
+    long i, k, claimed;
+    char *separator = "";
+    if (region == NULL || (long) getpid() != recorder_pid) return TRUE;
+
+    file_desc = fopen(trace_path, "w");
+    if (file_desc == NULL) {
+        printf("Can't create or rewrite to file %s.", trace_path);
+        munmap(region, sizeof(trace_region));
+        region = NULL;
+        return FALSE;
+    }
+    claimed = region->claimed < TRACE_BUFFERS ? region->claimed : TRACE_BUFFERS;
+    fprintf(file_desc, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (i = 0; i < claimed; i++) {
+        trace_buffer *buffer = &region->buffers[i];
+        /* The thread of the buffer is its index, unique in all the processes */
+        fprintf(file_desc, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%ld,", separator,
+                buffer->pid, i);
+        fprintf(file_desc, "\"args\":{\"name\":\"%s %ld\"}}", buffer->pid == recorder_pid ? "thread" : "worker thread",
+                i);
+        separator = ",";
+        /* Only the last TRACE_BUFFER_EVENTS events are kept */
+        for (k = buffer->count > TRACE_BUFFER_EVENTS ? buffer->count - TRACE_BUFFER_EVENTS : 0; k < buffer->count;
+             k++) {
+            trace_event *event = &buffer->events[k % TRACE_BUFFER_EVENTS];
+            fprintf(file_desc, ",\n{\"name\":");
+            write_json_string(file_desc, event->name);
+            fprintf(file_desc, ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%ld,\"tid\":%ld,", event->kind, event->start,
+                    buffer->pid, i);
+            if (event->kind == TRACE_SPAN) {
+                fprintf(file_desc, "\"dur\":%.3f,\"args\":{", event->duration);
+                if (event->detail[0] != '\0') {
+                    fprintf(file_desc, "\"file\":");
+                    write_json_string(file_desc, event->detail);
+                }
+                fprintf(file_desc, "}}");
+            } else {
+                fprintf(file_desc, "\"args\":{\"value\":%ld}}", event->value);
+            }
+        }
+    }
+    fprintf(file_desc, "\n]}\n");
+    fclose(file_desc);
+    munmap(region, sizeof(trace_region));
+    region = NULL;
+    return TRUE;
+}
+
+static trace_buffer *get_thread_buffer(void) {
+    trace_buffer *buffer = (trace_buffer *) pthread_getspecific(buffer_key);
+    long pid = (long) getpid(), i, idle = -pid, taken;
+    /* A forked worker inherits its parent thread's buffer, which isn't its own */
+    if (buffer != NULL && buffer->owner == pid) return buffer;
+
+    /* A buffer of a thread of this process that exited, its events stay */
+    for (i = 0, buffer = NULL; i < region->claimed && i < TRACE_BUFFERS && buffer == NULL; i++) {
+        long expected = idle;
+        if (__atomic_compare_exchange_n(&region->buffers[i].owner, &expected, pid, FALSE, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE)) {
+            buffer = &region->buffers[i];
+        }
+    }
+    if (buffer == NULL) {
+        if ((taken = __atomic_fetch_add(&region->claimed, 1, __ATOMIC_ACQ_REL)) >= TRACE_BUFFERS) return NULL;
+        buffer = &region->buffers[taken];
+        buffer->owner = buffer->pid = pid;
+        buffer->count = 0;
+    }
+    pthread_setspecific(buffer_key, buffer);
+    return buffer;
+}
+
+static void release_thread_buffer(void *buffer) {
+    trace_buffer *thread_buffer = (trace_buffer *) buffer;
+    if (thread_buffer->owner == (long) getpid()) {
+        __atomic_store_n(&thread_buffer->owner, -thread_buffer->owner, __ATOMIC_RELEASE);
+    }
+}
+
+static trace_event *add_event(char kind, char *name, char *detail) {
+    trace_buffer *buffer = get_thread_buffer();
+    trace_event *event;
+    if (buffer == NULL) return NULL;
+    event = &buffer->events[buffer->count % TRACE_BUFFER_EVENTS];
+    buffer->count++;
+    event->kind = kind;
+    event->value = 0;
+    event->duration = 0;
+    strncpy(event->name, name, TRACE_NAME_LENGTH - 1);
+    event->name[TRACE_NAME_LENGTH - 1] = '\0';
+    event->detail[0] = '\0';
+    if (detail != NULL) {
+        size_t length = strlen(detail);
+        /* The end of a long path tells the files apart */
+        strcpy(event->detail, detail + (length >= TRACE_DETAIL_LENGTH ? length - TRACE_DETAIL_LENGTH + 1 : 0));
+    }
+    return event;
+}
+
+static void write_json_string(FILE *file_desc, char *text) {
+    fputc('"', file_desc);
+    for (; *text; text++) {
+        if (*text == '"' || *text == '\\') {
+            fprintf(file_desc, "\\%c", *text);
+        } else if ((unsigned char) *text < ' ') {
+            fprintf(file_desc, "\\u%04x", (unsigned char) *text);
+        } else {
+            fputc(*text, file_desc);
+        }
+    }
+    fputc('"', file_desc);
+}
+
+static double monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
@@ -0,0 +1,59 @@
+/* Timeline trace (--trace) - spans and counters of every thread and worker, exported as Chrome trace events */
+#ifndef _TRACE_H
+#define _TRACE_H
+#include "globals.h"
+
+/** Maximum length of an event name, longer names are cut */
+#define TRACE_NAME_LENGTH 24
+
+/** Maximum length of an event's file name, longer names keep their end */
+#define TRACE_DETAIL_LENGTH 64
+
+/** Number of thread buffers, shared by all the workers. A thread that finds none records nothing. */
+#define TRACE_BUFFERS 64
+
+/** Events of a single thread buffer, the oldest are overwritten */
+#define TRACE_BUFFER_EVENTS 512
+
+/**
+ * Starts recording. Must be called before any thread or worker process starts, as the buffers are shared
+ * memory that the workers inherit.
+ * @param path The trace file, written by finish_trace
+ * @return Whether succeeded
+ */
+bool start_trace(char *path);
+
+/**
+ * Returns whether recording, to skip gathering counters otherwise
+ */
+bool is_tracing(void);
+
+/**
+ * Returns the current time of the trace in microseconds, for trace_span
+ * @return The time, 0 if not recording
+ */
+double trace_now(void);
+
+/**
+ * Records a span of the calling thread, from start to now. Does nothing if not recording.
+ * @param name The span name, like "first_pass"
+ * @param detail The file the span worked on, NULL if none
+ * @param start The start time, from trace_now
+ */
+void trace_span(char *name, char *detail, double start);
+
+/**
+ * Records the value of a counter, like the symbol count of a file. Does nothing if not recording.
+ * @param name The counter name
+ * @param value The value
+ */
+void trace_counter(char *name, long value);
+
+/**
+ * Writes the recorded events of all the threads and workers as Chrome/Perfetto trace events, and stops recording.
+ * Must be called by the process that started recording, after its threads and workers finished.
+ * @return Whether succeeded, True if not recording
+ */
+bool finish_trace(void);
+
+#endif
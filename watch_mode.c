@@ -0,0 +1,181 @@
+/* Watch mode - reassembles files when their sources change, updating the unit of the last assembly */
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include "watch_mode.h"
+#include "helper.h"
+#include "intern_pool.h"
+
+/** Size of the inotify read buffer, fits many events */
+#define WATCH_EVENT_BUFFER_LENGTH 16384
+
+/** A file that is reassembled when its source changes */
+typedef struct watched_file {
+    /** The extensionless file name */
+    char *filename;
+    /** The files the last assembly read: the source first, and then the files it included */
+    include_log sources;
+    /** Watch descriptor of the directory of every source, -1 if it couldn't be watched */
+    int *source_watches;
+    /** Whether the file has to be reassembled */
+    bool is_changed;
+    /** The unit of the last assembly */
+    incremental_unit kept;
+} watched_file;
+
+/**
+ * Reads the pending events and marks the files they change
+ * @param notify_fd The inotify descriptor
+ * @param files The watched files
+ * @param file_count The amount of files
+ * @return False if the events couldn't be read
+ */
+static bool read_changes(int notify_fd, watched_file *files, int file_count);
+
+/**
+ * Assembles a single file, prints how long it took, and watches the files it read
+ * @param notify_fd The inotify descriptor
+ * @param file The file
+ * @param processor The function that fully processes a single file
+ */
+static void reassemble(int notify_fd, watched_file *file, watched_file_processor processor);
+
+/**
+ * Watches the directory of a file. Editors often replace a file instead of writing it, so the directory is watched.
+ * A directory that is already watched keeps its watch descriptor.
+ * @param notify_fd The inotify descriptor
+ * @param path The path of the file
+ * @return The watch descriptor, -1 if the directory couldn't be watched
+ */
+static int watch_directory(int notify_fd, char *path);
+
+/**
+ * Returns the current time in milliseconds, from an arbitrary point
+ */
+static double now_ms(void);
+
+int run_watch(char **filenames, int file_count, watched_file_processor processor) {
+    watched_file *files = (watched_file *) better_malloc(file_count * sizeof(watched_file));
+    int notify_fd = inotify_init(), i;
+
+    if (notify_fd < 0) {
+        printf_error("[ERROR] Unable to watch the source files\n");
+        free(files);
+        return 1;
+    }
+    for (i = 0; i < file_count; i++) {
+        files[i].filename = filenames[i];
+        init_include_log(&files[i].sources);
+        files[i].source_watches = NULL;
+        init_incremental_unit(&files[i].kept, filenames[i]);
+        files[i].is_changed = TRUE;
+    }
+
+    for (;;) {
+        /* A cached included file is reused when its own content didn't change, even if a file it includes did */
+        clear_included_modules();
+        /* Every label and macro name that was ever typed is interned, start over once they add up */
+        if (interned_count() > WATCH_INTERN_LIMIT) {
+            for (i = 0; i < file_count; i++) {
+                free_incremental_unit(&files[i].kept);
+            }
+            reset_intern_pool();
+            for (i = 0; i < file_count; i++) {
+                init_incremental_unit(&files[i].kept, filenames[i]);
+            }
+        }
+        for (i = 0; i < file_count; i++) {
+            if (files[i].is_changed) reassemble(notify_fd, &files[i], processor);
+        }
+        fflush(stdout);
+        if (!read_changes(notify_fd, files, file_count)) break;
+    }
+
+    for (i = 0; i < file_count; i++) {
+        free_incremental_unit(&files[i].kept);
+        free_include_log(&files[i].sources);
+        free(files[i].source_watches);
+    }
+    free(files);
+    close(notify_fd);
+    printf_error("[ERROR] Unable to read the changes of the source files\n");
+    return 1;
+}
+
+static bool read_changes(int notify_fd, watched_file *files, int file_count) {
+    char buffer[WATCH_EVENT_BUFFER_LENGTH];
+    struct pollfd pending;
+    bool is_any_changed = FALSE;
+    pending.fd = notify_fd;
+    pending.events = POLLIN;
+
+    /* Wait for a change of a watched file, and then until the changes settle */
+    while (!is_any_changed || poll(&pending, 1, WATCH_SETTLE_MS) > 0) {
+        ssize_t length = read(notify_fd, buffer, sizeof(buffer)), offset;
+        if (length <= 0) return FALSE;
+        for (offset = 0; offset < length;) {
+            struct inotify_event *event = (struct inotify_event *) (buffer + offset);
+            int i;
+            long k;
+            offset += sizeof(struct inotify_event) + event->len;
+            if (event->len == 0) continue;
+            for (i = 0; i < file_count; i++) {
+                for (k = 0; !files[i].is_changed && k < files[i].sources.count; k++) {
+                    char *path = files[i].sources.paths[k], *slash = strrchr(path, '/');
+                    if (files[i].source_watches[k] == event->wd &&
+                        strcmp(slash != NULL ? slash + 1 : path, event->name) == 0) {
+                        files[i].is_changed = is_any_changed = TRUE;
+                    }
+                }
+            }
+        }
+    }
+    return TRUE;
+}
+
+static void reassemble(int notify_fd, watched_file *file, watched_file_processor processor) {
+    double start_ms = now_ms();
+    char *source = strcat_to_new(file->filename, PRE_MARCO_SUFFIX);
+    bool succeeded;
+    long i;
+    file->is_changed = FALSE;
+    free_include_log(&file->sources);
+    add_include_path(&file->sources, source);
+    free(source);
+    succeeded = processor(file->filename, &file->kept, &file->sources);
+    printf("%s: %s in %.3f ms\n", file->filename, succeeded ? "assembled" : "failed", now_ms() - start_ms);
+
+    /* The includes may have changed, watch the files this assembly read */
+    free(file->source_watches);
+    file->source_watches = (int *) better_malloc(file->sources.count * sizeof(int));
+    for (i = 0; i < file->sources.count; i++) {
+        file->source_watches[i] = watch_directory(notify_fd, file->sources.paths[i]);
+    }
+}
+
+static int watch_directory(int notify_fd, char *path) {
+    char *slash = strrchr(path, '/'), *directory;
+    int watch;
+    if (slash != NULL) {
+        directory = strcat_to_new(path, "");
+        directory[slash - path + (slash == path)] = '\0';
+    } else {
+        directory = strcat_to_new(".", "");
+    }
+    /* The same mask, so a directory that is already watched keeps its watch */
+    watch = inotify_add_watch(notify_fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (watch < 0) printf_error("[ERROR] Unable to watch the directory: %s\n", directory);
+    free(directory);
+    return watch;
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
@@ -0,0 +1,33 @@
+/* Watch mode - reassembles files when their sources change, updating the unit of the last assembly */
+#ifndef _WATCH_MODE_H
+#define _WATCH_MODE_H
+#include "globals.h"
+#include "incremental_unit.h"
+#include "include_cache.h"
+
+/** Interned strings above which the pool is reset (with the kept units that refer to it) between assemblies */
+#define WATCH_INTERN_LIMIT 1048576
+
+/** Milliseconds to wait for more changes after a change, editors save a file in several steps */
+#define WATCH_SETTLE_MS 20
+
+/**
+ * Full processing function of a single extensionless file name, returns True if good.
+ * The file's kept unit is updated when it can be, instead of assembling the file in full.
+ * The paths of the files that the expansion included are added to includes.
+ */
+typedef bool (*watched_file_processor)(char *filename, incremental_unit *kept, include_log *includes);
+
+/**
+ * Assembles the files, and then reassembles a file every time its source, or a file it included in its last
+ * assembly, is written. Every file keeps its unit between assemblies, so a reassembly passes only the lines
+ * that changed (see update_incremental_unit).
+ * Runs until interrupted.
+ * @param filenames The extensionless file names
+ * @param file_count The amount of files
+ * @param processor The function that fully processes a single file
+ * @return 1 if the sources couldn't be watched
+ */
+int run_watch(char **filenames, int file_count, watched_file_processor processor);
+
+#endif